@@ -0,0 +1,280 @@
+//! Throughput and allocation counts of the exporter on a fixed corpus.
+//!
+//! Run with `cargo bench --manifest-path ffi/Cargo.toml`. Each entry point
+//! is timed on every document for at least `MIN_TIME`; the table reports
+//! input megabytes per second and heap allocations per document. An
+//! optional argument only runs the documents whose name contains it.
+//! Export options stay at their defaults (all off), so highlighting and
+//! MathML are not measured here.
+
+use std::alloc::{GlobalAlloc, Layout, System};
+use std::hint::black_box;
+use std::os::raw::c_char;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::time::{Duration, Instant};
+
+use org_ffi::{
+    bench, org_extract_metadata, org_extract_toc, org_free_metadata, org_free_string,
+    org_parse_to_html,
+};
+
+const MIN_TIME: Duration = Duration::from_millis(500);
+const MIN_RUNS: u32 = 5;
+
+/// System allocator that counts allocations and allocated bytes.
+struct Counting;
+
+static ALLOCATIONS: AtomicUsize = AtomicUsize::new(0);
+static ALLOCATED_BYTES: AtomicUsize = AtomicUsize::new(0);
+
+unsafe impl GlobalAlloc for Counting {
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        ALLOCATIONS.fetch_add(1, Ordering::Relaxed);
+        ALLOCATED_BYTES.fetch_add(layout.size(), Ordering::Relaxed);
+        System.alloc(layout)
+    }
+
+    unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+        System.dealloc(ptr, layout)
+    }
+
+    unsafe fn realloc(&self, ptr: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
+        ALLOCATIONS.fetch_add(1, Ordering::Relaxed);
+        ALLOCATED_BYTES.fetch_add(new_size, Ordering::Relaxed);
+        System.realloc(ptr, layout, new_size)
+    }
+}
+
+#[global_allocator]
+static GLOBAL: Counting = Counting;
+
+/// Deterministic word source so the corpus is the same on every run.
+struct Words {
+    state: u64,
+}
+
+impl Words {
+    fn new(seed: u64) -> Self {
+        Words { state: seed }
+    }
+
+    fn next(&mut self, n: usize) -> usize {
+        self.state = self.state.wrapping_mul(6364136223846793005).wrapping_add(1442695040888963407);
+        (self.state >> 33) as usize % n
+    }
+
+    fn pick<'a>(&mut self, words: &[&'a str]) -> &'a str {
+        words[self.next(words.len())]
+    }
+}
+
+const LATIN: &[&str] = &[
+    "the", "exporter", "walks", "a", "tree", "of", "headlines", "and", "writes", "html",
+    "with", "links", "lists", "tables", "into", "one", "buffer", "per", "document",
+];
+const CJK: &[&str] = &[
+    "构建", "时间", "的", "文章", "中文", "排版", "和", "代码", "块", "链接", "标题", "缓存",
+    "我们", "使用", "来", "生成", "静态", "页面",
+];
+
+fn header(title: &str) -> String {
+    format!(
+        "#+TITLE: {}\n#+DATE: <2024-05-01 Wed 10:00>\n#+DESCRIPTION: Benchmark corpus\n#+FILETAGS: :bench:org:\n\n",
+        title
+    )
+}
+
+fn small_post() -> String {
+    let mut words = Words::new(1);
+    let mut doc = header("Small post");
+    for section in 0..4 {
+        doc.push_str(&format!("* Section {}\n", section));
+        for _ in 0..3 {
+            for i in 0..40 {
+                doc.push_str(words.pick(LATIN));
+                doc.push_str(if i % 9 == 8 { " *bold* " } else { " " });
+            }
+            doc.push_str("\n\n");
+        }
+        doc.push_str("- item one\n- item /two/\n- item =three=\n\n");
+    }
+    doc
+}
+
+fn cjk_prose() -> String {
+    let mut words = Words::new(2);
+    let mut doc = header("长篇中文");
+    for section in 0..60 {
+        doc.push_str(&format!("* 第 {} 节\n", section));
+        for _ in 0..8 {
+            for i in 0..120 {
+                doc.push_str(words.pick(CJK));
+                if i % 11 == 10 {
+                    doc.push_str(words.pick(LATIN));
+                }
+                if i % 30 == 29 {
+                    doc.push('，');
+                }
+            }
+            doc.push_str("。\n\n");
+        }
+    }
+    doc
+}
+
+fn code_heavy() -> String {
+    let mut words = Words::new(3);
+    let mut doc = header("Code heavy");
+    for section in 0..40 {
+        doc.push_str(&format!("* Listing {}\nSome words before the code.\n\n", section));
+        let lang = ["rust", "c", "python", "sh"][section % 4];
+        doc.push_str(&format!("#+begin_src {}\n", lang));
+        for line in 0..60 {
+            doc.push_str(&format!(
+                "    let {}_{} = {}({}, \"{}\"); // {}\n",
+                words.pick(LATIN),
+                line,
+                words.pick(LATIN),
+                line * 7,
+                words.pick(LATIN),
+                words.pick(LATIN)
+            ));
+        }
+        doc.push_str("#+end_src\n\n");
+    }
+    doc
+}
+
+fn huge_table() -> String {
+    let mut words = Words::new(4);
+    let mut doc = header("Huge table");
+    doc.push_str("* Data\n| id | name | value | note |\n|----+------+-------+------|\n");
+    for row in 0..5000 {
+        doc.push_str(&format!(
+            "| {} | {} | {}.{} | {} {} |\n",
+            row,
+            words.pick(LATIN),
+            words.next(1000),
+            words.next(100),
+            words.pick(LATIN),
+            words.pick(CJK)
+        ));
+    }
+    doc
+}
+
+fn url_dense() -> String {
+    let mut words = Words::new(5);
+    let mut doc = header("Links everywhere");
+    for section in 0..30 {
+        doc.push_str(&format!("* Links {}\n", section));
+        for i in 0..60 {
+            doc.push_str(&format!(
+                "See https://example.org/{}/{}?q={} and (http://{}.example.com/path_{}), ",
+                words.pick(LATIN),
+                i,
+                words.next(100),
+                words.pick(LATIN),
+                i
+            ));
+            if i % 3 == 0 {
+                doc.push_str(&format!("参见 https://例子.cn/{}。", words.pick(CJK)));
+            }
+            if i % 10 == 9 {
+                doc.push_str("\n\n");
+            }
+        }
+        doc.push_str("\n\n");
+    }
+    doc
+}
+
+struct Measurement {
+    runs: u32,
+    elapsed: Duration,
+    allocations: usize,
+    allocated_bytes: usize,
+}
+
+/// Runs `f` until `MIN_TIME` has passed, counting allocations in the
+/// timed runs only.
+fn measure(mut f: impl FnMut()) -> Measurement {
+    f(); // warm up caches and the thread's scratch buffers
+    let allocations = ALLOCATIONS.load(Ordering::Relaxed);
+    let allocated_bytes = ALLOCATED_BYTES.load(Ordering::Relaxed);
+    let start = Instant::now();
+    let mut runs = 0;
+    while runs < MIN_RUNS || start.elapsed() < MIN_TIME {
+        f();
+        runs += 1;
+    }
+    Measurement {
+        runs,
+        elapsed: start.elapsed(),
+        allocations: ALLOCATIONS.load(Ordering::Relaxed) - allocations,
+        allocated_bytes: ALLOCATED_BYTES.load(Ordering::Relaxed) - allocated_bytes,
+    }
+}
+
+fn report(document: &str, entry: &str, len: usize, m: &Measurement) {
+    let seconds = m.elapsed.as_secs_f64() / m.runs as f64;
+    println!(
+        "{:<12} {:<22} {:>9.1} {:>10.1} {:>12} {:>12}",
+        document,
+        entry,
+        len as f64 / seconds / 1e6,
+        seconds * 1e6,
+        m.allocations / m.runs as usize,
+        m.allocated_bytes / m.runs as usize,
+    );
+}
+
+fn main() {
+    // `cargo bench` passes `--bench`; the first other argument filters.
+    let filter = std::env::args().skip(1).find(|arg| !arg.starts_with('-'));
+    let corpus: [(&str, String); 5] = [
+        ("small", small_post()),
+        ("cjk", cjk_prose()),
+        ("code", code_heavy()),
+        ("table", huge_table()),
+        ("urls", url_dense()),
+    ];
+
+    println!(
+        "{:<12} {:<22} {:>9} {:>10} {:>12} {:>12}",
+        "document", "entry point", "MB/s", "us/doc", "allocs/doc", "bytes/doc"
+    );
+    for (name, text) in &corpus {
+        if filter.as_deref().is_some_and(|filter| !name.contains(filter)) {
+            continue;
+        }
+        let input = text.as_ptr() as *const c_char;
+        let len = text.len();
+
+        let m = measure(|| {
+            let html = org_parse_to_html(input, len);
+            assert!(!html.is_null());
+            org_free_string(black_box(html));
+        });
+        report(name, "org_parse_to_html", len, &m);
+
+        let m = measure(|| {
+            let meta = org_extract_metadata(input, len);
+            assert!(!meta.is_null());
+            org_free_metadata(black_box(meta));
+        });
+        report(name, "org_extract_metadata", len, &m);
+
+        let m = measure(|| {
+            let toc = org_extract_toc(input, len);
+            assert!(!toc.is_null());
+            org_free_string(black_box(toc));
+        });
+        report(name, "org_extract_toc", len, &m);
+
+        let m = measure(|| {
+            black_box(bench::autolink(black_box(text)));
+        });
+        report(name, "autolink", len, &m);
+    }
+}
@@ -0,0 +1,186 @@
+//! Flat preorder view of a parsed document for C-side passes.
+//!
+//! Every element becomes one fixed-size `OrgNode` in a single array, with
+//! parent and next-sibling links as indices and the element's text as a
+//! byte range into the original input. Syntax nodes with no public kind,
+//! such as headline stars or block delimiters, are left out and their
+//! children attach to the nearest kept ancestor. Of the tokens only text
+//! is kept.
+
+use orgize::ast::{
+    BabelCall, Bold, CenterBlock, Clock, Code, Comment, CommentBlock, Cookie, Document, Drawer,
+    Entity, ExampleBlock, ExportBlock, FixedWidth, FnDef, FnRef, Headline, InlineCall, InlineSrc,
+    Italic, Keyword, LatexEnvironment, LatexFragment, LineBreak, Link, List, ListItem, Macros,
+    OrgTable, OrgTableCell, OrgTableRow, Paragraph, PropertyDrawer, QuoteBlock, RadioTarget, Rule,
+    Section, Snippet, SourceBlock, SpecialBlock, Strike, Subscript, Superscript, Target, Timestamp,
+    Underline, Verbatim, VerseBlock,
+};
+use orgize::rowan::ast::AstNode;
+use orgize::rowan::{NodeOrToken, WalkEvent};
+use orgize::{Org, SyntaxKind};
+
+/// Index value meaning "no node".
+pub const NONE: u32 = u32::MAX;
+
+/// Mirrors `OrgNode` in org-ffi.h.
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub struct OrgNode {
+    kind: u16,
+    level: u16,
+    parent: u32,
+    next_sibling: u32,
+    offset: u32,
+    len: u32,
+}
+
+macro_rules! node_kinds {
+    ($($kind:ident = $name:literal $(: $ty:ident)?,)*) => {
+        /// Mirrors `OrgNodeKind` in org-ffi.h.
+        #[repr(u16)]
+        #[derive(Clone, Copy)]
+        enum NodeKind {
+            $($kind,)*
+        }
+
+        const KIND_NAMES: &[&str] = &[$(concat!($name, "\0"),)*];
+
+        fn classify(kind: SyntaxKind) -> Option<NodeKind> {
+            $($(
+                if $ty::can_cast(kind) {
+                    return Some(NodeKind::$kind);
+                }
+            )?)*
+            None
+        }
+    };
+}
+
+node_kinds! {
+    Document = "document": Document,
+    Section = "section": Section,
+    Headline = "headline": Headline,
+    Paragraph = "paragraph": Paragraph,
+    Text = "text",
+    Bold = "bold": Bold,
+    Italic = "italic": Italic,
+    Underline = "underline": Underline,
+    Strike = "strike": Strike,
+    Verbatim = "verbatim": Verbatim,
+    Code = "code": Code,
+    Subscript = "subscript": Subscript,
+    Superscript = "superscript": Superscript,
+    Link = "link": Link,
+    Target = "target": Target,
+    RadioTarget = "radio-target": RadioTarget,
+    FnRef = "footnote-reference": FnRef,
+    FnDef = "footnote-definition": FnDef,
+    List = "list": List,
+    ListItem = "list-item": ListItem,
+    Table = "table": OrgTable,
+    TableRow = "table-row": OrgTableRow,
+    TableCell = "table-cell": OrgTableCell,
+    SourceBlock = "source-block": SourceBlock,
+    ExampleBlock = "example-block": ExampleBlock,
+    QuoteBlock = "quote-block": QuoteBlock,
+    VerseBlock = "verse-block": VerseBlock,
+    CenterBlock = "center-block": CenterBlock,
+    CommentBlock = "comment-block": CommentBlock,
+    ExportBlock = "export-block": ExportBlock,
+    SpecialBlock = "special-block": SpecialBlock,
+    Drawer = "drawer": Drawer,
+    PropertyDrawer = "property-drawer": PropertyDrawer,
+    Keyword = "keyword": Keyword,
+    Comment = "comment": Comment,
+    FixedWidth = "fixed-width": FixedWidth,
+    Rule = "rule": Rule,
+    Timestamp = "timestamp": Timestamp,
+    Clock = "clock": Clock,
+    LatexFragment = "latex-fragment": LatexFragment,
+    LatexEnvironment = "latex-environment": LatexEnvironment,
+    Entity = "entity": Entity,
+    LineBreak = "line-break": LineBreak,
+    Snippet = "snippet": Snippet,
+    Macros = "macro": Macros,
+    Cookie = "cookie": Cookie,
+    InlineSrc = "inline-src": InlineSrc,
+    InlineCall = "inline-call": InlineCall,
+    BabelCall = "babel-call": BabelCall,
+}
+
+/// Null-terminated name of a node kind, for debugging output.
+pub fn kind_name(kind: i32) -> Option<&'static str> {
+    usize::try_from(kind)
+        .ok()
+        .and_then(|i| KIND_NAMES.get(i))
+        .copied()
+}
+
+/// Flattens `org` into preorder records. Returns `None` if the document has
+/// more elements than 32-bit indices can address.
+pub fn flatten(org: &Org) -> Option<Vec<OrgNode>> {
+    let root = org.document();
+    let mut nodes: Vec<OrgNode> = Vec::new();
+    // Index and last child so far of each kept node on the current path.
+    let mut open: Vec<(u32, u32)> = Vec::new();
+    // Whether each syntax node on the current path was kept.
+    let mut kept: Vec<bool> = Vec::new();
+
+    for event in root.syntax().preorder_with_tokens() {
+        let element = match event {
+            WalkEvent::Enter(element) => element,
+            WalkEvent::Leave(NodeOrToken::Node(_)) => {
+                if kept.pop() == Some(true) {
+                    open.pop();
+                }
+                continue;
+            }
+            WalkEvent::Leave(NodeOrToken::Token(_)) => continue,
+        };
+
+        let (kind, level) = match &element {
+            NodeOrToken::Node(node) => match classify(node.kind()) {
+                Some(kind) => {
+                    let level = Headline::cast(node.clone())
+                        .map_or(0, |h| h.level().min(u16::MAX as usize) as u16);
+                    (kind, level)
+                }
+                None => {
+                    kept.push(false);
+                    continue;
+                }
+            },
+            NodeOrToken::Token(token) if token.kind() == SyntaxKind::TEXT => (NodeKind::Text, 0),
+            NodeOrToken::Token(_) => continue,
+        };
+
+        let index = u32::try_from(nodes.len()).ok().filter(|&i| i != NONE)?;
+        let range = element.text_range();
+        let parent = match open.last_mut() {
+            Some((parent, last_child)) => {
+                if *last_child != NONE {
+                    nodes[*last_child as usize].next_sibling = index;
+                }
+                *last_child = index;
+                *parent
+            }
+            None => NONE,
+        };
+
+        nodes.push(OrgNode {
+            kind: kind as u16,
+            level,
+            parent,
+            next_sibling: NONE,
+            offset: u32::from(range.start()),
+            len: u32::from(range.len()),
+        });
+
+        if let NodeOrToken::Node(_) = element {
+            kept.push(true);
+            open.push((index, NONE));
+        }
+    }
+
+    Some(nodes)
+}
@@ -0,0 +1,156 @@
+//! On-disk memo cache for rendered fragments.
+//!
+//! Entries live under `<dir>/<namespace>/<hash>.entry`, one file each, keyed
+//! by a 64-bit FNV-1a hash of everything that affects the output. Writes go
+//! to a temporary file and are renamed into place, so concurrent exporters
+//! never see a partial entry. With no directory configured every lookup
+//! misses and nothing is written.
+//!
+//! Every key read or written is remembered until the directory is set
+//! again, so after a full build `prune` can drop the entries that build no
+//! longer needed, such as old versions of an edited section.
+
+use std::collections::HashSet;
+use std::fs;
+use std::path::PathBuf;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::{Mutex, RwLock};
+
+static CACHE_DIR: RwLock<Option<PathBuf>> = RwLock::new(None);
+static TEMP_COUNTER: AtomicUsize = AtomicUsize::new(0);
+static USED: Mutex<Option<HashSet<(String, u64)>>> = Mutex::new(None);
+
+/// File name suffix of an entry; neutral, as most payloads are not HTML.
+const EXTENSION: &str = "entry";
+
+pub fn set_dir(dir: Option<PathBuf>) {
+    if let Ok(mut current) = CACHE_DIR.write() {
+        *current = dir;
+    }
+    if let Ok(mut used) = USED.lock() {
+        *used = None;
+    }
+}
+
+fn dir() -> Option<PathBuf> {
+    CACHE_DIR.read().ok().and_then(|dir| dir.clone())
+}
+
+fn mark_used(namespace: &str, key: u64) {
+    if let Ok(mut used) = USED.lock() {
+        used.get_or_insert_with(HashSet::new).insert((namespace.to_string(), key));
+    }
+}
+
+fn entry_name(key: u64) -> String {
+    format!("{:016x}.{}", key, EXTENSION)
+}
+
+/// FNV-1a over several byte strings. Each part is followed by a 0xff byte,
+/// which never occurs in UTF-8, so ("ab", "c") and ("a", "bc") differ.
+pub fn hash(parts: &[&[u8]]) -> u64 {
+    let mut h: u64 = 0xcbf29ce484222325;
+    for part in parts {
+        for &b in part.iter().chain(std::iter::once(&0xff)) {
+            h ^= b as u64;
+            h = h.wrapping_mul(0x100000001b3);
+        }
+    }
+    h
+}
+
+/// Returns the cached fragment for `key`, or builds, stores and returns it.
+pub fn get_or_insert_with(namespace: &str, key: u64, build: impl FnOnce() -> String) -> String {
+    get_or_try_insert_with(namespace, key, || Some(build())).unwrap_or_default()
+}
+
+/// Like `get_or_insert_with`, but a `None` from `build` is returned as is
+/// and not stored, so failures are retried on the next build.
+pub fn get_or_try_insert_with(namespace: &str, key: u64, build: impl FnOnce() -> Option<String>) -> Option<String> {
+    if !enabled() {
+        return build();
+    }
+    if let Some(hit) = get(namespace, key) {
+        return Some(hit);
+    }
+    let value = build()?;
+    insert(namespace, key, &value);
+    Some(value)
+}
+
+pub fn enabled() -> bool {
+    CACHE_DIR.read().is_ok_and(|dir| dir.is_some())
+}
+
+/// Returns the cached fragment for `key`, if there is one.
+pub fn get(namespace: &str, key: u64) -> Option<String> {
+    let path = dir()?.join(namespace).join(entry_name(key));
+    let value = fs::read_to_string(path).ok()?;
+    mark_used(namespace, key);
+    Some(value)
+}
+
+/// Stores `value` under `key`. Does nothing without a cache directory.
+pub fn insert(namespace: &str, key: u64, value: &str) {
+    let Some(root) = dir() else {
+        return;
+    };
+    let dir = root.join(namespace);
+    mark_used(namespace, key);
+
+    // A cache that cannot be written is just a cache miss next time.
+    if fs::create_dir_all(&dir).is_ok() {
+        let path = dir.join(entry_name(key));
+        let temp = dir.join(format!(
+            ".{:016x}.{}.{}.tmp",
+            key,
+            std::process::id(),
+            TEMP_COUNTER.fetch_add(1, Ordering::Relaxed)
+        ));
+        let stored = fs::write(&temp, value).is_ok() && fs::rename(&temp, &path).is_ok();
+        if !stored {
+            let _ = fs::remove_file(&temp);
+        }
+    }
+}
+
+/// Removes every entry not read or written since the directory was set,
+/// along with leftover temporary files and entries in an older format.
+/// Only meaningful after a build that exported every document, or the
+/// entries of the ones it skipped go too. Returns the number of files
+/// removed.
+pub fn prune() -> usize {
+    let Some(root) = dir() else {
+        return 0;
+    };
+    let used = match USED.lock() {
+        Ok(used) => used.clone().unwrap_or_default(),
+        Err(_) => return 0,
+    };
+    let Ok(namespaces) = fs::read_dir(&root) else {
+        return 0;
+    };
+
+    let mut removed = 0;
+    for namespace in namespaces.flatten() {
+        let name = namespace.file_name();
+        let Some(name) = name.to_str() else {
+            continue;
+        };
+        let Ok(entries) = fs::read_dir(namespace.path()) else {
+            continue;
+        };
+        for entry in entries.flatten() {
+            let file = entry.file_name();
+            let key = file
+                .to_str()
+                .and_then(|file| file.strip_suffix(EXTENSION)?.strip_suffix('.'))
+                .and_then(|hex| u64::from_str_radix(hex, 16).ok());
+            let keep = key.is_some_and(|key| used.contains(&(name.to_string(), key)));
+            if !keep && entry.file_type().is_ok_and(|kind| kind.is_file()) && fs::remove_file(entry.path()).is_ok() {
+                removed += 1;
+            }
+        }
+    }
+    removed
+}
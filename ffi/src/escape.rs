@@ -0,0 +1,122 @@
+//! HTML escaping shared by the exporter and the C template layer.
+//!
+//! Produces the same entities as `orgize::export::HtmlEscape`, but finds the
+//! bytes that need escaping 16 at a time and copies the clean spans between
+//! them in one go instead of formatting character by character.
+
+use std::fmt;
+
+/// Entity for a byte that must be escaped, or `None` when it is copied as is.
+#[inline]
+fn entity(b: u8) -> Option<&'static str> {
+    match b {
+        b'<' => Some("&lt;"),
+        b'>' => Some("&gt;"),
+        b'&' => Some("&amp;"),
+        b'\'' => Some("&#39;"),
+        b'"' => Some("&quot;"),
+        _ => None,
+    }
+}
+
+/// Returns the offset of the first byte in `bytes[from..]` that needs
+/// escaping, or `bytes.len()` if there is none.
+#[inline]
+fn next_special(bytes: &[u8], from: usize) -> usize {
+    #[cfg(target_arch = "x86_64")]
+    {
+        // SSE2 is part of the x86_64 baseline, so no runtime detection.
+        unsafe { next_special_sse2(bytes, from) }
+    }
+    #[cfg(not(target_arch = "x86_64"))]
+    {
+        next_special_scalar(bytes, from)
+    }
+}
+
+#[cfg_attr(target_arch = "x86_64", allow(dead_code))]
+#[inline]
+fn next_special_scalar(bytes: &[u8], from: usize) -> usize {
+    bytes[from..]
+        .iter()
+        .position(|&b| entity(b).is_some())
+        .map_or(bytes.len(), |p| from + p)
+}
+
+#[cfg(target_arch = "x86_64")]
+#[inline]
+unsafe fn next_special_sse2(bytes: &[u8], from: usize) -> usize {
+    use std::arch::x86_64::*;
+
+    let len = bytes.len();
+    let ptr = bytes.as_ptr();
+    let lt = _mm_set1_epi8(b'<' as i8);
+    let gt = _mm_set1_epi8(b'>' as i8);
+    let amp = _mm_set1_epi8(b'&' as i8);
+    let apos = _mm_set1_epi8(b'\'' as i8);
+    let quot = _mm_set1_epi8(b'"' as i8);
+
+    let mut i = from;
+    while i + 16 <= len {
+        let chunk = _mm_loadu_si128(ptr.add(i) as *const __m128i);
+        let hits = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, lt), _mm_cmpeq_epi8(chunk, gt)),
+            _mm_or_si128(
+                _mm_cmpeq_epi8(chunk, amp),
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, apos), _mm_cmpeq_epi8(chunk, quot)),
+            ),
+        );
+        let mask = _mm_movemask_epi8(hits) as u32;
+        if mask != 0 {
+            return i + mask.trailing_zeros() as usize;
+        }
+        i += 16;
+    }
+
+    next_special_scalar(bytes, i)
+}
+
+/// Calls `emit` with the escaped form of `bytes`, one clean span or entity
+/// at a time. Any bytes will do: only the ASCII special characters are
+/// looked at, and everything between them is passed through untouched.
+#[inline]
+pub fn escape_byte_spans<E>(bytes: &[u8], mut emit: impl FnMut(&[u8]) -> Result<(), E>) -> Result<(), E> {
+    let mut start = 0;
+    loop {
+        let pos = next_special(bytes, start);
+        if pos > start {
+            emit(&bytes[start..pos])?;
+        }
+        if pos == bytes.len() {
+            return Ok(());
+        }
+        if let Some(e) = entity(bytes[pos]) {
+            emit(e.as_bytes())?;
+        }
+        start = pos + 1;
+    }
+}
+
+/// Like `escape_byte_spans` for text. Only ASCII bytes are ever split on,
+/// so every span is valid UTF-8.
+#[inline]
+fn escape_spans<E>(text: &str, mut emit: impl FnMut(&str) -> Result<(), E>) -> Result<(), E> {
+    escape_byte_spans(text.as_bytes(), |span| emit(unsafe { std::str::from_utf8_unchecked(span) }))
+}
+
+/// Appends the escaped form of `text` to `out`.
+pub fn escape_into(out: &mut String, text: &str) {
+    let _ = escape_spans::<()>(text, |s| {
+        out.push_str(s);
+        Ok(())
+    });
+}
+
+/// `Display` adapter for use inside `write!` format strings.
+pub struct Escaped<'a>(pub &'a str);
+
+impl fmt::Display for Escaped<'_> {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        escape_spans(self.0, |s| f.write_str(s))
+    }
+}
@@ -0,0 +1,442 @@
+//! Build-time syntax highlighting for source blocks.
+//!
+//! A single table-driven lexer covers the languages that show up in posts.
+//! It recognises comments, strings, numbers, keywords, literals, function
+//! names and a few language-specific forms, and wraps them in the `hljs-*`
+//! classes the blog stylesheet already themes. Anything it does not
+//! recognise is copied through escaped, so output is always safe HTML even
+//! when the lexing is approximate.
+
+use crate::escape::escape_into;
+
+/// Bump when the output format changes so cached fragments are rebuilt.
+pub const VERSION: &str = "1";
+
+struct Lang {
+    name: &'static str,
+    keywords: &'static [&'static str],
+    literals: &'static [&'static str],
+    line_comments: &'static [&'static str],
+    block_comment: Option<(&'static str, &'static str)>,
+    quotes: &'static [u8],
+    /// Bytes besides ASCII alphanumerics and `_` that continue an identifier.
+    ident_extra: &'static [u8],
+    /// `#` at the start of a line begins a preprocessor directive.
+    preprocessor: bool,
+    /// `@name` is a decorator or annotation.
+    decorators: bool,
+    /// `$name` and `${...}` are variables.
+    dollar_vars: bool,
+    /// `'x'` is a character literal but a lone `'` is a lifetime.
+    char_literals: bool,
+    /// `"""` and `'''` strings may span lines.
+    triple_quotes: bool,
+    case_insensitive: bool,
+    /// `name(` is highlighted as a function name.
+    call_titles: bool,
+}
+
+const C_LIKE_BASE: Lang = Lang {
+    name: "",
+    keywords: &[],
+    literals: &[],
+    line_comments: &["//"],
+    block_comment: Some(("/*", "*/")),
+    quotes: b"\"'",
+    ident_extra: b"",
+    preprocessor: false,
+    decorators: false,
+    dollar_vars: false,
+    char_literals: false,
+    triple_quotes: false,
+    case_insensitive: false,
+    call_titles: true,
+};
+
+const LANGS: &[Lang] = &[
+    Lang {
+        name: "c",
+        keywords: &[
+            "auto", "break", "case", "char", "const", "continue", "default", "do", "double", "else",
+            "enum", "extern", "float", "for", "goto", "if", "inline", "int", "long", "register",
+            "restrict", "return", "short", "signed", "sizeof", "static", "struct", "switch",
+            "typedef", "union", "unsigned", "void", "volatile", "while", "bool", "size_t",
+            "class", "namespace", "template", "typename", "public", "private", "protected",
+            "virtual", "new", "delete", "using", "constexpr", "override", "this",
+        ],
+        literals: &["NULL", "true", "false", "nullptr"],
+        preprocessor: true,
+        ..C_LIKE_BASE
+    },
+    Lang {
+        name: "rust",
+        keywords: &[
+            "as", "async", "await", "break", "const", "continue", "crate", "dyn", "else", "enum",
+            "extern", "fn", "for", "if", "impl", "in", "let", "loop", "match", "mod", "move", "mut",
+            "pub", "ref", "return", "self", "Self", "static", "struct", "super", "trait", "type",
+            "unsafe", "use", "where", "while",
+        ],
+        literals: &["true", "false", "None", "Some", "Ok", "Err"],
+        quotes: b"\"'",
+        char_literals: true,
+        ..C_LIKE_BASE
+    },
+    Lang {
+        name: "go",
+        keywords: &[
+            "break", "case", "chan", "const", "continue", "default", "defer", "else", "fallthrough",
+            "for", "func", "go", "goto", "if", "import", "interface", "map", "package", "range",
+            "return", "select", "struct", "switch", "type", "var",
+        ],
+        literals: &["true", "false", "nil", "iota"],
+        quotes: b"\"'`",
+        ..C_LIKE_BASE
+    },
+    Lang {
+        name: "java",
+        keywords: &[
+            "abstract", "boolean", "break", "byte", "case", "catch", "char", "class", "const",
+            "continue", "default", "do", "double", "else", "enum", "extends", "final", "finally",
+            "float", "for", "if", "implements", "import", "instanceof", "int", "interface", "long",
+            "new", "package", "private", "protected", "public", "return", "short", "static",
+            "super", "switch", "synchronized", "this", "throw", "throws", "try", "void", "while",
+            "var", "fun", "val", "object",
+        ],
+        literals: &["true", "false", "null"],
+        decorators: true,
+        ..C_LIKE_BASE
+    },
+    Lang {
+        name: "javascript",
+        keywords: &[
+            "async", "await", "break", "case", "catch", "class", "const", "continue", "default",
+            "delete", "do", "else", "export", "extends", "finally", "for", "from", "function", "if",
+            "import", "in", "instanceof", "interface", "let", "new", "of", "return", "static",
+            "super", "switch", "this", "throw", "try", "type", "typeof", "var", "void", "while",
+            "yield",
+        ],
+        literals: &["true", "false", "null", "undefined", "NaN", "Infinity"],
+        quotes: b"\"'`",
+        decorators: true,
+        ..C_LIKE_BASE
+    },
+    Lang {
+        name: "python",
+        keywords: &[
+            "and", "as", "assert", "async", "await", "break", "class", "continue", "def", "del",
+            "elif", "else", "except", "finally", "for", "from", "global", "if", "import", "in", "is",
+            "lambda", "nonlocal", "not", "or", "pass", "raise", "return", "try", "while", "with",
+            "yield",
+        ],
+        literals: &["True", "False", "None"],
+        line_comments: &["#"],
+        block_comment: None,
+        decorators: true,
+        triple_quotes: true,
+        ..C_LIKE_BASE
+    },
+    Lang {
+        name: "shell",
+        keywords: &[
+            "if", "then", "else", "elif", "fi", "for", "while", "until", "do", "done", "case", "esac",
+            "in", "function", "return", "local", "export", "readonly", "set", "unset", "shift",
+            "exit", "source", "alias", "echo", "cd", "sudo",
+        ],
+        literals: &["true", "false"],
+        line_comments: &["#"],
+        block_comment: None,
+        ident_extra: b"-",
+        dollar_vars: true,
+        call_titles: false,
+        ..C_LIKE_BASE
+    },
+    Lang {
+        name: "lisp",
+        keywords: &[
+            "defun", "defmacro", "defvar", "defcustom", "defconst", "defgroup", "define", "lambda",
+            "let", "let*", "if", "when", "unless", "cond", "progn", "setq", "setf", "quote",
+            "require", "provide", "use-package", "dolist", "dotimes", "while", "and", "or", "not",
+            "interactive", "add-hook", "with-eval-after-load", "save-excursion", "condition-case",
+        ],
+        literals: &["t", "nil"],
+        line_comments: &[";"],
+        block_comment: None,
+        quotes: b"\"",
+        ident_extra: b"-*+/?!<>=:.&%",
+        call_titles: false,
+        ..C_LIKE_BASE
+    },
+    Lang {
+        name: "sql",
+        keywords: &[
+            "select", "from", "where", "insert", "into", "values", "update", "set", "delete",
+            "create", "table", "index", "drop", "alter", "add", "join", "left", "right", "inner",
+            "outer", "on", "group", "by", "order", "having", "limit", "offset", "as", "and", "or",
+            "not", "in", "is", "distinct", "union", "all", "primary", "key", "foreign",
+            "references", "default", "integer", "text", "varchar",
+        ],
+        literals: &["null", "true", "false"],
+        line_comments: &["--"],
+        case_insensitive: true,
+        call_titles: false,
+        ..C_LIKE_BASE
+    },
+    Lang {
+        name: "json",
+        keywords: &[],
+        literals: &["true", "false", "null"],
+        line_comments: &[],
+        block_comment: None,
+        quotes: b"\"",
+        call_titles: false,
+        ..C_LIKE_BASE
+    },
+];
+
+fn lookup(language: &str) -> Option<&'static Lang> {
+    let name = match language.to_ascii_lowercase().as_str() {
+        "c" | "h" | "cpp" | "c++" | "cc" | "cxx" | "hpp" | "objc" => "c",
+        "rust" | "rs" => "rust",
+        "go" | "golang" => "go",
+        "java" | "kotlin" | "kt" => "java",
+        "js" | "javascript" | "jsx" | "ts" | "typescript" | "tsx" => "javascript",
+        "python" | "py" | "python3" => "python",
+        "sh" | "bash" | "shell" | "zsh" | "fish" | "console" => "shell",
+        "elisp" | "emacs-lisp" | "lisp" | "scheme" | "clojure" | "racket" | "common-lisp" => "lisp",
+        "sql" | "sqlite" | "postgresql" | "mysql" => "sql",
+        "json" => "json",
+        _ => return None,
+    };
+    LANGS.iter().find(|lang| lang.name == name)
+}
+
+/// Canonical name used in cache keys, or `None` if the language is not
+/// highlighted.
+pub fn canonical(language: &str) -> Option<&'static str> {
+    lookup(language).map(|lang| lang.name)
+}
+
+/// Returns the highlighted, escaped HTML for `code`, or `None` if the
+/// language is not supported.
+pub fn highlight(language: &str, code: &str) -> Option<String> {
+    let lang = lookup(language)?;
+    let mut out = String::with_capacity(code.len() + code.len() / 2);
+    Lexer { lang, text: code, pos: 0, plain_start: 0, out: &mut out }.run();
+    Some(out)
+}
+
+struct Lexer<'a> {
+    lang: &'static Lang,
+    text: &'a str,
+    pos: usize,
+    plain_start: usize,
+    out: &'a mut String,
+}
+
+impl Lexer<'_> {
+    fn bytes(&self) -> &[u8] {
+        self.text.as_bytes()
+    }
+
+    fn is_ident_byte(&self, b: u8) -> bool {
+        b.is_ascii_alphanumeric() || b == b'_' || b >= 0x80 || self.lang.ident_extra.contains(&b)
+    }
+
+    fn at_line_start(&self) -> bool {
+        self.bytes()[..self.pos]
+            .iter()
+            .rev()
+            .take_while(|&&b| b != b'\n')
+            .all(|b| b.is_ascii_whitespace())
+    }
+
+    /// Emits any pending plain text, then `text[pos..end]` in a span.
+    fn span(&mut self, class: &str, end: usize) {
+        let text = self.text;
+        escape_into(self.out, &text[self.plain_start..self.pos]);
+        self.out.push_str("<span class=\"");
+        self.out.push_str(class);
+        self.out.push_str("\">");
+        escape_into(self.out, &text[self.pos..end]);
+        self.out.push_str("</span>");
+        self.pos = end;
+        self.plain_start = end;
+    }
+
+    fn find_from(&self, from: usize, needle: &str) -> Option<usize> {
+        self.text[from..].find(needle).map(|i| from + i)
+    }
+
+    fn line_end(&self, from: usize) -> usize {
+        memchr::memchr(b'\n', &self.bytes()[from..]).map_or(self.text.len(), |i| from + i)
+    }
+
+    fn string_end(&self, quote: u8) -> usize {
+        let bytes = self.bytes();
+        let multiline = quote == b'`';
+        let mut i = self.pos + 1;
+        while i < bytes.len() {
+            match bytes[i] {
+                b'\\' => i += 2,
+                b'\n' if !multiline => return i,
+                b if b == quote => return i + 1,
+                _ => i += 1,
+            }
+        }
+        bytes.len()
+    }
+
+    /// Length of a Rust-style char literal at `pos`, or `None` for a lifetime.
+    fn char_literal_end(&self) -> Option<usize> {
+        let rest = &self.text[self.pos + 1..];
+        let mut chars = rest.char_indices();
+        let (_, first) = chars.next()?;
+        if first == '\\' {
+            let close = rest[1..].find('\'')?;
+            return (close < 10).then_some(self.pos + 1 + 1 + close + 1);
+        }
+        let (next_idx, next) = chars.next()?;
+        (next == '\'' && first != '\'').then_some(self.pos + 1 + next_idx + 1)
+    }
+
+    fn is_keyword(&self, word: &str) -> bool {
+        if self.lang.case_insensitive {
+            self.lang.keywords.iter().any(|k| k.eq_ignore_ascii_case(word))
+        } else {
+            self.lang.keywords.contains(&word)
+        }
+    }
+
+    fn is_literal(&self, word: &str) -> bool {
+        if self.lang.case_insensitive {
+            self.lang.literals.iter().any(|k| k.eq_ignore_ascii_case(word))
+        } else {
+            self.lang.literals.contains(&word)
+        }
+    }
+
+    fn run(mut self) {
+        let len = self.text.len();
+        while self.pos < len {
+            let text = self.text;
+            let b = text.as_bytes()[self.pos];
+            let rest = &text[self.pos..];
+
+            if let Some(prefix) = self.lang.line_comments.iter().find(|p| rest.starts_with(**p)) {
+                // `#` only starts a shell comment at a word boundary (not in `$#`).
+                let boundary = !self.lang.dollar_vars
+                    || *prefix != "#"
+                    || self.pos == 0
+                    || self.bytes()[self.pos - 1].is_ascii_whitespace();
+                if boundary {
+                    let end = self.line_end(self.pos);
+                    self.span("hljs-comment", end);
+                    continue;
+                }
+            }
+
+            if let Some((open, close)) = self.lang.block_comment {
+                if rest.starts_with(open) {
+                    let end = self
+                        .find_from(self.pos + open.len(), close)
+                        .map_or(len, |i| i + close.len());
+                    self.span("hljs-comment", end);
+                    continue;
+                }
+            }
+
+            if self.lang.preprocessor && b == b'#' && self.at_line_start() {
+                let end = self.line_end(self.pos);
+                self.span("hljs-meta", end);
+                continue;
+            }
+
+            if self.lang.triple_quotes && (rest.starts_with("\"\"\"") || rest.starts_with("'''")) {
+                let end = self.find_from(self.pos + 3, &rest[..3]).map_or(len, |i| i + 3);
+                self.span("hljs-string", end);
+                continue;
+            }
+
+            if self.lang.quotes.contains(&b) {
+                if self.lang.char_literals && b == b'\'' {
+                    if let Some(end) = self.char_literal_end() {
+                        self.span("hljs-string", end);
+                    } else {
+                        self.pos += 1;
+                    }
+                    continue;
+                }
+                let end = self.string_end(b);
+                self.span("hljs-string", end);
+                continue;
+            }
+
+            if self.lang.dollar_vars && b == b'$' {
+                let bytes = self.bytes();
+                let end = if bytes.get(self.pos + 1) == Some(&b'{') {
+                    self.find_from(self.pos + 2, "}").map_or(len, |i| i + 1)
+                } else {
+                    let mut i = self.pos + 1;
+                    while i < len && (bytes[i].is_ascii_alphanumeric() || bytes[i] == b'_') {
+                        i += 1;
+                    }
+                    if i == self.pos + 1 && i < len && b"@#?*!$0123456789".contains(&bytes[i]) {
+                        i += 1;
+                    }
+                    i
+                };
+                if end > self.pos + 1 {
+                    self.span("hljs-variable", end);
+                } else {
+                    self.pos += 1;
+                }
+                continue;
+            }
+
+            if self.lang.decorators && b == b'@' {
+                let mut i = self.pos + 1;
+                while i < len && (self.is_ident_byte(self.bytes()[i]) || self.bytes()[i] == b'.') {
+                    i += 1;
+                }
+                if i > self.pos + 1 {
+                    self.span("hljs-meta", i);
+                } else {
+                    self.pos += 1;
+                }
+                continue;
+            }
+
+            if b.is_ascii_digit() {
+                let mut i = self.pos + 1;
+                while i < len && (self.bytes()[i].is_ascii_alphanumeric() || self.bytes()[i] == b'_' || self.bytes()[i] == b'.') {
+                    i += 1;
+                }
+                self.span("hljs-number", i);
+                continue;
+            }
+
+            if self.is_ident_byte(b) {
+                let mut end = self.pos + 1;
+                while end < len && self.is_ident_byte(self.bytes()[end]) {
+                    end += 1;
+                }
+                let word = &self.text[self.pos..end];
+                if self.is_keyword(word) {
+                    self.span("hljs-keyword", end);
+                } else if self.is_literal(word) {
+                    self.span("hljs-literal", end);
+                } else if self.lang.call_titles && self.bytes().get(end) == Some(&b'(') {
+                    self.span("hljs-title function_", end);
+                } else {
+                    self.pos = end;
+                }
+                continue;
+            }
+
+            self.pos += 1;
+        }
+
+        let text = self.text;
+        escape_into(self.out, &text[self.plain_start..]);
+    }
+}
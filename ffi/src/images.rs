@@ -0,0 +1,174 @@
+//! Pixel sizes of local images, read from their headers.
+//!
+//! Only the bytes that hold the size are read: a fixed-size header for PNG,
+//! GIF and WebP, and for JPEG the segment headers up to the first frame,
+//! seeking over everything in between. Sizes are kept in the render cache
+//! keyed by path, modification time and length, so an unchanged image is
+//! not opened again by later builds.
+
+use std::fs::File;
+use std::io::{Read, Seek, SeekFrom};
+use std::path::{Component, Path, PathBuf};
+use std::time::UNIX_EPOCH;
+
+use crate::cache;
+
+/// Bump when the probing changes, to drop every cached size.
+const VERSION: &str = "1";
+
+/// Bytes that hold the size of a PNG, GIF or WebP image.
+const HEADER_LEN: usize = 30;
+
+/// A JPEG whose first frame is further in than this many segments is
+/// given up on.
+const MAX_JPEG_SEGMENTS: usize = 64;
+
+/// The file a relative `src` refers to, with its metadata. `dirs` lists
+/// the directories to look in, in the form of `PATH`; the first one holding
+/// the file wins. URLs and absolute paths are not probed.
+fn resolve(dirs: &Path, src: &str) -> Option<(PathBuf, std::fs::Metadata)> {
+    if src.is_empty() || src.starts_with('/') || src.contains(':') {
+        return None;
+    }
+    let src = src.split(['?', '#']).next()?;
+    std::env::split_paths(dirs).find_map(|dir| {
+        let path = normalize(&dir.join(src));
+        let meta = std::fs::metadata(&path).ok()?;
+        meta.is_file().then_some((path, meta))
+    })
+}
+
+/// Drops `.` and resolves `..` against the component before it, as a
+/// browser does with the URL, so a directory on the way need not exist.
+fn normalize(path: &Path) -> PathBuf {
+    let mut out = PathBuf::new();
+    for component in path.components() {
+        match component {
+            Component::CurDir => {}
+            Component::ParentDir if matches!(out.components().next_back(), Some(Component::Normal(_))) => {
+                out.pop();
+            }
+            other => out.push(other),
+        }
+    }
+    out
+}
+
+/// Width and height in pixels of the image at `src`, relative to one of
+/// `dirs`, if it is a local PNG, JPEG, GIF or WebP file.
+pub fn size(dirs: &Path, src: &str) -> Option<(u32, u32)> {
+    let (path, meta) = resolve(dirs, src)?;
+    let mtime = meta.modified().ok()?.duration_since(UNIX_EPOCH).ok()?.as_nanos();
+    let key = cache::hash(&[
+        VERSION.as_bytes(),
+        path.to_str()?.as_bytes(),
+        &mtime.to_le_bytes(),
+        &meta.len().to_le_bytes(),
+    ]);
+
+    if let Some(hit) = cache::get("image-size", key) {
+        let (width, height) = hit.split_once(' ')?;
+        return Some((width.parse().ok()?, height.parse().ok()?));
+    }
+    let size = read_size(File::open(&path).ok()?);
+    // Unreadable images are not cached, so a fixed file is picked up.
+    if let Some((width, height)) = size {
+        cache::insert("image-size", key, &format!("{} {}", width, height));
+    }
+    size
+}
+
+fn read_size(mut file: impl Read + Seek) -> Option<(u32, u32)> {
+    let mut header = [0u8; HEADER_LEN];
+    let len = read_up_to(&mut file, &mut header)?;
+    let header = &header[..len];
+
+    if header.starts_with(b"\xff\xd8") {
+        return jpeg_size(file);
+    }
+    let size = header_size(header)?;
+    (size.0 > 0 && size.1 > 0).then_some(size)
+}
+
+/// Size from the first `HEADER_LEN` bytes of a PNG, GIF or WebP file.
+fn header_size(header: &[u8]) -> Option<(u32, u32)> {
+    let be32 = |at: usize| Some(u32::from_be_bytes(header.get(at..at + 4)?.try_into().ok()?));
+    let le16 = |at: usize| Some(u16::from_le_bytes(header.get(at..at + 2)?.try_into().ok()?) as u32);
+    let le24 = |at: usize| {
+        let b = header.get(at..at + 3)?;
+        Some(b[0] as u32 | (b[1] as u32) << 8 | (b[2] as u32) << 16)
+    };
+
+    if header.starts_with(b"\x89PNG\r\n\x1a\n") && header.get(12..16) == Some(b"IHDR") {
+        return Some((be32(16)?, be32(20)?));
+    }
+    if header.starts_with(b"GIF87a") || header.starts_with(b"GIF89a") {
+        return Some((le16(6)?, le16(8)?));
+    }
+    if header.starts_with(b"RIFF") && header.get(8..12) == Some(b"WEBP") {
+        return match header.get(12..16)? {
+            b"VP8 " => Some((le16(26)? & 0x3fff, le16(28)? & 0x3fff)),
+            b"VP8L" => {
+                let bits = u32::from_le_bytes(header.get(21..25)?.try_into().ok()?);
+                Some(((bits & 0x3fff) + 1, (bits >> 14 & 0x3fff) + 1))
+            }
+            b"VP8X" => Some((le24(24)? + 1, le24(27)? + 1)),
+            _ => None,
+        };
+    }
+    None
+}
+
+/// Walks the JPEG segments after SOI to the first start-of-frame marker.
+fn jpeg_size(mut file: impl Read + Seek) -> Option<(u32, u32)> {
+    let mut pos = 2u64;
+    for _ in 0..MAX_JPEG_SEGMENTS {
+        file.seek(SeekFrom::Start(pos)).ok()?;
+        let mut segment = [0u8; 9];
+        let len = read_up_to(&mut file, &mut segment)?;
+        if len < 4 || segment[0] != 0xff {
+            return None;
+        }
+        let marker = segment[1];
+        match marker {
+            // Fill byte before a marker.
+            0xff => {
+                pos += 1;
+                continue;
+            }
+            // Markers without a length.
+            0x01 | 0xd0..=0xd7 => {
+                pos += 2;
+                continue;
+            }
+            // Start of frame, except DHT, JPG and DAC which share the range.
+            0xc0..=0xcf if !matches!(marker, 0xc4 | 0xc8 | 0xcc) => {
+                if len < 9 {
+                    return None;
+                }
+                let height = u16::from_be_bytes([segment[5], segment[6]]) as u32;
+                let width = u16::from_be_bytes([segment[7], segment[8]]) as u32;
+                return (width > 0 && height > 0).then_some((width, height));
+            }
+            // Start of scan or end of image before any frame.
+            0xd9 | 0xda => return None,
+            _ => {}
+        }
+        pos += 2 + u16::from_be_bytes([segment[2], segment[3]]) as u64;
+    }
+    None
+}
+
+/// Fills as much of `buf` as the file has, returning the length read.
+fn read_up_to(file: &mut impl Read, buf: &mut [u8]) -> Option<usize> {
+    let mut len = 0;
+    while len < buf.len() {
+        match file.read(&mut buf[len..]) {
+            Ok(0) => break,
+            Ok(n) => len += n,
+            Err(err) if err.kind() == std::io::ErrorKind::Interrupted => {}
+            Err(_) => return None,
+        }
+    }
+    Some(len)
+}
@@ -1,38 +1,178 @@
 use orgize::{Org, export::{from_fn, Container, Event, TraversalContext, Traverser}, SyntaxKind};
-use orgize::export::HtmlEscape;
 use orgize::ast::{Headline, Keyword, Link, List, ListItem, OrgTableRow, SourceBlock, Timestamp};
 use orgize::config::{ParseConfig, UseSubSuperscript};
 use orgize::rowan::ast::AstNode;
+use std::alloc::{alloc, dealloc, Layout};
+use std::borrow::Cow;
+use std::cell::RefCell;
 use std::collections::HashMap;
-use std::ffi::{CStr, CString};
-use std::os::raw::c_char;
+use std::ffi::CString;
+use std::os::raw::{c_char, c_void};
+use std::path::{Path, PathBuf};
 use std::ptr;
+use std::sync::atomic::{AtomicUsize, Ordering};
 use std::fmt::Write;
-use slugify::slugify;
+use memchr::memmem;
+
+mod ast;
+mod cache;
+mod escape;
+mod highlight;
+mod images;
+mod links;
+mod mathml;
+mod options;
+mod parallel;
+mod scratch;
+mod sections;
+mod slug;
+mod spacing;
+mod stats;
+use escape::{escape_into, Escaped};
+use slug::SlugTable;
+
+/// Callback receiving HTML chunks; returns 0 on success, non-zero to abort.
+pub type OrgWriteFn = unsafe extern "C" fn(userdata: *mut c_void, data: *const c_char, len: usize) -> i32;
+
+/// Output is handed to the sink in chunks of at least this many bytes.
+const SINK_FLUSH_THRESHOLD: usize = 64 * 1024;
+
+/// Source blocks longer than this get an Expand button.
+const COLLAPSED_CODE_LINES: usize = 50;
+
+#[derive(Clone, Copy)]
+struct HtmlSink {
+    write: OrgWriteFn,
+    userdata: *mut c_void,
+}
+
+impl HtmlSink {
+    fn new(write: Option<OrgWriteFn>, userdata: *mut c_void) -> Option<Self> {
+        write.map(|write| HtmlSink { write, userdata })
+    }
+
+    fn write(&self, chunk: &str) -> bool {
+        self.write_bytes(chunk.as_bytes())
+    }
+
+    fn write_bytes(&self, chunk: &[u8]) -> bool {
+        unsafe { (self.write)(self.userdata, chunk.as_ptr() as *const c_char, chunk.len()) == 0 }
+    }
+}
 
 struct HtmlExportWithUrls {
     output: String,
     in_descriptive_list: Vec<bool>,
     pending_attributes: Option<HashMap<String, String>>,
+    /// Cleared map reused for the next `#+attr_html`.
+    spare_attributes: HashMap<String, String>,
     paragraph_start_len: Vec<usize>,
     in_verbatim_or_code: bool,
+    highlight: bool,
+    mathml: bool,
+    spacing: bool,
+    heading_anchors: bool,
+    code_decorations: bool,
+    image_hints: bool,
+    /// Directories the document's relative image paths are looked up in,
+    /// in the form of `PATH`; without any images are not sized.
+    image_dir: Option<PathBuf>,
+    /// Images whose size was looked up, with the size found, so a cached
+    /// copy of this output can be checked against the files later.
+    probed_images: Vec<(String, Option<(u32, u32)>)>,
+    /// Lines of the source block being exported, `None` outside of one.
+    source_lines: Option<usize>,
+    /// Output length after the last prose character, and that character,
+    /// for spacing CJK and Latin text split across inline markup.
+    spacing_tail: Option<(usize, char)>,
+    source_block: Option<SourceCapture>,
+    sink: Option<HtmlSink>,
+    sink_failed: bool,
+    /// Output buffer capacity after the last event, to count regrowths.
+    output_capacity: usize,
+    output_allocations: usize,
+    input_len: usize,
+    /// Headline ids, used when this exporter is the traverser itself.
+    slugs: SlugTable,
+    /// Leave out the document's `<main>` wrapper, for exporting one piece
+    /// of a split document.
+    fragment: bool,
+}
+
+/// Text of a source block being collected for highlighting.
+struct SourceCapture {
+    language: &'static str,
+    code: String,
 }
 
 impl HtmlExportWithUrls {
-    fn new() -> Self {
+    /// Borrows this thread's scratch buffers and presizes the output for
+    /// `input_len` bytes of org. With a sink only about one flush worth of
+    /// output is ever buffered.
+    fn new(input_len: usize, sink: Option<HtmlSink>) -> Self {
+        let buffers = scratch::take_html();
+        let mut output = buffers.output;
+        let initial_capacity = output.capacity();
+        let expected = scratch::predict_output(input_len);
+        output.reserve(if sink.is_some() { expected.min(2 * SINK_FLUSH_THRESHOLD) } else { expected });
+
         HtmlExportWithUrls {
-            output: String::new(),
-            in_descriptive_list: Vec::new(),
+            output_capacity: output.capacity(),
+            output_allocations: usize::from(output.capacity() != initial_capacity),
+            output,
+            in_descriptive_list: buffers.in_descriptive_list,
             pending_attributes: None,
-            paragraph_start_len: Vec::new(),
+            spare_attributes: buffers.attributes,
+            paragraph_start_len: buffers.paragraph_start_len,
             in_verbatim_or_code: false,
+            highlight: options::enabled(options::HIGHLIGHT),
+            mathml: options::enabled(options::MATHML),
+            spacing: options::enabled(options::CJK_SPACING),
+            heading_anchors: options::enabled(options::HEADING_ANCHORS),
+            code_decorations: options::enabled(options::CODE_DECORATIONS),
+            image_hints: options::enabled(options::IMAGE_HINTS),
+            image_dir: None,
+            probed_images: Vec::new(),
+            source_lines: None,
+            spacing_tail: None,
+            source_block: None,
+            sink,
+            sink_failed: false,
+            input_len,
+            slugs: SlugTable::default(),
+            fragment: false,
         }
     }
 
-    fn append_escaped_char(&mut self, c: char) {
-        let mut buf = [0; 4];
-        let s = c.encode_utf8(&mut buf);
-        let _ = write!(&mut self.output, "{}", HtmlEscape(s));
+    /// Hands buffered output to the sink once enough has accumulated. Output
+    /// inside an open paragraph stays buffered because an empty paragraph is
+    /// dropped again when it closes.
+    fn flush_to_sink(&mut self, force: bool) {
+        if self.output.capacity() != self.output_capacity {
+            self.output_capacity = self.output.capacity();
+            self.output_allocations += 1;
+        }
+        if force {
+            stats::add_output(0, std::mem::take(&mut self.output_allocations));
+        }
+
+        let Some(sink) = &self.sink else {
+            return;
+        };
+        if self.output.is_empty() {
+            return;
+        }
+        if !force && (self.output.len() < SINK_FLUSH_THRESHOLD || !self.paragraph_start_len.is_empty()) {
+            return;
+        }
+
+        let ok = self.sink_failed || sink.write(&self.output);
+        if ok {
+            stats::add_output(self.output.len(), 0);
+        }
+        self.sink_failed = !ok;
+        self.output.clear();
+        self.spacing_tail = None;
     }
 
     fn open_tag(&mut self, tag: &str) {
@@ -53,52 +193,121 @@ impl HtmlExportWithUrls {
         self.close_tag("code");
     }
 
-    fn attrs_string(attrs: &HashMap<String, String>, skip_empty_alt: bool) -> String {
-        let mut attrs_str = String::new();
-        for (key, value) in attrs {
+    /// Writes and consumes the pending `#+attr_html` attributes.
+    fn write_pending_attrs(&mut self, skip_empty_alt: bool) {
+        let Some(mut attrs) = self.pending_attributes.take() else {
+            return;
+        };
+        for (key, value) in &attrs {
             if skip_empty_alt && key.eq_ignore_ascii_case("alt") && value.is_empty() {
                 continue;
             }
-            let _ = write!(attrs_str, r#" {}="{}""#, key, HtmlEscape(value));
+            let _ = write!(&mut self.output, r#" {}="{}""#, key, Escaped(value));
         }
-        attrs_str
+        attrs.clear();
+        self.spare_attributes = attrs;
     }
 
-    fn take_pending_attrs_string(&mut self, skip_empty_alt: bool) -> String {
-        match self.pending_attributes.take() {
-            Some(attrs) => Self::attrs_string(&attrs, skip_empty_alt),
-            None => String::new(),
+    /// Writes the pending attributes of an `<img>`. With image hints on,
+    /// adds its pixel size unless `#+attr_html` gave one, and lets the
+    /// browser load and decode it lazily.
+    fn write_image_attrs(&mut self, src: &str, skip_empty_alt: bool) {
+        let given = |key: &str| {
+            self.pending_attributes
+                .as_ref()
+                .is_some_and(|attrs| attrs.keys().any(|k| k.eq_ignore_ascii_case(key)))
+        };
+        let (sized, loading, decoding) = (given("width") || given("height"), given("loading"), given("decoding"));
+        self.write_pending_attrs(skip_empty_alt);
+        if !self.image_hints {
+            return;
+        }
+
+        if let (false, Some(dir)) = (sized, &self.image_dir) {
+            let size = images::size(dir, src);
+            if let Some((width, height)) = size {
+                let _ = write!(&mut self.output, r#" width="{}" height="{}""#, width, height);
+            }
+            self.probed_images.push((src.to_string(), size));
+        }
+        if !loading {
+            self.output.push_str(r#" loading="lazy""#);
+        }
+        if !decoding {
+            self.output.push_str(r#" decoding="async""#);
         }
     }
 
-    fn merge_pending_attributes(&mut self, parsed: HashMap<String, String>) {
-        if let Some(existing) = &mut self.pending_attributes {
-            existing.extend(parsed);
-        } else {
-            self.pending_attributes = Some(parsed);
+    fn discard_pending_attrs(&mut self) {
+        if let Some(mut attrs) = self.pending_attributes.take() {
+            attrs.clear();
+            self.spare_attributes = attrs;
         }
     }
 
+    fn merge_pending_attributes(&mut self, value: &str) {
+        let attrs = self
+            .pending_attributes
+            .get_or_insert_with(|| std::mem::take(&mut self.spare_attributes));
+        Self::parse_attr_html(value, attrs);
+    }
+
     fn escape_text_only(&mut self, text: &str) {
-        let _ = write!(&mut self.output, "{}", HtmlEscape(text));
+        escape_into(&mut self.output, text);
     }
 
     fn handle_document_enter(&mut self) {
-        self.output.push_str("<main>");
+        if !self.fragment {
+            self.output.push_str(MAIN_OPEN);
+        }
     }
 
     fn handle_document_leave(&mut self) {
-        self.output.push_str("</main>");
+        if !self.fragment {
+            self.output.push_str(MAIN_CLOSE);
+        }
     }
 
-    fn handle_headline_enter(&mut self, headline: &Headline, ctx: &mut TraversalContext) {
+    /// Writes the heading. With anchors on, `<h2>` to `<h4>` are wrapped in
+    /// a sticky `heading-wrapper` together with a `#` link to themselves.
+    fn handle_headline_enter(&mut self, headline: &Headline, id: &str, ctx: &mut TraversalContext) {
         let level = std::cmp::min(headline.level() + 1, 6);
-        let (_title, id) = headline_title_and_id(headline);
+        let anchored = self.heading_anchors && level <= 4;
+        if anchored {
+            self.output.push_str(r#"<div class="heading-wrapper">"#);
+        }
         let _ = write!(&mut self.output, "<h{} id=\"{}\">", level, id);
+        let title_start = self.output.len();
         for elem in headline.title() {
             self.element(elem, ctx);
         }
+        let title_end = self.output.len();
         let _ = write!(&mut self.output, "</h{}>", level);
+
+        if anchored {
+            let label = Self::text_content(&self.output[title_start..title_end]);
+            let _ = write!(
+                &mut self.output,
+                r##"<a class="heading-anchor" href="#{}" aria-label="Link to {}">#</a></div>"##,
+                id, label
+            );
+        }
+    }
+
+    /// Rendered HTML with its tags removed; entities are kept, so the result
+    /// can go straight into an attribute.
+    fn text_content(html: &str) -> String {
+        let mut text = String::with_capacity(html.len());
+        let mut rest = html;
+        while let Some(open) = rest.find('<') {
+            text.push_str(&rest[..open]);
+            match rest[open..].find('>') {
+                Some(close) => rest = &rest[open + close + 1..],
+                None => rest = "",
+            }
+        }
+        text.push_str(rest);
+        text
     }
 
     fn handle_paragraph_enter(&mut self) {
@@ -114,20 +323,55 @@ impl HtmlExportWithUrls {
         } else {
             self.output.push_str("</p>");
         }
-        self.pending_attributes = None;
+        self.discard_pending_attrs();
     }
 
     fn handle_source_block_enter(&mut self, block: &SourceBlock) {
         self.output.push_str(r#"<div class="org-src-container">"#);
-        if let Some(language) = block.language() {
-            let _ = write!(
-                &mut self.output,
-                r#"<pre class="src src-{}">"#,
-                HtmlEscape(&language)
-            );
-        } else {
-            self.output.push_str(r#"<pre class="src">"#);
+        self.source_lines = Some(1);
+        let language = block.language();
+        match &language {
+            Some(language) => {
+                let _ = write!(&mut self.output, r#"<pre class="src src-{}""#, Escaped(language));
+                if self.highlight {
+                    self.source_block = highlight::canonical(language)
+                        .map(|language| SourceCapture { language, code: String::new() });
+                }
+            }
+            None => self.output.push_str(r#"<pre class="src""#),
+        }
+        if self.code_decorations {
+            let label = language.as_deref().filter(|language| *language != "nil").unwrap_or("code");
+            let _ = write!(&mut self.output, r#" data-lang="{}""#, Escaped(label));
+        }
+        self.output.push('>');
+    }
+
+    fn handle_source_block_leave(&mut self) {
+        if let Some(capture) = self.source_block.take() {
+            let key = cache::hash(&[
+                highlight::VERSION.as_bytes(),
+                capture.language.as_bytes(),
+                capture.code.as_bytes(),
+            ]);
+            let html = cache::get_or_insert_with("highlight", key, || {
+                highlight::highlight(capture.language, &capture.code).unwrap_or_default()
+            });
+            self.output.push_str(&html);
+        }
+        self.output.push_str("</pre>");
+
+        let lines = self.source_lines.take().unwrap_or(0);
+        if self.code_decorations {
+            if lines > COLLAPSED_CODE_LINES {
+                self.output.push_str(concat!(
+                    r#"<div class="expand-wrapper"><span class="code-ellipsis">...</span>"#,
+                    r#"<button type="button" class="toggle-button">Expand</button></div>"#
+                ));
+            }
+            self.output.push_str(r#"<button type="button" class="copy-button">Copy</button>"#);
         }
+        self.output.push_str("</div>");
     }
 
     fn handle_list_enter(&mut self, list: &List) {
@@ -191,30 +435,57 @@ impl HtmlExportWithUrls {
 
     fn handle_link_enter(&mut self, link: &Link, ctx: &mut TraversalContext) {
         let path = link.path();
-        let path = path.trim_start_matches("file:");
-        let attrs_str = self.take_pending_attrs_string(false);
+        let (tag, path) = if link.is_image() {
+            ("img src", Cow::Borrowed(path.trim_start_matches("file:")))
+        } else {
+            ("a href", links::href(&path))
+        };
 
+        let _ = write!(&mut self.output, r#"<{}="{}""#, tag, Escaped(&path));
         if link.is_image() {
-            let _ = write!(&mut self.output, r#"<img src="{}"{}>"#, HtmlEscape(&path), attrs_str);
-            return ctx.skip();
+            self.write_image_attrs(&path, false);
+        } else {
+            self.write_pending_attrs(false);
         }
+        self.output.push('>');
 
-        let _ = write!(&mut self.output, r#"<a href="{}"{}>"#, HtmlEscape(&path), attrs_str);
+        if link.is_image() {
+            return ctx.skip();
+        }
 
         if !link.has_description() {
-            let _ = write!(&mut self.output, "{}</a>", HtmlEscape(&path));
+            let text = link.path();
+            let _ = write!(&mut self.output, "{}</a>", Escaped(text.trim_start_matches("file:")));
             ctx.skip();
         }
     }
 
     fn handle_text(&mut self, text: &str) {
-        if self.in_verbatim_or_code {
+        if let Some(lines) = &mut self.source_lines {
+            *lines += memchr::memchr_iter(b'\n', text.as_bytes()).count();
+        }
+        if let Some(capture) = &mut self.source_block {
+            capture.code.push_str(text);
+        } else if self.in_verbatim_or_code {
             self.escape_text_only(text);
         } else {
             self.process_text_with_urls(text);
         }
     }
 
+    /// Writes MathML when enabled and the TeX is supported, and the raw
+    /// LaTeX otherwise.
+    fn handle_latex(&mut self, latex: &str) {
+        if self.mathml {
+            let key = cache::hash(&[mathml::VERSION.as_bytes(), latex.trim().as_bytes()]);
+            if let Some(math) = cache::get_or_try_insert_with("math", key, || mathml::render(latex)) {
+                self.output.push_str(&math);
+                return;
+            }
+        }
+        self.output.push_str(latex);
+    }
+
     fn handle_timestamp(&mut self, timestamp: &Timestamp) {
         self.output.push_str(r#"<span class="timestamp-wrapper"><span class="timestamp">"#);
         for e in timestamp.syntax().children_with_tokens() {
@@ -234,128 +505,155 @@ impl HtmlExportWithUrls {
     fn handle_keyword(&mut self, keyword: &Keyword, ctx: &mut TraversalContext) {
         let key = keyword.key();
         if key.eq_ignore_ascii_case("attr_html") {
-            let value = keyword.value();
-            let parsed = Self::parse_attr_html(&value);
-            self.merge_pending_attributes(parsed);
+            self.merge_pending_attributes(&keyword.value());
         }
         ctx.skip();
     }
 
     fn process_text_with_urls(&mut self, text: &str) {
-        let mut char_pos = 0;
-        let chars: Vec<char> = text.chars().collect();
-
-        while char_pos < chars.len() {
-            if char_pos + 7 <= chars.len()
-                && chars[char_pos] == 'h'
-                && chars[char_pos + 1] == 't'
-                && chars[char_pos + 2] == 't'
-                && chars[char_pos + 3] == 'p'
-            {
-                let start = char_pos;
-                let maybe_result = if char_pos + 8 <= chars.len()
-                    && chars[char_pos + 4] == 's'
-                    && chars[char_pos + 5] == ':'
-                    && chars[char_pos + 6] == '/'
-                    && chars[char_pos + 7] == '/'
-                {
-                    Self::extract_url(&chars, char_pos + 8, "https://")
-                } else if char_pos + 7 <= chars.len()
-                    && chars[char_pos + 4] == ':'
-                    && chars[char_pos + 5] == '/'
-                    && chars[char_pos + 6] == '/'
-                {
-                    Self::extract_url(&chars, char_pos + 7, "http://")
-                } else {
-                    None
-                };
-
-                if let Some((url, end_pos)) = maybe_result {
-                    if url.len() > 10 {
-                        let use_image = Self::is_image_url(&url) && self.pending_attributes.is_some();
-                        let attrs_str = self.take_pending_attrs_string(true);
-                        if use_image {
-                            let _ = write!(
-                                &mut self.output,
-                                r#"<img src="{}"{}>"#,
-                                HtmlEscape(&url),
-                                attrs_str
-                            );
-                        } else {
-                            let _ = write!(
-                                &mut self.output,
-                                r#"<a href="{}"{}>{}</a>"#,
-                                HtmlEscape(&url),
-                                attrs_str,
-                                HtmlEscape(&url)
-                            );
-                        }
-                        char_pos = end_pos;
-                        continue;
-                    }
-                }
-                self.append_escaped_char(chars[start]);
-                char_pos += 1;
+        let bytes = text.as_bytes();
+        let mut emitted = 0;
+        let mut search = 0;
+
+        while let Some(offset) = memmem::find(&bytes[search..], b"http") {
+            let start = search + offset;
+            let rest = &bytes[start + 4..];
+            let url_start = if rest.starts_with(b"s://") {
+                start + 8
+            } else if rest.starts_with(b"://") {
+                start + 7
             } else {
-                self.append_escaped_char(chars[char_pos]);
-                char_pos += 1;
+                search = start + 1;
+                continue;
+            };
+
+            let end = Self::extract_url(text, url_start);
+            if end - start <= 10 {
+                search = start + 1;
+                continue;
             }
+
+            self.write_prose(&text[emitted..start]);
+            self.space_before('h');
+            self.write_url(&text[start..end]);
+            self.end_prose(&text[start..end]);
+            emitted = end;
+            search = end;
         }
+
+        self.write_prose(&text[emitted..]);
     }
 
-    fn extract_url(chars: &[char], start: usize, scheme: &str) -> Option<(String, usize)> {
-        let mut url_end = start;
-        let mut paren_depth = 0;
+    /// Whether running text is spaced. Source blocks that are not
+    /// highlighted still reach `write_prose`, and code is never spaced.
+    fn spaces_prose(&self) -> bool {
+        self.spacing && self.source_lines.is_none()
+    }
 
-        while url_end < chars.len() {
-            let c = chars[url_end];
+    /// Escapes running text, spacing CJK and Latin apart when enabled.
+    fn write_prose(&mut self, text: &str) {
+        if !self.spaces_prose() {
+            self.escape_text_only(text);
+            return;
+        }
+        let Some(first) = text.chars().next() else {
+            return;
+        };
 
-            if c == '(' {
-                paren_depth += 1;
-            } else if c == '（' {
-                paren_depth += 1;
-            } else if c == ')' {
-                if paren_depth > 0 {
-                    paren_depth -= 1;
-                } else {
-                    break;
-                }
-            } else if c == '）' {
-                if paren_depth > 0 {
-                    paren_depth -= 1;
-                } else {
-                    break;
-                }
-            } else if c.is_whitespace() || c == '<' || c == '>' || c == '"' || c == '\''
-                || c == '。' || c == '，' || c == '！' || c == '？' || c == '；' || c == '：'
-            {
-                break;
+        self.space_before(first);
+        let mut start = 0;
+        for gap in spacing::gaps(text) {
+            escape_into(&mut self.output, &text[start..gap]);
+            self.output.push(' ');
+            start = gap;
+        }
+        escape_into(&mut self.output, &text[start..]);
+        self.end_prose(text);
+    }
+
+    /// Adds a space if `next` starts a run that the previous prose, with
+    /// only inline tags in between, should be spaced apart from.
+    fn space_before(&mut self, next: char) {
+        if !self.spaces_prose() {
+            return;
+        }
+        if let Some((end, prev)) = self.spacing_tail.take() {
+            let between = self.output.get(end..).unwrap_or("<");
+            if spacing::needs_space(prev, next) && spacing::only_inline_tags(between) {
+                self.output.push(' ');
             }
-            url_end += 1;
         }
+    }
 
-        let url_str: String = chars[start..url_end].iter().collect();
-        let trimmed_len = url_str.trim_end_matches(|c: char| {
-            c == '.' || c == ',' || c == '!' || c == '?' || c == ';' || c == ':'
-        }).chars().count();
+    fn end_prose(&mut self, text: &str) {
+        if self.spaces_prose() {
+            self.spacing_tail = text.chars().next_back().map(|last| (self.output.len(), last));
+        }
+    }
 
-        let actual_end = start + trimmed_len;
-        let trimmed_url: String = chars[start..actual_end].iter().collect();
+    fn write_url(&mut self, url: &str) {
+        let use_image = Self::is_image_url(url) && self.pending_attributes.is_some();
+        let tag = if use_image { "img src" } else { "a href" };
 
-        let url = format!("{}{}", scheme, trimmed_url);
-        if url.len() > 10 {
-            Some((url, actual_end))
+        let _ = write!(&mut self.output, r#"<{}="{}""#, tag, Escaped(url));
+        if use_image {
+            self.write_image_attrs(url, true);
+        } else {
+            self.write_pending_attrs(true);
+        }
+        if use_image {
+            self.output.push('>');
         } else {
-            None
+            let _ = write!(&mut self.output, ">{}</a>", Escaped(url));
+        }
+    }
+
+    /// Returns the byte offset where the URL body starting at `start` ends.
+    /// ASCII bytes are classified directly; only non-ASCII bytes are decoded
+    /// to check for full-width punctuation and Unicode whitespace.
+    fn extract_url(text: &str, start: usize) -> usize {
+        let bytes = text.as_bytes();
+        let mut url_end = start;
+        let mut paren_depth = 0usize;
+
+        while url_end < bytes.len() {
+            let b = bytes[url_end];
+            let (c, width) = if b.is_ascii() {
+                (b as char, 1)
+            } else {
+                let c = text[url_end..].chars().next().unwrap_or('\u{fffd}');
+                (c, c.len_utf8())
+            };
+
+            match c {
+                '(' | '（' => paren_depth += 1,
+                ')' | '）' => {
+                    if paren_depth == 0 {
+                        break;
+                    }
+                    paren_depth -= 1;
+                }
+                '<' | '>' | '"' | '\'' | '。' | '，' | '！' | '？' | '；' | '：' => break,
+                c if c.is_whitespace() => break,
+                _ => {}
+            }
+            url_end += width;
+        }
+
+        while url_end > start && matches!(bytes[url_end - 1], b'.' | b',' | b'!' | b'?' | b';' | b':') {
+            url_end -= 1;
         }
+
+        url_end
     }
 
-    fn parse_attr_html(value: &str) -> HashMap<String, String> {
+    /// Adds the `:key value` pairs in `value` to `attrs`, replacing earlier
+    /// values for the same key.
+    fn parse_attr_html(value: &str, attrs: &mut HashMap<String, String>) {
         fn attr_key(token: &str) -> Option<&str> {
             token.strip_prefix(':').or_else(|| token.strip_prefix('：'))
         }
 
-        let mut attrs = HashMap::new();
         let mut tokens = Vec::new();
         let mut current = String::new();
         let mut in_quotes = false;
@@ -413,8 +711,6 @@ impl HtmlExportWithUrls {
             attrs.insert(key.to_string(), value);
             index += 1;
         }
-
-        attrs
     }
 
     fn is_image_url(url: &str) -> bool {
@@ -433,30 +729,71 @@ impl HtmlExportWithUrls {
             || trimmed.ends_with(".avif")
     }
 
-    fn finish(self) -> String {
-        self.output
+    /// Copies the body HTML out at its final size; the buffer itself goes
+    /// back to the thread's scratch when the exporter is dropped.
+    fn finish(mut self) -> Option<CString> {
+        self.flush_to_sink(true);
+        scratch::observe_output(self.input_len, self.output.len());
+        body_c_string(&[&self.output])
+    }
+
+    /// Takes the output as is, for a caller that joins several pieces.
+    fn finish_fragment(mut self) -> String {
+        self.flush_to_sink(true);
+        std::mem::take(&mut self.output)
+    }
+}
+
+impl Drop for HtmlExportWithUrls {
+    fn drop(&mut self) {
+        scratch::release_html(scratch::HtmlBuffers {
+            output: std::mem::take(&mut self.output),
+            paragraph_start_len: std::mem::take(&mut self.paragraph_start_len),
+            in_descriptive_list: std::mem::take(&mut self.in_descriptive_list),
+            attributes: std::mem::take(&mut self.spare_attributes),
+        });
     }
 }
 
 struct TocBuilder {
     output: String,
+    slugs: SlugTable,
+    spacing: bool,
 }
 
 impl TocBuilder {
     fn new() -> Self {
         TocBuilder {
-            output: String::new(),
+            output: scratch::take_toc(),
+            slugs: SlugTable::default(),
+            spacing: options::enabled(options::CJK_SPACING),
         }
     }
 
-    fn finish(self) -> String {
-        self.output
+    /// Copies the list out wrapped in its `<nav>`.
+    fn finish(self) -> Option<CString> {
+        toc_c_string(&[&self.output])
+    }
+
+    /// Takes the list items without the wrapper.
+    fn finish_fragment(mut self) -> String {
+        std::mem::take(&mut self.output)
     }
 
-    fn handle_headline_enter(&mut self, headline: &Headline) {
-        let (title, id) = headline_title_and_id(headline);
+    fn handle_headline_enter(&mut self, headline: &Headline, id: &str) {
         let has_children = headline.headlines().next().is_some();
-        let _ = write!(&mut self.output, "<li><a href=\"#{}\">{}</a>", id, title);
+        let _ = write!(&mut self.output, "<li><a href=\"#{}\">", id);
+        let title_start = self.output.len();
+        for element in headline.title() {
+            let _ = write!(&mut self.output, "{}", element);
+        }
+        if self.spacing {
+            if let Cow::Owned(title) = spacing::spaced(&self.output[title_start..]) {
+                self.output.truncate(title_start);
+                self.output.push_str(&title);
+            }
+        }
+        self.output.push_str("</a>");
         if has_children {
             self.output.push_str("<ul>");
         }
@@ -470,38 +807,66 @@ impl TocBuilder {
     }
 }
 
-fn parse_org_with_config(org_str: &str) -> Org {
+impl Drop for TocBuilder {
+    fn drop(&mut self) {
+        scratch::release_toc(std::mem::take(&mut self.output));
+    }
+}
+
+fn parse_config() -> ParseConfig {
     let mut config = ParseConfig::default();
     config.use_sub_superscript = UseSubSuperscript::Brace;
-    config.parse(org_str)
+    config
+}
+
+fn parse_org_with_config(org_str: &str) -> Org {
+    stats::add_document(org_str.len());
+    stats::time(&[stats::Stage::Parse], || parse_config().parse(org_str))
 }
 
-fn input_to_str(input: *const c_char, len: usize) -> Option<String> {
+/// Borrows `len` bytes at `input` as UTF-8 text. The buffer does not need a
+/// NUL terminator and may contain embedded NULs.
+fn input_to_str<'a>(input: *const c_char, len: usize) -> Option<&'a str> {
     if input.is_null() || len == 0 {
         return None;
     }
 
-    unsafe { CStr::from_ptr(input).to_str().ok().map(|value| value.to_string()) }
+    let bytes = unsafe { std::slice::from_raw_parts(input as *const u8, len) };
+    std::str::from_utf8(bytes).ok()
 }
 
-fn into_c_string(value: &str) -> *mut c_char {
-    match CString::new(value) {
-        Ok(s) => s.into_raw(),
-        Err(_) => ptr::null_mut(),
+/// A null-terminated directory path from C; NULL, empty or non-UTF-8 paths
+/// are `None`.
+fn c_str_to_path<'a>(path: *const c_char) -> Option<&'a Path> {
+    if path.is_null() {
+        return None;
     }
+    let path = unsafe { std::ffi::CStr::from_ptr(path) }.to_str().ok()?;
+    (!path.is_empty()).then(|| Path::new(path))
 }
 
-fn into_c_string_optional(value: Option<&str>) -> *mut c_char {
-    match value {
-        Some(text) => into_c_string(text.trim()),
-        None => ptr::null_mut(),
+/// Concatenates `parts` into a single exactly-sized allocation.
+fn to_c_string(parts: &[&str]) -> Option<CString> {
+    let len = parts.iter().map(|part| part.len()).sum::<usize>();
+    let mut bytes = Vec::with_capacity(len + 1);
+    for part in parts {
+        bytes.extend_from_slice(part.as_bytes());
+    }
+    stats::add_output(len, 1);
+
+    match CString::new(bytes) {
+        Ok(s) => Some(s),
+        // Embedded NULs can come through from the input; replace them the
+        // way HTML parsers do rather than failing the whole document.
+        Err(err) => {
+            let text = String::from_utf8(err.into_vec()).ok()?;
+            CString::new(text.replace('\0', "\u{FFFD}")).ok()
+        }
     }
 }
 
-fn headline_title_and_id(headline: &Headline) -> (String, String) {
-    let title = headline.title().map(|e| e.to_string()).collect::<String>();
-    let id = slugify!(&title);
-    (title, id)
+fn into_raw(value: Option<CString>) -> *mut c_char {
+    value.map_or(ptr::null_mut(), CString::into_raw)
 }
 
 impl Traverser for HtmlExportWithUrls {
@@ -510,7 +875,11 @@ impl Traverser for HtmlExportWithUrls {
             Event::Enter(Container::Document(_)) => self.handle_document_enter(),
             Event::Leave(Container::Document(_)) => self.handle_document_leave(),
 
-            Event::Enter(Container::Headline(headline)) => self.handle_headline_enter(&headline, ctx),
+            Event::Enter(Container::Headline(headline)) => {
+                let mut slugs = std::mem::take(&mut self.slugs);
+                self.handle_headline_enter(&headline, slugs.next_id(&headline), ctx);
+                self.slugs = slugs;
+            }
             Event::Leave(Container::Headline(_)) => {},
 
             Event::Enter(Container::Paragraph(_)) => self.handle_paragraph_enter(),
@@ -546,7 +915,7 @@ impl Traverser for HtmlExportWithUrls {
             }
 
             Event::Enter(Container::SourceBlock(block)) => self.handle_source_block_enter(&block),
-            Event::Leave(Container::SourceBlock(_)) => self.output.push_str("</pre></div>"),
+            Event::Leave(Container::SourceBlock(_)) => self.handle_source_block_leave(),
 
             Event::Enter(Container::QuoteBlock(_)) => self.open_tag("blockquote"),
             Event::Leave(Container::QuoteBlock(_)) => self.close_tag("blockquote"),
@@ -604,12 +973,8 @@ impl Traverser for HtmlExportWithUrls {
 
             Event::Timestamp(timestamp) => self.handle_timestamp(&timestamp),
 
-            Event::LatexFragment(latex) => {
-                let _ = write!(&mut self.output, "{}", latex.syntax());
-            }
-            Event::LatexEnvironment(latex) => {
-                let _ = write!(&mut self.output, "{}", latex.syntax());
-            }
+            Event::LatexFragment(latex) => self.handle_latex(&latex.syntax().to_string()),
+            Event::LatexEnvironment(latex) => self.handle_latex(&latex.syntax().to_string()),
 
             Event::Enter(Container::Keyword(keyword)) => self.handle_keyword(&keyword, ctx),
 
@@ -617,20 +982,388 @@ impl Traverser for HtmlExportWithUrls {
 
             _ => {}
         }
+
+        self.flush_to_sink(false);
     }
 }
 
 impl Traverser for TocBuilder {
     fn event(&mut self, event: Event, _ctx: &mut TraversalContext) {
         match event {
-            Event::Enter(Container::Headline(headline)) => self.handle_headline_enter(&headline),
+            Event::Enter(Container::Headline(headline)) => {
+                let mut slugs = std::mem::take(&mut self.slugs);
+                self.handle_headline_enter(&headline, slugs.next_id(&headline));
+                self.slugs = slugs;
+            }
             Event::Leave(Container::Headline(headline)) => self.handle_headline_leave(&headline),
             _ => {}
         }
     }
 }
 
-fn extract_body_content(html: &str) -> String {
+/// Collects the text a reader sees, for search indexes and excerpts.
+/// Markup is left out and whitespace collapsed to single spaces; each
+/// headline title gets a line of its own and its offset is recorded with
+/// its id.
+struct TextExtractor {
+    text: String,
+    headings: Vec<(usize, String)>,
+    /// Separator owed before the next word: a space, or a newline after a
+    /// headline title. Dropped at the very start and end.
+    pending: Option<char>,
+    skip_source: bool,
+    slugs: SlugTable,
+}
+
+/// Output of `TextExtractor`, before it is handed to C.
+struct ExtractedText {
+    text: String,
+    headings: Vec<(usize, String)>,
+}
+
+impl TextExtractor {
+    fn new(skip_source: bool) -> Self {
+        TextExtractor {
+            text: String::new(),
+            headings: Vec::new(),
+            pending: None,
+            skip_source,
+            slugs: SlugTable::default(),
+        }
+    }
+
+    fn finish(self) -> ExtractedText {
+        ExtractedText { text: self.text, headings: self.headings }
+    }
+
+    fn separate(&mut self) {
+        self.pending.get_or_insert(' ');
+    }
+
+    fn push_text(&mut self, text: &str) {
+        let is_space = |c: char| c.is_whitespace() || c == '\0';
+        if text.starts_with(is_space) {
+            self.separate();
+        }
+        for (i, word) in text.split(is_space).filter(|word| !word.is_empty()).enumerate() {
+            if i > 0 {
+                self.separate();
+            }
+            if let Some(separator) = self.pending.take() {
+                if !self.text.is_empty() {
+                    self.text.push(separator);
+                }
+            }
+            self.text.push_str(word);
+        }
+        if text.ends_with(is_space) {
+            self.separate();
+        }
+    }
+
+    fn handle_headline_enter(&mut self, headline: &Headline, id: &str, ctx: &mut TraversalContext) {
+        if !self.text.is_empty() {
+            self.text.push('\n');
+        }
+        self.pending = None;
+        self.headings.push((self.text.len(), id.to_string()));
+        for elem in headline.title() {
+            self.element(elem, ctx);
+        }
+        self.pending = Some('\n');
+    }
+}
+
+impl ExtractedText {
+    /// Appends the text of the next top-level section, as if both had
+    /// been extracted in one walk.
+    fn append(&mut self, next: ExtractedText) {
+        if !self.text.is_empty() && (!next.text.is_empty() || !next.headings.is_empty()) {
+            self.text.push('\n');
+        }
+        let base = self.text.len();
+        self.headings.extend(next.headings.into_iter().map(|(offset, id)| (base + offset, id)));
+        self.text.push_str(&next.text);
+    }
+}
+
+impl Traverser for TextExtractor {
+    fn event(&mut self, event: Event, ctx: &mut TraversalContext) {
+        match event {
+            Event::Enter(Container::Headline(headline)) => {
+                let mut slugs = std::mem::take(&mut self.slugs);
+                self.handle_headline_enter(&headline, slugs.next_id(&headline), ctx);
+                self.slugs = slugs;
+            }
+            Event::Text(text) => self.push_text(&text),
+            Event::Entity(entity) => self.push_text(entity.utf8()),
+
+            Event::Enter(Container::Link(link)) => {
+                if link.is_image() {
+                    ctx.skip();
+                } else if !link.has_description() {
+                    self.push_text(link.path().trim_start_matches("file:"));
+                    ctx.skip();
+                }
+            }
+            Event::Enter(Container::SourceBlock(_)) if self.skip_source => {
+                self.separate();
+                ctx.skip();
+            }
+            Event::Enter(
+                Container::Keyword(_)
+                | Container::Comment(_)
+                | Container::CommentBlock(_)
+                | Container::ExportBlock(_)
+                | Container::PropertyDrawer(_),
+            ) => ctx.skip(),
+
+            // Inline markup joins the words around it; everything else
+            // separates them.
+            Event::Enter(
+                Container::Bold(_)
+                | Container::Italic(_)
+                | Container::Underline(_)
+                | Container::Strike(_)
+                | Container::Verbatim(_)
+                | Container::Code(_)
+                | Container::Subscript(_)
+                | Container::Superscript(_)
+                | Container::Target(_)
+                | Container::RadioTarget(_),
+            )
+            | Event::Leave(
+                Container::Bold(_)
+                | Container::Italic(_)
+                | Container::Underline(_)
+                | Container::Strike(_)
+                | Container::Verbatim(_)
+                | Container::Code(_)
+                | Container::Subscript(_)
+                | Container::Superscript(_)
+                | Container::Target(_)
+                | Container::RadioTarget(_)
+                | Container::Link(_),
+            ) => {}
+            Event::Enter(_) | Event::Leave(_) | Event::LineBreak(_) => self.separate(),
+            _ => {}
+        }
+    }
+}
+
+/// Runs the HTML exporter, TOC builder and metadata collector over a single
+/// traversal so a document only has to be parsed and walked once.
+struct DocumentExport {
+    html: HtmlExportWithUrls,
+    toc: TocBuilder,
+    meta: MetadataCollector,
+    slugs: SlugTable,
+    clock: stats::StageClock,
+}
+
+impl DocumentExport {
+    fn new(input_len: usize, sink: Option<HtmlSink>, slugs: SlugTable) -> Self {
+        DocumentExport {
+            slugs,
+            html: HtmlExportWithUrls::new(input_len, sink),
+            toc: TocBuilder::new(),
+            meta: MetadataCollector::new(),
+            clock: stats::StageClock::new(options::enabled(options::STAGE_TIMING)),
+        }
+    }
+}
+
+impl Traverser for DocumentExport {
+    fn event(&mut self, event: Event, ctx: &mut TraversalContext) {
+        use stats::Stage;
+
+        self.clock.start();
+        match event {
+            Event::Enter(Container::Headline(headline)) => {
+                let id = self.slugs.next_id(&headline);
+                self.toc.handle_headline_enter(&headline, id);
+                self.clock.lap(Stage::Toc);
+                self.html.handle_headline_enter(&headline, id, ctx);
+                self.clock.lap(Stage::Html);
+            }
+            Event::Leave(Container::Headline(headline)) => {
+                self.toc.handle_headline_leave(&headline);
+                self.clock.lap(Stage::Toc);
+            }
+            Event::Enter(Container::Keyword(keyword)) => {
+                self.meta.collect_keyword(&keyword);
+                self.clock.lap(Stage::Meta);
+                self.html.handle_keyword(&keyword, ctx);
+                self.clock.lap(Stage::Html);
+            }
+            event => {
+                self.html.event(event, ctx);
+                self.clock.lap(Stage::Html);
+            }
+        }
+    }
+}
+
+/// Walks `org` with `traverser`, charging the time to traversal and to
+/// `stage`.
+fn traverse_as(org: &Org, stage: stats::Stage, traverser: &mut impl Traverser) {
+    stats::time(&[stats::Stage::Traverse, stage], || org.traverse(traverser));
+}
+
+/// Length of the org text `org` was parsed from.
+fn source_len(org: &Org) -> usize {
+    usize::from(org.document().syntax().text_range().len())
+}
+
+// The exporters below borrow `slugs` for the walk and hand it back, so a
+// parsed document computes its headline ids once for every view.
+
+fn export_html(org: &Org, slugs: &mut SlugTable, image_dir: Option<&Path>) -> Option<CString> {
+    let mut exporter = HtmlExportWithUrls::new(source_len(org), None);
+    exporter.image_dir = image_dir.map(Path::to_path_buf);
+    exporter.slugs = slugs.replay();
+    traverse_as(org, stats::Stage::Html, &mut exporter);
+    *slugs = std::mem::take(&mut exporter.slugs);
+    exporter.finish()
+}
+
+fn write_html(org: &Org, sink: HtmlSink, slugs: &mut SlugTable, image_dir: Option<&Path>) -> i32 {
+    let mut exporter = HtmlExportWithUrls::new(source_len(org), Some(sink));
+    exporter.image_dir = image_dir.map(Path::to_path_buf);
+    exporter.slugs = slugs.replay();
+    traverse_as(org, stats::Stage::Html, &mut exporter);
+    *slugs = std::mem::take(&mut exporter.slugs);
+    exporter.flush_to_sink(true);
+    if exporter.sink_failed { 1 } else { 0 }
+}
+
+fn export_toc(org: &Org, slugs: &mut SlugTable) -> Option<CString> {
+    let mut toc_builder = TocBuilder::new();
+    toc_builder.slugs = slugs.replay();
+    traverse_as(org, stats::Stage::Toc, &mut toc_builder);
+    *slugs = std::mem::take(&mut toc_builder.slugs);
+    toc_builder.finish()
+}
+
+fn extract_text(org: &Org, slugs: &mut SlugTable, skip_source: bool) -> ExtractedText {
+    let mut extractor = TextExtractor::new(skip_source);
+    extractor.slugs = slugs.replay();
+    stats::time(&[stats::Stage::Traverse], || org.traverse(&mut extractor));
+    *slugs = std::mem::take(&mut extractor.slugs);
+    extractor.finish()
+}
+
+fn collect_metadata(org: &Org) -> MetadataCollector {
+    let mut collector = MetadataCollector::new();
+    let mut handler = from_fn(|event| collector.collect_from_event(event));
+    traverse_as(org, stats::Stage::Meta, &mut handler);
+    collector
+}
+
+/// Everything one traversal produces, still as Rust values so it can be
+/// built on a worker thread and converted to C on the caller's.
+struct ExportedDocument {
+    html: Option<CString>,
+    toc: CString,
+    meta: MetadataCollector,
+    /// Only with `options::RESULT_TEXT`.
+    text: Option<ExtractedText>,
+}
+
+/// Runs the combined traversal. With a sink the body HTML is streamed to it
+/// and `html` is `None`; returns `None` if the sink failed. Images are
+/// sized from `image_dir` when given.
+fn export_document(
+    org: &Org,
+    sink: Option<HtmlSink>,
+    slugs: &mut SlugTable,
+    image_dir: Option<&Path>,
+) -> Option<ExportedDocument> {
+    let mut export = DocumentExport::new(source_len(org), sink, slugs.replay());
+    export.html.image_dir = image_dir.map(Path::to_path_buf);
+    stats::time(&[stats::Stage::Traverse], || org.traverse(&mut export));
+    export.clock.commit();
+    *slugs = export.slugs;
+
+    export.html.flush_to_sink(true);
+    if export.html.sink_failed {
+        return None;
+    }
+    let html = if sink.is_some() { None } else { Some(export.html.finish()?) };
+    let toc = export.toc.finish()?;
+
+    // A second, cheap walk over the same tree; sharing the first would mean
+    // sharing the HTML exporter's skip decisions.
+    let text = options::enabled(options::RESULT_TEXT).then(|| extract_text(org, slugs, false));
+
+    Some(ExportedDocument { html, toc, meta: export.meta, text })
+}
+
+impl ExportedDocument {
+    fn into_result(self, out: &mut OrgResult) -> i32 {
+        let mut text = OrgText::empty();
+        if let Some(extracted) = self.text {
+            extracted.into_raw(&mut text);
+        }
+        *out = OrgResult {
+            html: into_raw(self.html),
+            toc: self.toc.into_raw(),
+            meta: self.meta.into_raw(),
+            text,
+        };
+
+        0
+    }
+}
+
+/// Exports org text, section by section on up to `threads` threads when it
+/// is large enough.
+fn export_text(text: &str, threads: usize, image_dir: Option<&Path>) -> Option<ExportedDocument> {
+    parallel::export(text, threads, image_dir)
+        .or_else(|| export_document(&parse_org_with_config(text), None, &mut SlugTable::default(), image_dir))
+}
+
+/// Fills `out` from one traversal. With a sink the body HTML is streamed to
+/// it and `out.html` is left NULL.
+fn process_into(
+    org: &Org,
+    sink: Option<HtmlSink>,
+    slugs: &mut SlugTable,
+    image_dir: Option<&Path>,
+    out: &mut OrgResult,
+) -> i32 {
+    match export_document(org, sink, slugs, image_dir) {
+        Some(doc) => doc.into_result(out),
+        None => {
+            *out = OrgResult::empty();
+            1
+        }
+    }
+}
+
+const MAIN_OPEN: &str = "<main>";
+const MAIN_CLOSE: &str = "</main>";
+
+/// Joins exported HTML into a C string holding just the body.
+fn body_c_string(parts: &[&str]) -> Option<CString> {
+    // Only raw HTML snippets in the document can produce a literal <body>.
+    if parts.iter().any(|part| memmem::find(part.as_bytes(), b"<body>").is_some()) {
+        let html = parts.concat();
+        return to_c_string(&[body_content(&html)]);
+    }
+    to_c_string(parts)
+}
+
+/// Joins TOC list items into a C string wrapped in its `<nav>`.
+fn toc_c_string(items: &[&str]) -> Option<CString> {
+    let mut parts = Vec::with_capacity(items.len() + 2);
+    parts.push("<nav class=\"toc\"><ul>");
+    parts.extend_from_slice(items);
+    parts.push("</ul></nav>");
+    to_c_string(&parts)
+}
+
+fn body_content(html: &str) -> &str {
     let body_start = html.find("<body>").and_then(|pos| {
         html[pos + 6..].find('>').map(|end| pos + 6 + end + 1)
     });
@@ -638,8 +1371,8 @@ fn extract_body_content(html: &str) -> String {
     let body_end = html.find("</body>");
 
     match (body_start, body_end) {
-        (Some(start), Some(end)) if start < end => html[start..end].trim().to_string(),
-        _ => html.to_string(),
+        (Some(start), Some(end)) if start < end => html[start..end].trim(),
+        _ => html,
     }
 }
 
@@ -651,6 +1384,8 @@ pub struct OrgMetadata {
     tags: *mut c_char,
     tags_array: *mut *mut c_char,
     tags_count: usize,
+    /// Size of the single allocation holding this header and all strings.
+    alloc_size: usize,
 }
 
 struct MetadataCollector {
@@ -658,6 +1393,9 @@ struct MetadataCollector {
     date: Option<String>,
     description: Option<String>,
     tags: Vec<String>,
+    /// Titles and descriptions are shown as text, so they are spaced like
+    /// the body.
+    spacing: bool,
 }
 
 impl MetadataCollector {
@@ -667,29 +1405,333 @@ impl MetadataCollector {
             date: None,
             description: None,
             tags: Vec::new(),
+            spacing: options::enabled(options::CJK_SPACING),
         }
     }
 }
 
 impl MetadataCollector {
+    /// Fills fields still unset from a collector that saw later text.
+    fn merge(&mut self, later: MetadataCollector) {
+        if self.title.is_none() {
+            self.title = later.title;
+        }
+        if self.date.is_none() {
+            self.date = later.date;
+        }
+        if self.description.is_none() {
+            self.description = later.description;
+        }
+        if self.tags.is_empty() {
+            self.tags = later.tags;
+        }
+    }
+
     fn collect_from_event(&mut self, event: Event) {
         if let Event::Enter(Container::Keyword(keyword)) = event {
-            let key = keyword.key();
-            let value = keyword.value();
-
-            if key.eq_ignore_ascii_case("TITLE") && self.title.is_none() {
-                self.title = Some(value.to_string());
-            } else if key.eq_ignore_ascii_case("DATE") && self.date.is_none() {
-                self.date = Some(value.to_string());
-            } else if key.eq_ignore_ascii_case("DESCRIPTION") && self.description.is_none() {
-                self.description = Some(value.to_string());
-            } else if key.eq_ignore_ascii_case("FILETAGS") && self.tags.is_empty() {
-                self.tags = value.split_whitespace()
-                    .map(|s| s.to_string())
-                    .collect();
-            }
+            self.collect_keyword(&keyword);
         }
     }
+
+    fn collect_keyword(&mut self, keyword: &Keyword) {
+        self.collect_pair(&keyword.key(), &keyword.value());
+    }
+
+    fn collect_pair(&mut self, key: &str, value: &str) {
+        let text = || {
+            if self.spacing {
+                spacing::spaced(value).into_owned()
+            } else {
+                value.to_string()
+            }
+        };
+        if key.eq_ignore_ascii_case("TITLE") && self.title.is_none() {
+            self.title = Some(text());
+        } else if key.eq_ignore_ascii_case("DATE") && self.date.is_none() {
+            self.date = Some(value.to_string());
+        } else if key.eq_ignore_ascii_case("DESCRIPTION") && self.description.is_none() {
+            self.description = Some(text());
+        } else if key.eq_ignore_ascii_case("FILETAGS") && self.tags.is_empty() {
+            self.tags = value.split_whitespace()
+                .map(|s| s.to_string())
+                .collect();
+        }
+    }
+
+    /// Packs everything into one allocation laid out as
+    /// `[OrgMetadata][tag pointers][title\0 date\0 description\0 tags\0 tag\0...]`,
+    /// so a result costs one malloc and one free however many tags it has.
+    fn into_raw(self) -> *mut OrgMetadata {
+        let title = self.title.as_deref().map(|s| without_nuls(s.trim()));
+        let date = self.date.as_deref().map(|s| without_nuls(s.trim()));
+        let description = self.description.as_deref().map(|s| without_nuls(s.trim()));
+        let tags: Vec<Cow<str>> = self.tags.iter().map(|tag| without_nuls(tag)).collect();
+
+        let joined_len = match tags.len() {
+            0 => 0,
+            n => tags.iter().map(|tag| tag.len()).sum::<usize>() + n - 1,
+        };
+        let field_len = |value: &Option<Cow<str>>| value.as_ref().map_or(0, |s| s.len() + 1);
+
+        let header = std::mem::size_of::<OrgMetadata>();
+        let array_bytes = tags.len() * std::mem::size_of::<*mut c_char>();
+        let string_bytes = field_len(&title)
+            + field_len(&date)
+            + field_len(&description)
+            + if joined_len > 0 { joined_len + 1 } else { 0 }
+            + tags.iter().map(|tag| tag.len() + 1).sum::<usize>();
+        let size = header + array_bytes + string_bytes;
+
+        let Ok(layout) = Layout::from_size_align(size, std::mem::align_of::<OrgMetadata>()) else {
+            return ptr::null_mut();
+        };
+
+        unsafe {
+            let base = alloc(layout);
+            if base.is_null() {
+                return ptr::null_mut();
+            }
+            stats::add_output(size, 1);
+
+            let array = base.add(header) as *mut *mut c_char;
+            let mut cursor = base.add(header + array_bytes);
+
+            let title_c = title.map_or(ptr::null_mut(), |s| arena_put(&mut cursor, &[&s]));
+            let date_c = date.map_or(ptr::null_mut(), |s| arena_put(&mut cursor, &[&s]));
+            let description_c = description.map_or(ptr::null_mut(), |s| arena_put(&mut cursor, &[&s]));
+
+            let parts: Vec<&str> = tags.iter().map(|tag| tag.as_ref()).collect();
+            let tags_c = if joined_len > 0 { arena_put(&mut cursor, &parts) } else { ptr::null_mut() };
+            for (i, tag) in parts.iter().enumerate() {
+                *array.add(i) = arena_put(&mut cursor, &[tag]);
+            }
+
+            ptr::write(base as *mut OrgMetadata, OrgMetadata {
+                title: title_c,
+                date: date_c,
+                description: description_c,
+                tags: tags_c,
+                tags_array: if tags.is_empty() { ptr::null_mut() } else { array },
+                tags_count: tags.len(),
+                alloc_size: size,
+            });
+
+            base as *mut OrgMetadata
+        }
+    }
+}
+
+/// Embedded NULs can come through from the input; replace them the way HTML
+/// parsers do so the value survives as a C string.
+fn without_nuls(value: &str) -> Cow<'_, str> {
+    if value.as_bytes().contains(&0) {
+        Cow::Owned(value.replace('\0', "\u{FFFD}"))
+    } else {
+        Cow::Borrowed(value)
+    }
+}
+
+/// Writes `parts` joined by spaces plus a NUL at `cursor` and advances it.
+unsafe fn arena_put(cursor: &mut *mut u8, parts: &[&str]) -> *mut c_char {
+    let start = *cursor;
+    for (i, part) in parts.iter().enumerate() {
+        if i > 0 {
+            **cursor = b' ';
+            *cursor = cursor.add(1);
+        }
+        ptr::copy_nonoverlapping(part.as_ptr(), *cursor, part.len());
+        *cursor = cursor.add(part.len());
+    }
+    **cursor = 0;
+    *cursor = cursor.add(1);
+    start as *mut c_char
+}
+
+/// Reads `#+KEY: value` lines from the top of a document without parsing it.
+/// Blank lines, `#` comments and a leading property drawer are skipped;
+/// scanning stops at the first headline or any other content line.
+fn scan_header(text: &str) -> MetadataCollector {
+    let mut collector = MetadataCollector::new();
+    let mut in_drawer = false;
+
+    for line in text.trim_start_matches('\u{feff}').lines() {
+        let line = line.trim();
+
+        if in_drawer {
+            in_drawer = !line.eq_ignore_ascii_case(":END:");
+            continue;
+        }
+        if line.is_empty() || line == "#" || line.starts_with("# ") {
+            continue;
+        }
+        if line.eq_ignore_ascii_case(":PROPERTIES:") {
+            in_drawer = true;
+            continue;
+        }
+
+        let Some(keyword) = line.strip_prefix("#+") else {
+            break;
+        };
+        let Some((key, value)) = keyword.split_once(':') else {
+            break;
+        };
+        if key.is_empty() || key.contains(char::is_whitespace) {
+            break;
+        }
+
+        collector.collect_pair(key, value);
+    }
+
+    collector
+}
+
+#[repr(C)]
+pub struct OrgResult {
+    html: *mut c_char,
+    toc: *mut c_char,
+    meta: *mut OrgMetadata,
+    text: OrgText,
+}
+
+impl OrgResult {
+    fn empty() -> Self {
+        OrgResult {
+            html: ptr::null_mut(),
+            toc: ptr::null_mut(),
+            meta: ptr::null_mut(),
+            text: OrgText::empty(),
+        }
+    }
+}
+
+/// Mirrors `OrgTextHeading` in org-ffi.h.
+#[repr(C)]
+pub struct OrgTextHeading {
+    offset: usize,
+    id: *mut c_char,
+}
+
+/// Mirrors `OrgText` in org-ffi.h.
+#[repr(C)]
+pub struct OrgText {
+    text: *mut c_char,
+    len: usize,
+    headings: *mut OrgTextHeading,
+    heading_count: usize,
+}
+
+impl OrgText {
+    fn empty() -> Self {
+        OrgText {
+            text: ptr::null_mut(),
+            len: 0,
+            headings: ptr::null_mut(),
+            heading_count: 0,
+        }
+    }
+}
+
+impl ExtractedText {
+    /// Fills `out`. The extractor never keeps NULs, so offsets stay valid.
+    fn into_raw(self, out: &mut OrgText) -> i32 {
+        let Some(text) = to_c_string(&[&self.text]) else {
+            *out = OrgText::empty();
+            return 1;
+        };
+        let ids_len: usize = self.headings.iter().map(|(_, id)| id.len()).sum();
+        stats::add_output(ids_len, 1 + self.headings.len());
+
+        let headings: Box<[OrgTextHeading]> = self
+            .headings
+            .into_iter()
+            .map(|(offset, id)| OrgTextHeading { offset, id: into_raw(CString::new(id).ok()) })
+            .collect();
+        *out = OrgText {
+            len: self.text.len(),
+            text: text.into_raw(),
+            heading_count: headings.len(),
+            headings: Box::into_raw(headings) as *mut OrgTextHeading,
+        };
+        0
+    }
+}
+
+/// One document for org_process_batch().
+#[repr(C)]
+pub struct OrgInput {
+    data: *const c_char,
+    len: usize,
+    image_dir: *const c_char,
+}
+
+/// One document of a batch, with the directory its images are sized from.
+type BatchInput<'a> = (&'a str, Option<&'a Path>);
+
+fn available_threads() -> usize {
+    std::thread::available_parallelism().map_or(1, |n| n.get())
+}
+
+fn batch_thread_count(requested: i32, jobs: usize) -> usize {
+    let threads = if requested > 0 { requested as usize } else { available_threads() };
+    threads.clamp(1, jobs.max(1))
+}
+
+/// Parses and exports every input, handing out documents to `threads`
+/// workers from a shared counter. Parse trees never leave the worker that
+/// built them; only the finished strings come back, in input order. The
+/// machine's threads are shared out between the workers, so a large
+/// document only gets section threads of its own when there are spare
+/// ones; otherwise it is exported on its worker's thread.
+fn process_batch(inputs: &[Option<BatchInput>], threads: usize) -> Vec<Option<ExportedDocument>> {
+    let section_threads = (available_threads() / threads.max(1)).max(1);
+    let export_one =
+        |input: Option<BatchInput>| input.and_then(|(text, image_dir)| export_text(text, section_threads, image_dir));
+
+    if threads <= 1 {
+        return inputs.iter().map(|text| export_one(*text)).collect();
+    }
+
+    let next = AtomicUsize::new(0);
+    let mut results: Vec<Option<ExportedDocument>> = inputs.iter().map(|_| None).collect();
+
+    std::thread::scope(|scope| {
+        let workers: Vec<_> = (0..threads)
+            .map(|_| {
+                scope.spawn(|| {
+                    let mut done = Vec::new();
+                    loop {
+                        let i = next.fetch_add(1, Ordering::Relaxed);
+                        if i >= inputs.len() {
+                            break;
+                        }
+                        done.push((i, export_one(inputs[i])));
+                    }
+                    done
+                })
+            })
+            .collect();
+
+        for worker in workers {
+            // Documents held by a worker that panicked are reported as failed.
+            if let Ok(done) = worker.join() {
+                for (i, doc) in done {
+                    results[i] = doc;
+                }
+            }
+        }
+    });
+
+    results
+}
+
+/// A parsed document kept alive across FFI calls so several views can be
+/// rendered from one parse.
+pub struct OrgDocument {
+    org: Org,
+    /// Headline ids, filled by the first export and replayed by the rest.
+    slugs: RefCell<SlugTable>,
+    /// Set by `org_document_set_image_dir`.
+    image_dir: Option<PathBuf>,
 }
 
 #[no_mangle]
@@ -699,16 +1741,8 @@ pub extern "C" fn org_parse_to_html(input: *const c_char, len: usize) -> *mut c_
         None => return ptr::null_mut(),
     };
 
-    let org = parse_org_with_config(org_str.as_str());
-    let mut exporter = HtmlExportWithUrls::new();
-    org.traverse(&mut exporter);
-    let html = exporter.finish();
-    let body_content = extract_body_content(&html);
-
-    match CString::new(body_content) {
-        Ok(c_string) => c_string.into_raw(),
-        Err(_) => ptr::null_mut(),
-    }
+    let org = parse_org_with_config(org_str);
+    into_raw(export_html(&org, &mut SlugTable::default(), None))
 }
 
 #[no_mangle]
@@ -718,51 +1752,18 @@ pub extern "C" fn org_extract_metadata(input: *const c_char, len: usize) -> *mut
         None => return ptr::null_mut(),
     };
 
-    let org = parse_org_with_config(org_str.as_str());
-
-    let mut collector = MetadataCollector::new();
-    let mut handler = from_fn(|event| collector.collect_from_event(event));
-
-    org.traverse(&mut handler);
-
-    let title_c = into_c_string_optional(collector.title.as_deref());
-    let date_c = into_c_string_optional(collector.date.as_deref());
-    let description_c = into_c_string_optional(collector.description.as_deref());
-
-    let tags_str = collector.tags.join(" ");
-    let tags_c = if tags_str.is_empty() {
-        ptr::null_mut()
-    } else {
-        into_c_string(&tags_str)
-    };
-
-    let tags_len = collector.tags.len();
-
-    let tags_array: Vec<*mut c_char> = collector.tags
-        .into_iter()
-        .filter_map(|tag| CString::new(tag).ok())
-        .map(|s| s.into_raw())
-        .collect();
+    let org = parse_org_with_config(org_str);
+    collect_metadata(&org).into_raw()
+}
 
-    let tags_array_ptr = if tags_array.is_empty() {
-        ptr::null_mut()
-    } else {
-        let mut boxed = tags_array.into_boxed_slice();
-        let ptr = boxed.as_mut_ptr();
-        std::mem::forget(boxed);
-        ptr
+#[no_mangle]
+pub extern "C" fn org_scan_header(input: *const c_char, len: usize) -> *mut OrgMetadata {
+    let org_str = match input_to_str(input, len) {
+        Some(value) => value,
+        None => return ptr::null_mut(),
     };
 
-    let metadata = Box::new(OrgMetadata {
-        title: title_c,
-        date: date_c,
-        description: description_c,
-        tags: tags_c,
-        tags_array: tags_array_ptr,
-        tags_count: if tags_array_ptr.is_null() { 0 } else { tags_len },
-    });
-
-    Box::into_raw(metadata)
+    scan_header(org_str).into_raw()
 }
 
 #[no_mangle]
@@ -778,29 +1779,8 @@ pub extern "C" fn org_free_string(s: *mut c_char) {
 pub extern "C" fn org_free_metadata(meta: *mut OrgMetadata) {
     if !meta.is_null() {
         unsafe {
-            let meta_box = Box::from_raw(meta);
-
-            if !meta_box.title.is_null() {
-                let _ = CString::from_raw(meta_box.title);
-            }
-            if !meta_box.date.is_null() {
-                let _ = CString::from_raw(meta_box.date);
-            }
-            if !meta_box.description.is_null() {
-                let _ = CString::from_raw(meta_box.description);
-            }
-            if !meta_box.tags.is_null() {
-                let _ = CString::from_raw(meta_box.tags);
-            }
-            if !meta_box.tags_array.is_null() && meta_box.tags_count > 0 {
-                let slice = std::slice::from_raw_parts_mut(meta_box.tags_array, meta_box.tags_count);
-                for tag_ptr in slice {
-                    if !tag_ptr.is_null() {
-                        let _ = CString::from_raw(*tag_ptr);
-                    }
-                }
-                let _ = Box::from_raw(meta_box.tags_array);
-            }
+            let layout = Layout::from_size_align_unchecked((*meta).alloc_size, std::mem::align_of::<OrgMetadata>());
+            dealloc(meta as *mut u8, layout);
         }
     }
 }
@@ -863,15 +1843,417 @@ pub extern "C" fn org_extract_toc(input: *const c_char, len: usize) -> *mut c_ch
         None => return ptr::null_mut(),
     };
 
-    let org = parse_org_with_config(org_str.as_str());
-    let mut toc_builder = TocBuilder::new();
-    org.traverse(&mut toc_builder);
-    let toc = toc_builder.finish();
+    let org = parse_org_with_config(org_str);
+    into_raw(export_toc(&org, &mut SlugTable::default()))
+}
+
+#[no_mangle]
+pub extern "C" fn org_process_document(input: *const c_char, len: usize, out: *mut OrgResult) -> i32 {
+    if out.is_null() {
+        return 1;
+    }
+
+    let org_str = match input_to_str(input, len) {
+        Some(value) => value,
+        None => {
+            unsafe { *out = OrgResult::empty() };
+            return 1;
+        }
+    };
+
+    // Callers opt in to a thread fan-out; batches budget their own.
+    let threads = if options::enabled(options::SECTION_THREADS) { available_threads() } else { 1 };
+    match export_text(org_str, threads, None) {
+        Some(doc) => unsafe { doc.into_result(&mut *out) },
+        None => {
+            unsafe { *out = OrgResult::empty() };
+            1
+        }
+    }
+}
+
+#[no_mangle]
+pub extern "C" fn org_process_batch(inputs: *const OrgInput, n: usize, out: *mut OrgResult, threads: i32) -> i32 {
+    if n == 0 {
+        return 0;
+    }
+    if inputs.is_null() || out.is_null() {
+        return 1;
+    }
+
+    let inputs = unsafe { std::slice::from_raw_parts(inputs, n) };
+    let out = unsafe { std::slice::from_raw_parts_mut(out, n) };
+    let texts: Vec<Option<BatchInput>> = inputs
+        .iter()
+        .map(|input| Some((input_to_str(input.data, input.len)?, c_str_to_path(input.image_dir))))
+        .collect();
+
+    let docs = process_batch(&texts, batch_thread_count(threads, n));
+
+    let mut failed = 0;
+    for (slot, doc) in out.iter_mut().zip(docs) {
+        failed += match doc {
+            Some(doc) => doc.into_result(slot),
+            None => {
+                *slot = OrgResult::empty();
+                1
+            }
+        };
+    }
+    failed
+}
+
+#[no_mangle]
+pub extern "C" fn org_free_result(result: *mut OrgResult) {
+    if result.is_null() {
+        return;
+    }
+
+    unsafe {
+        org_free_string((*result).html);
+        org_free_string((*result).toc);
+        org_free_metadata((*result).meta);
+        org_free_text(&mut (*result).text);
+        (*result).html = ptr::null_mut();
+        (*result).toc = ptr::null_mut();
+        (*result).meta = ptr::null_mut();
+    }
+}
+
+#[no_mangle]
+pub extern "C" fn org_document_parse(input: *const c_char, len: usize) -> *mut OrgDocument {
+    let org_str = match input_to_str(input, len) {
+        Some(value) => value,
+        None => return ptr::null_mut(),
+    };
+
+    let document = Box::new(OrgDocument {
+        org: parse_org_with_config(org_str),
+        slugs: RefCell::default(),
+        image_dir: None,
+    });
+
+    Box::into_raw(document)
+}
+
+#[no_mangle]
+pub extern "C" fn org_document_html(doc: *const OrgDocument) -> *mut c_char {
+    if doc.is_null() {
+        return ptr::null_mut();
+    }
+    unsafe {
+        let doc = &*doc;
+        into_raw(export_html(&doc.org, &mut doc.slugs.borrow_mut(), doc.image_dir.as_deref()))
+    }
+}
+
+#[no_mangle]
+pub extern "C" fn org_document_toc(doc: *const OrgDocument) -> *mut c_char {
+    if doc.is_null() {
+        return ptr::null_mut();
+    }
+    unsafe { into_raw(export_toc(&(*doc).org, &mut (*doc).slugs.borrow_mut())) }
+}
+
+#[no_mangle]
+pub extern "C" fn org_document_metadata(doc: *const OrgDocument) -> *mut OrgMetadata {
+    if doc.is_null() {
+        return ptr::null_mut();
+    }
+    unsafe { collect_metadata(&(*doc).org).into_raw() }
+}
+
+#[no_mangle]
+pub extern "C" fn org_document_process(doc: *const OrgDocument, out: *mut OrgResult) -> i32 {
+    if out.is_null() {
+        return 1;
+    }
+    if doc.is_null() {
+        unsafe { *out = OrgResult::empty() };
+        return 1;
+    }
+    unsafe {
+        let doc = &*doc;
+        process_into(&doc.org, None, &mut doc.slugs.borrow_mut(), doc.image_dir.as_deref(), &mut *out)
+    }
+}
+
+#[no_mangle]
+pub extern "C" fn org_document_set_image_dir(doc: *mut OrgDocument, image_dir: *const c_char) -> i32 {
+    if doc.is_null() {
+        return 1;
+    }
+    let dir = c_str_to_path(image_dir);
+    if dir.is_none() && !image_dir.is_null() {
+        return 1;
+    }
+    unsafe { (*doc).image_dir = dir.map(Path::to_path_buf) };
+    0
+}
+
+#[no_mangle]
+pub extern "C" fn org_document_free(doc: *mut OrgDocument) {
+    if !doc.is_null() {
+        unsafe {
+            let _ = Box::from_raw(doc);
+        }
+    }
+}
+
+#[no_mangle]
+pub extern "C" fn org_write_html(input: *const c_char, len: usize, write: Option<OrgWriteFn>, userdata: *mut c_void) -> i32 {
+    let Some(sink) = HtmlSink::new(write, userdata) else {
+        return 1;
+    };
+    let org_str = match input_to_str(input, len) {
+        Some(value) => value,
+        None => return 1,
+    };
+
+    let org = parse_org_with_config(org_str);
+    write_html(&org, sink, &mut SlugTable::default(), None)
+}
+
+#[no_mangle]
+pub extern "C" fn org_document_write_html(doc: *const OrgDocument, write: Option<OrgWriteFn>, userdata: *mut c_void) -> i32 {
+    let Some(sink) = HtmlSink::new(write, userdata) else {
+        return 1;
+    };
+    if doc.is_null() {
+        return 1;
+    }
+    unsafe {
+        let doc = &*doc;
+        write_html(&doc.org, sink, &mut doc.slugs.borrow_mut(), doc.image_dir.as_deref())
+    }
+}
+
+#[no_mangle]
+pub extern "C" fn org_set_option(option: i32, value: i32) -> i32 {
+    if options::set(option, value != 0) { 0 } else { 1 }
+}
+
+#[no_mangle]
+pub extern "C" fn org_set_cache_dir(path: *const c_char) -> i32 {
+    if path.is_null() {
+        cache::set_dir(None);
+        return 0;
+    }
+
+    match unsafe { std::ffi::CStr::from_ptr(path) }.to_str() {
+        Ok(dir) if !dir.is_empty() => {
+            cache::set_dir(Some(std::path::PathBuf::from(dir)));
+            0
+        }
+        _ => 1,
+    }
+}
+
+#[no_mangle]
+pub extern "C" fn org_prune_cache() -> usize {
+    cache::prune()
+}
+
+/// Flat node array handed to C; see org_ast_build().
+#[repr(C)]
+pub struct OrgAst {
+    nodes: *mut ast::OrgNode,
+    count: usize,
+}
+
+impl OrgAst {
+    fn empty() -> Self {
+        OrgAst {
+            nodes: ptr::null_mut(),
+            count: 0,
+        }
+    }
+}
+
+fn flatten_into(org: &Org, out: &mut OrgAst) -> i32 {
+    let Some(nodes) = ast::flatten(org) else {
+        *out = OrgAst::empty();
+        return 1;
+    };
+    stats::add_output(nodes.len() * std::mem::size_of::<ast::OrgNode>(), 1);
 
-    let toc_html = format!("<nav class=\"toc\"><ul>{}</ul></nav>", toc);
+    let nodes = nodes.into_boxed_slice();
+    *out = OrgAst {
+        count: nodes.len(),
+        nodes: Box::into_raw(nodes) as *mut ast::OrgNode,
+    };
+    0
+}
+
+#[no_mangle]
+pub extern "C" fn org_ast_build(input: *const c_char, len: usize, out: *mut OrgAst) -> i32 {
+    if out.is_null() {
+        return 1;
+    }
+
+    let org_str = match input_to_str(input, len) {
+        Some(value) => value,
+        None => {
+            unsafe { *out = OrgAst::empty() };
+            return 1;
+        }
+    };
+
+    let org = parse_org_with_config(org_str);
+    unsafe { flatten_into(&org, &mut *out) }
+}
+
+#[no_mangle]
+pub extern "C" fn org_document_ast(doc: *const OrgDocument, out: *mut OrgAst) -> i32 {
+    if out.is_null() {
+        return 1;
+    }
+    if doc.is_null() {
+        unsafe { *out = OrgAst::empty() };
+        return 1;
+    }
+    unsafe { flatten_into(&(*doc).org, &mut *out) }
+}
+
+#[no_mangle]
+pub extern "C" fn org_free_ast(ast: *mut OrgAst) {
+    if ast.is_null() {
+        return;
+    }
+    unsafe {
+        let ast = &mut *ast;
+        if !ast.nodes.is_null() {
+            drop(Box::from_raw(ptr::slice_from_raw_parts_mut(ast.nodes, ast.count)));
+        }
+        *ast = OrgAst::empty();
+    }
+}
+
+/// `ORG_TEXT_SKIP_SOURCE` in org-ffi.h.
+const TEXT_SKIP_SOURCE: u32 = 1;
+
+#[no_mangle]
+pub extern "C" fn org_extract_text(input: *const c_char, len: usize, flags: u32, out: *mut OrgText) -> i32 {
+    if out.is_null() {
+        return 1;
+    }
+
+    let org_str = match input_to_str(input, len) {
+        Some(value) => value,
+        None => {
+            unsafe { *out = OrgText::empty() };
+            return 1;
+        }
+    };
+
+    let org = parse_org_with_config(org_str);
+    let text = extract_text(&org, &mut SlugTable::default(), flags & TEXT_SKIP_SOURCE != 0);
+    unsafe { text.into_raw(&mut *out) }
+}
+
+#[no_mangle]
+pub extern "C" fn org_document_text(doc: *const OrgDocument, flags: u32, out: *mut OrgText) -> i32 {
+    if out.is_null() {
+        return 1;
+    }
+    if doc.is_null() {
+        unsafe { *out = OrgText::empty() };
+        return 1;
+    }
+    unsafe {
+        let text = extract_text(&(*doc).org, &mut (*doc).slugs.borrow_mut(), flags & TEXT_SKIP_SOURCE != 0);
+        text.into_raw(&mut *out)
+    }
+}
+
+#[no_mangle]
+pub extern "C" fn org_free_text(text: *mut OrgText) {
+    if text.is_null() {
+        return;
+    }
+    unsafe {
+        let text = &mut *text;
+        if !text.text.is_null() {
+            drop(CString::from_raw(text.text));
+        }
+        if !text.headings.is_null() {
+            let headings = Box::from_raw(ptr::slice_from_raw_parts_mut(text.headings, text.heading_count));
+            for heading in headings.iter() {
+                if !heading.id.is_null() {
+                    drop(CString::from_raw(heading.id));
+                }
+            }
+        }
+        *text = OrgText::empty();
+    }
+}
+
+#[no_mangle]
+pub extern "C" fn org_node_kind_name(kind: i32) -> *const c_char {
+    ast::kind_name(kind).map_or(ptr::null(), |name| name.as_ptr() as *const c_char)
+}
+
+#[no_mangle]
+pub extern "C" fn org_get_stats(out: *mut stats::OrgStats) {
+    if let Some(out) = unsafe { out.as_mut() } {
+        *out = stats::snapshot();
+    }
+}
+
+#[no_mangle]
+pub extern "C" fn org_reset_stats() {
+    stats::reset();
+}
+
+#[no_mangle]
+pub extern "C" fn org_escape_html(input: *const c_char, len: usize, write: Option<OrgWriteFn>, userdata: *mut c_void) -> i32 {
+    let Some(sink) = HtmlSink::new(write, userdata) else {
+        return 1;
+    };
+    if len == 0 {
+        return 0;
+    }
+    if input.is_null() {
+        return 1;
+    }
+
+    // Bytes rather than text, so nothing gets through unescaped for not
+    // being UTF-8.
+    let bytes = unsafe { std::slice::from_raw_parts(input as *const u8, len) };
+    let written = escape::escape_byte_spans(bytes, |span| if sink.write_bytes(span) { Ok(()) } else { Err(()) });
+    if written.is_ok() { 0 } else { 1 }
+}
+
+#[no_mangle]
+pub extern "C" fn org_document_process_to(
+    doc: *const OrgDocument,
+    write: Option<OrgWriteFn>,
+    userdata: *mut c_void,
+    out: *mut OrgResult,
+) -> i32 {
+    if out.is_null() {
+        return 1;
+    }
+    let sink = HtmlSink::new(write, userdata);
+    if doc.is_null() || sink.is_none() {
+        unsafe { *out = OrgResult::empty() };
+        return 1;
+    }
+    unsafe {
+        let doc = &*doc;
+        process_into(&doc.org, sink, &mut doc.slugs.borrow_mut(), doc.image_dir.as_deref(), &mut *out)
+    }
+}
 
-    match CString::new(toc_html) {
-        Ok(c_string) => c_string.into_raw(),
-        Err(_) => ptr::null_mut(),
+/// Internals timed by `benches/exporter.rs`, which only sees the public
+/// API. Not part of the C interface.
+#[doc(hidden)]
+pub mod bench {
+    /// Runs the autolinker over `text` as paragraph text, returning the
+    /// length of the HTML it wrote.
+    pub fn autolink(text: &str) -> usize {
+        let mut export = super::HtmlExportWithUrls::new(text.len(), None);
+        export.process_text_with_urls(text);
+        export.output.len()
     }
 }
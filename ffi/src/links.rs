@@ -0,0 +1,60 @@
+//! Links between posts.
+//!
+//! Every post is exported to an `.html` file next to where its `.org`
+//! source sits, so a link to another post's source is pointed at that
+//! page instead. An Org search option after `::` becomes a fragment:
+//! `*Title` and plain text resolve to the id of the first headline with
+//! that title, `#id` to the headline whose `CUSTOM_ID` it is.
+
+use std::borrow::Cow;
+
+use crate::slug;
+
+/// The `href` for a link path: `file:` dropped, `.org` targets and
+/// headline searches rewritten, anything else unchanged.
+pub fn href(path: &str) -> Cow<'_, str> {
+    let path = path.strip_prefix("file:").unwrap_or(path);
+
+    // `[[*Title]]` searches the current document.
+    if let Some(title) = path.strip_prefix('*') {
+        return Cow::Owned(format!("#{}", slug::slugify(title)));
+    }
+
+    let (file, search) = match path.split_once("::") {
+        Some((file, search)) => (file, Some(search)),
+        None => (path, None),
+    };
+    let Some(stem) = org_stem(file) else {
+        return Cow::Borrowed(path);
+    };
+
+    let mut href = String::with_capacity(path.len() + 8);
+    href.push_str(stem);
+    href.push_str(".html");
+    if let Some(fragment) = search.and_then(fragment) {
+        href.push('#');
+        href.push_str(&fragment);
+    }
+    Cow::Owned(href)
+}
+
+/// `file` without its `.org` extension, if it names a local Org file.
+fn org_stem(file: &str) -> Option<&str> {
+    if file.contains("://") {
+        return None;
+    }
+    let split = file.len().checked_sub(4)?;
+    let (stem, ext) = (file.get(..split)?, file.get(split..)?);
+    (!stem.is_empty() && ext.eq_ignore_ascii_case(".org")).then_some(stem)
+}
+
+fn fragment(search: &str) -> Option<String> {
+    let search = search.trim();
+    if search.is_empty() {
+        None
+    } else if let Some(id) = search.strip_prefix('#') {
+        Some(id.to_string())
+    } else {
+        Some(slug::slugify(search.strip_prefix('*').unwrap_or(search)))
+    }
+}
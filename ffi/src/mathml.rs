@@ -0,0 +1,550 @@
+//! Build-time LaTeX to MathML conversion for math fragments.
+//!
+//! Covers the TeX that shows up in posts: identifiers, numbers, operators,
+//! Greek letters and common symbols, `\frac`, `\sqrt`, sub- and superscripts,
+//! accents, `\text`-style font commands, `\left`/`\right` fences, matrices
+//! and `align`-style environments. Anything else makes `render` return
+//! `None`, and the caller falls back to emitting the raw LaTeX as before.
+
+use crate::escape::escape_into;
+
+/// Bump when the output format changes so cached fragments are rebuilt.
+pub const VERSION: &str = "1";
+
+/// Converts a complete fragment or environment, delimiters included.
+pub fn render(latex: &str) -> Option<String> {
+    let latex = latex.trim();
+    let (body, display) = strip_delimiters(latex)?;
+
+    let mut parser = Parser { src: body.0, pos: 0 };
+    let content = match body.1 {
+        Layout::Row => {
+            let (items, end) = parser.row()?;
+            if end != End::Eof {
+                return None;
+            }
+            join_row(&items)
+        }
+        Layout::Table => parser.table(End::Eof)?,
+    };
+
+    let mut out = String::with_capacity(content.len() + latex.len() + 128);
+    out.push_str(if display {
+        r#"<math display="block"><semantics><mrow>"#
+    } else {
+        r#"<math display="inline"><semantics><mrow>"#
+    });
+    out.push_str(&content);
+    out.push_str(r#"</mrow><annotation encoding="application/x-tex">"#);
+    escape_into(&mut out, latex);
+    out.push_str("</annotation></semantics></math>");
+    Some(out)
+}
+
+enum Layout {
+    Row,
+    Table,
+}
+
+/// Returns the TeX between the delimiters, how to lay it out, and whether
+/// it is display math.
+fn strip_delimiters(latex: &str) -> Option<((&str, Layout), bool)> {
+    let pairs = [("\\[", "\\]", true), ("$$", "$$", true), ("\\(", "\\)", false), ("$", "$", false)];
+    for (open, close, display) in pairs {
+        if latex.len() >= open.len() + close.len() && latex.starts_with(open) && latex.ends_with(close) {
+            return Some(((&latex[open.len()..latex.len() - close.len()], Layout::Row), display));
+        }
+    }
+
+    let rest = latex.strip_prefix("\\begin{")?;
+    let name_end = rest.find('}')?;
+    let name = &rest[..name_end];
+    let end_tag = format!("\\end{{{}}}", name);
+    let body = rest[name_end + 1..].strip_suffix(end_tag.as_str())?;
+    let layout = match name.trim_end_matches('*') {
+        "equation" | "displaymath" | "math" => Layout::Row,
+        "align" | "aligned" | "gather" | "eqnarray" => Layout::Table,
+        _ => return None,
+    };
+    Some(((body, layout), true))
+}
+
+#[derive(PartialEq, Debug)]
+enum End {
+    Eof,
+    Brace,
+    Amp,
+    Newline,
+    Env(String),
+}
+
+/// One element of a row, kept apart from its scripts until the row ends so
+/// `x_i^2` becomes a single `msubsup`.
+struct Item {
+    base: String,
+    sub: Option<String>,
+    sup: Option<String>,
+    /// Big operators whose limits go under and over in display math.
+    limits: bool,
+}
+
+impl Item {
+    fn new(base: String) -> Self {
+        Item { base, sub: None, sup: None, limits: false }
+    }
+
+    fn render(&self, out: &mut String) {
+        let tags = if self.limits {
+            ["munder", "mover", "munderover"]
+        } else {
+            ["msub", "msup", "msubsup"]
+        };
+        match (&self.sub, &self.sup) {
+            (None, None) => out.push_str(&self.base),
+            (Some(sub), None) => wrap(out, tags[0], &[&self.base, sub]),
+            (None, Some(sup)) => wrap(out, tags[1], &[&self.base, sup]),
+            (Some(sub), Some(sup)) => wrap(out, tags[2], &[&self.base, sub, sup]),
+        }
+    }
+}
+
+fn wrap(out: &mut String, tag: &str, children: &[&str]) {
+    out.push('<');
+    out.push_str(tag);
+    out.push('>');
+    for child in children {
+        out.push_str(child);
+    }
+    out.push_str("</");
+    out.push_str(tag);
+    out.push('>');
+}
+
+fn join_row(items: &[Item]) -> String {
+    let mut out = String::new();
+    for item in items {
+        item.render(&mut out);
+    }
+    out
+}
+
+/// Wraps several items in an `mrow` so they act as one script or argument.
+fn group(items: &[Item]) -> String {
+    if items.len() == 1 {
+        return join_row(items);
+    }
+    format!("<mrow>{}</mrow>", join_row(items))
+}
+
+fn token(tag: &str, text: &str) -> String {
+    let mut out = String::with_capacity(text.len() + 2 * tag.len() + 5);
+    out.push('<');
+    out.push_str(tag);
+    out.push('>');
+    escape_into(&mut out, text);
+    out.push_str("</");
+    out.push_str(tag);
+    out.push('>');
+    out
+}
+
+fn symbol(name: &str) -> Option<(&'static str, &'static str)> {
+    let (tag, text) = match name {
+        "alpha" => ("mi", "α"), "beta" => ("mi", "β"), "gamma" => ("mi", "γ"),
+        "delta" => ("mi", "δ"), "epsilon" => ("mi", "ϵ"), "varepsilon" => ("mi", "ε"),
+        "zeta" => ("mi", "ζ"), "eta" => ("mi", "η"), "theta" => ("mi", "θ"),
+        "vartheta" => ("mi", "ϑ"), "iota" => ("mi", "ι"), "kappa" => ("mi", "κ"),
+        "lambda" => ("mi", "λ"), "mu" => ("mi", "μ"), "nu" => ("mi", "ν"), "xi" => ("mi", "ξ"),
+        "pi" => ("mi", "π"), "rho" => ("mi", "ρ"), "sigma" => ("mi", "σ"), "tau" => ("mi", "τ"),
+        "upsilon" => ("mi", "υ"), "phi" => ("mi", "ϕ"), "varphi" => ("mi", "φ"),
+        "chi" => ("mi", "χ"), "psi" => ("mi", "ψ"), "omega" => ("mi", "ω"),
+        "Gamma" => ("mi", "Γ"), "Delta" => ("mi", "Δ"), "Theta" => ("mi", "Θ"),
+        "Lambda" => ("mi", "Λ"), "Xi" => ("mi", "Ξ"), "Pi" => ("mi", "Π"), "Sigma" => ("mi", "Σ"),
+        "Phi" => ("mi", "Φ"), "Psi" => ("mi", "Ψ"), "Omega" => ("mi", "Ω"),
+        "infty" => ("mi", "∞"), "ell" => ("mi", "ℓ"), "hbar" => ("mi", "ℏ"),
+        "partial" => ("mo", "∂"), "nabla" => ("mo", "∇"),
+        "le" | "leq" => ("mo", "≤"), "ge" | "geq" => ("mo", "≥"), "ne" | "neq" => ("mo", "≠"),
+        "approx" => ("mo", "≈"), "equiv" => ("mo", "≡"), "sim" => ("mo", "∼"),
+        "simeq" => ("mo", "≃"), "propto" => ("mo", "∝"), "ll" => ("mo", "≪"), "gg" => ("mo", "≫"),
+        "cdot" => ("mo", "⋅"), "times" => ("mo", "×"), "div" => ("mo", "÷"), "pm" => ("mo", "±"),
+        "mp" => ("mo", "∓"), "ast" => ("mo", "∗"), "circ" => ("mo", "∘"),
+        "to" | "rightarrow" => ("mo", "→"), "leftarrow" | "gets" => ("mo", "←"),
+        "Rightarrow" | "implies" => ("mo", "⇒"), "Leftarrow" => ("mo", "⇐"),
+        "Leftrightarrow" | "iff" => ("mo", "⇔"), "leftrightarrow" => ("mo", "↔"),
+        "mapsto" => ("mo", "↦"),
+        "in" => ("mo", "∈"), "notin" => ("mo", "∉"), "ni" => ("mo", "∋"),
+        "subset" => ("mo", "⊂"), "subseteq" => ("mo", "⊆"), "supset" => ("mo", "⊃"),
+        "supseteq" => ("mo", "⊇"), "cup" => ("mo", "∪"), "cap" => ("mo", "∩"),
+        "emptyset" | "varnothing" => ("mi", "∅"), "setminus" => ("mo", "∖"),
+        "forall" => ("mo", "∀"), "exists" => ("mo", "∃"), "neg" | "lnot" => ("mo", "¬"),
+        "land" | "wedge" => ("mo", "∧"), "lor" | "vee" => ("mo", "∨"),
+        "oplus" => ("mo", "⊕"), "otimes" => ("mo", "⊗"),
+        "ldots" | "dots" => ("mo", "…"), "cdots" => ("mo", "⋯"), "vdots" => ("mo", "⋮"),
+        "ddots" => ("mo", "⋱"), "prime" => ("mo", "′"),
+        "langle" => ("mo", "⟨"), "rangle" => ("mo", "⟩"), "lfloor" => ("mo", "⌊"),
+        "rfloor" => ("mo", "⌋"), "lceil" => ("mo", "⌈"), "rceil" => ("mo", "⌉"),
+        "mid" => ("mo", "∣"), "parallel" => ("mo", "∥"), "perp" => ("mo", "⊥"),
+        "angle" => ("mo", "∠"), "triangle" => ("mi", "△"),
+        _ => return None,
+    };
+    Some((tag, text))
+}
+
+fn big_operator(name: &str) -> Option<&'static str> {
+    Some(match name {
+        "sum" => "∑",
+        "prod" => "∏",
+        "coprod" => "∐",
+        "int" => "∫",
+        "iint" => "∬",
+        "iiint" => "∭",
+        "oint" => "∮",
+        "bigcup" => "⋃",
+        "bigcap" => "⋂",
+        _ => return None,
+    })
+}
+
+fn is_function(name: &str) -> bool {
+    matches!(
+        name,
+        "sin" | "cos" | "tan" | "cot" | "sec" | "csc" | "arcsin" | "arccos" | "arctan"
+            | "sinh" | "cosh" | "tanh" | "log" | "ln" | "lg" | "exp" | "lim" | "liminf"
+            | "limsup" | "max" | "min" | "sup" | "inf" | "det" | "dim" | "ker" | "deg"
+            | "gcd" | "arg" | "Pr" | "mod"
+    )
+}
+
+fn accent(name: &str) -> Option<&'static str> {
+    Some(match name {
+        "hat" | "widehat" => "^",
+        "bar" | "overline" => "¯",
+        "vec" => "→",
+        "dot" => "˙",
+        "ddot" => "¨",
+        "tilde" | "widetilde" => "~",
+        _ => return None,
+    })
+}
+
+fn font_variant(name: &str) -> Option<&'static str> {
+    Some(match name {
+        "mathrm" | "rm" | "operatorname" => "normal",
+        "mathbf" | "bf" | "boldsymbol" => "bold",
+        "mathit" => "italic",
+        "mathbb" => "double-struck",
+        "mathcal" => "script",
+        "mathfrak" => "fraktur",
+        "mathsf" => "sans-serif",
+        "mathtt" => "monospace",
+        _ => return None,
+    })
+}
+
+struct Parser<'a> {
+    src: &'a str,
+    pos: usize,
+}
+
+impl Parser<'_> {
+    fn peek(&self) -> Option<char> {
+        self.src[self.pos..].chars().next()
+    }
+
+    fn skip_spaces(&mut self) {
+        while let Some(c) = self.peek() {
+            if !c.is_whitespace() {
+                break;
+            }
+            self.pos += c.len_utf8();
+        }
+    }
+
+    fn command_name(&mut self) -> &str {
+        let start = self.pos;
+        let bytes = self.src.as_bytes();
+        while self.pos < bytes.len() && bytes[self.pos].is_ascii_alphabetic() {
+            self.pos += 1;
+        }
+        if self.pos == start && self.pos < bytes.len() && bytes[self.pos].is_ascii() {
+            // Single-symbol command such as \{ or \,
+            self.pos += 1;
+        }
+        &self.src[start..self.pos]
+    }
+
+    /// Raw text of a `{...}` argument with balanced braces.
+    fn raw_group(&mut self) -> Option<&str> {
+        self.skip_spaces();
+        if self.peek() != Some('{') {
+            return None;
+        }
+        let start = self.pos + 1;
+        let mut depth = 0usize;
+        for (i, b) in self.src.as_bytes()[self.pos..].iter().enumerate() {
+            match b {
+                b'{' => depth += 1,
+                b'}' => {
+                    depth -= 1;
+                    if depth == 0 {
+                        let end = self.pos + i;
+                        self.pos = end + 1;
+                        return Some(&self.src[start..end]);
+                    }
+                }
+                _ => {}
+            }
+        }
+        None
+    }
+
+    /// One argument: a braced group or a single atom.
+    fn argument(&mut self) -> Option<String> {
+        self.skip_spaces();
+        if self.peek() == Some('{') {
+            self.pos += 1;
+            let (items, end) = self.row()?;
+            return (end == End::Brace).then(|| group(&items));
+        }
+        let item = self.atom()?.ok()?;
+        let mut out = String::new();
+        item.render(&mut out);
+        Some(out)
+    }
+
+    /// Parses items until something ends the row.
+    fn row(&mut self) -> Option<(Vec<Item>, End)> {
+        let mut items: Vec<Item> = Vec::new();
+        loop {
+            self.skip_spaces();
+            let Some(c) = self.peek() else {
+                return Some((items, End::Eof));
+            };
+
+            if c == '^' || c == '_' {
+                self.pos += 1;
+                let script = self.argument()?;
+                if items.is_empty() {
+                    items.push(Item::new("<mrow></mrow>".to_string()));
+                }
+                let last = items.last_mut()?;
+                let slot = if c == '^' { &mut last.sup } else { &mut last.sub };
+                if slot.is_some() {
+                    return None;
+                }
+                *slot = Some(script);
+                continue;
+            }
+
+            match self.atom()? {
+                Ok(item) => items.push(item),
+                Err(end) => return Some((items, end)),
+            }
+        }
+    }
+
+    /// `Ok` with the next item, or `Err` with what ended the row.
+    fn atom(&mut self) -> Option<Result<Item, End>> {
+        self.skip_spaces();
+        let c = self.peek()?;
+        self.pos += c.len_utf8();
+
+        let item = match c {
+            '{' => {
+                let (items, end) = self.row()?;
+                if end != End::Brace {
+                    return None;
+                }
+                Item::new(format!("<mrow>{}</mrow>", join_row(&items)))
+            }
+            '}' => return Some(Err(End::Brace)),
+            '&' => return Some(Err(End::Amp)),
+            '\\' => return self.command(),
+            '0'..='9' | '.' if c != '.' || self.peek().is_some_and(|n| n.is_ascii_digit()) => {
+                let start = self.pos - 1;
+                while let Some(n) = self.peek() {
+                    if !(n.is_ascii_digit() || n == '.') {
+                        break;
+                    }
+                    self.pos += 1;
+                }
+                Item::new(token("mn", &self.src[start..self.pos]))
+            }
+            '-' => Item::new(token("mo", "−")),
+            '\'' => Item::new(token("mo", "′")),
+            '~' => Item::new("<mtext>\u{a0}</mtext>".to_string()),
+            '+' | '=' | '<' | '>' | '*' | '/' | ',' | ';' | ':' | '!' | '?' | '(' | ')' | '[' | ']'
+            | '|' | '.' => {
+                let mut buf = [0u8; 4];
+                Item::new(token("mo", c.encode_utf8(&mut buf)))
+            }
+            '$' | '#' | '%' => return None,
+            c if c.is_alphabetic() => {
+                let mut buf = [0u8; 4];
+                Item::new(token("mi", c.encode_utf8(&mut buf)))
+            }
+            _ => return None,
+        };
+        Some(Ok(item))
+    }
+
+    fn command(&mut self) -> Option<Result<Item, End>> {
+        let name = self.command_name().to_string();
+
+        if let Some((tag, text)) = symbol(&name) {
+            return Some(Ok(Item::new(token(tag, text))));
+        }
+        if let Some(op) = big_operator(&name) {
+            let mut item = Item::new(token("mo", op));
+            item.limits = !name.contains("int");
+            return Some(Ok(item));
+        }
+        if is_function(&name) {
+            let mut item = Item::new(token("mi", &name));
+            item.limits = matches!(name.as_str(), "lim" | "liminf" | "limsup" | "max" | "min" | "sup" | "inf");
+            return Some(Ok(item));
+        }
+        if let Some(mark) = accent(&name) {
+            let arg = self.argument()?;
+            return Some(Ok(Item::new(format!(
+                r#"<mover accent="true">{}{}</mover>"#,
+                arg,
+                token("mo", mark)
+            ))));
+        }
+        if let Some(variant) = font_variant(&name) {
+            let arg = self.argument()?;
+            return Some(Ok(Item::new(format!(r#"<mstyle mathvariant="{}">{}</mstyle>"#, variant, arg))));
+        }
+
+        let item = match name.as_str() {
+            "\\" => return Some(Err(End::Newline)),
+            "frac" | "dfrac" | "tfrac" => {
+                let num = self.argument()?;
+                let den = self.argument()?;
+                Item::new(format!("<mfrac>{}{}</mfrac>", num, den))
+            }
+            "sqrt" => {
+                self.skip_spaces();
+                if self.peek() == Some('[') {
+                    let close = self.src[self.pos..].find(']')? + self.pos;
+                    let index_src = &self.src[self.pos + 1..close];
+                    let mut index = Parser { src: index_src, pos: 0 };
+                    let (items, end) = index.row()?;
+                    if end != End::Eof {
+                        return None;
+                    }
+                    self.pos = close + 1;
+                    let radicand = self.argument()?;
+                    Item::new(format!("<mroot>{}{}</mroot>", radicand, group(&items)))
+                } else {
+                    Item::new(format!("<msqrt>{}</msqrt>", self.argument()?))
+                }
+            }
+            "text" | "textrm" | "textit" | "textbf" | "mbox" => {
+                let text = self.raw_group()?;
+                Item::new(token("mtext", text))
+            }
+            "left" | "right" | "big" | "Big" | "bigg" | "Bigg" | "bigl" | "bigr" | "Bigl" | "Bigr" => {
+                self.skip_spaces();
+                let fence = match self.peek()? {
+                    '.' => {
+                        self.pos += 1;
+                        String::new()
+                    }
+                    '\\' => {
+                        self.pos += 1;
+                        match self.command_name() {
+                            "{" => "{".to_string(),
+                            "}" => "}".to_string(),
+                            "|" => "‖".to_string(),
+                            other => symbol(other)?.1.to_string(),
+                        }
+                    }
+                    c => {
+                        self.pos += c.len_utf8();
+                        c.to_string()
+                    }
+                };
+                if fence.is_empty() {
+                    Item::new("<mrow></mrow>".to_string())
+                } else {
+                    Item::new(token("mo", &fence))
+                }
+            }
+            "{" => Item::new(token("mo", "{")),
+            "}" => Item::new(token("mo", "}")),
+            "|" => Item::new(token("mo", "‖")),
+            "%" | "$" | "#" | "&" | "_" => Item::new(token("mo", &name)),
+            "," => Item::new(r#"<mspace width="0.167em"></mspace>"#.to_string()),
+            ":" | ">" => Item::new(r#"<mspace width="0.222em"></mspace>"#.to_string()),
+            ";" => Item::new(r#"<mspace width="0.278em"></mspace>"#.to_string()),
+            " " => Item::new(r#"<mspace width="0.333em"></mspace>"#.to_string()),
+            "quad" => Item::new(r#"<mspace width="1em"></mspace>"#.to_string()),
+            "qquad" => Item::new(r#"<mspace width="2em"></mspace>"#.to_string()),
+            "!" => Item::new(String::new()),
+            "label" | "tag" => {
+                self.raw_group()?;
+                Item::new(String::new())
+            }
+            "nonumber" | "notag" | "displaystyle" | "textstyle" => Item::new(String::new()),
+            "begin" => {
+                let env = self.raw_group()?.to_string();
+                let (open, close) = match env.as_str() {
+                    "matrix" | "smallmatrix" | "aligned" => ("", ""),
+                    "pmatrix" => ("(", ")"),
+                    "bmatrix" => ("[", "]"),
+                    "Bmatrix" => ("{", "}"),
+                    "vmatrix" => ("|", "|"),
+                    "Vmatrix" => ("‖", "‖"),
+                    "cases" => ("{", ""),
+                    _ => return None,
+                };
+                let table = self.table(End::Env(env))?;
+                let mut out = String::from("<mrow>");
+                if !open.is_empty() {
+                    out.push_str(&token("mo", open));
+                }
+                out.push_str(&table);
+                if !close.is_empty() {
+                    out.push_str(&token("mo", close));
+                }
+                out.push_str("</mrow>");
+                Item::new(out)
+            }
+            "end" => return Some(Err(End::Env(self.raw_group()?.to_string()))),
+            _ => return None,
+        };
+        Some(Ok(item))
+    }
+
+    /// Rows separated by `\\` and cells by `&`, up to `until`.
+    fn table(&mut self, until: End) -> Option<String> {
+        let mut out = String::from("<mtable>");
+        let mut row = String::new();
+        let mut has_cells = false;
+        loop {
+            let (items, end) = self.row()?;
+            row.push_str("<mtd>");
+            row.push_str(&join_row(&items));
+            row.push_str("</mtd>");
+            has_cells |= !items.is_empty();
+            match end {
+                End::Amp => continue,
+                End::Newline => {
+                    wrap(&mut out, "mtr", &[&row]);
+                    row.clear();
+                }
+                end if end == until => {
+                    if has_cells {
+                        wrap(&mut out, "mtr", &[&row]);
+                    }
+                    out.push_str("</mtable>");
+                    return Some(out);
+                }
+                _ => return None,
+            }
+            has_cells = false;
+        }
+    }
+}
@@ -0,0 +1,68 @@
+//! Process-wide export switches, set from C through `org_set_option()`.
+//!
+//! Exporters read the switches once when they are created, so a document is
+//! always rendered with one consistent set even if another thread flips them.
+
+use std::sync::atomic::{AtomicBool, Ordering};
+
+/// Build-time syntax highlighting of source blocks.
+pub const HIGHLIGHT: i32 = 0;
+/// Convert LaTeX fragments to MathML at build time.
+pub const MATHML: i32 = 1;
+/// Split traversal time into HTML, TOC and metadata in `org_get_stats()`.
+pub const STAGE_TIMING: i32 = 2;
+
+/// Space CJK and Latin text apart, as pangu.js does in the browser.
+pub const CJK_SPACING: i32 = 3;
+
+/// Wrap `<h2>` to `<h4>` in sticky wrappers with a `#` self-link.
+pub const HEADING_ANCHORS: i32 = 4;
+
+/// Give source blocks a `data-lang` label and copy/expand buttons.
+pub const CODE_DECORATIONS: i32 = 5;
+
+/// Also fill `OrgResult.text` with the plain text of the document.
+pub const RESULT_TEXT: i32 = 6;
+
+/// Give images their pixel size and lazy loading.
+pub const IMAGE_HINTS: i32 = 7;
+
+/// Let `org_process_document()` export a large document on a thread per
+/// CPU; without it only `org_process_batch()` spends threads.
+pub const SECTION_THREADS: i32 = 8;
+
+const OPTION_COUNT: usize = 9;
+
+#[allow(clippy::declare_interior_mutable_const)]
+const OFF: AtomicBool = AtomicBool::new(false);
+static FLAGS: [AtomicBool; OPTION_COUNT] = [OFF; OPTION_COUNT];
+
+/// Returns false for an unknown option.
+pub fn set(option: i32, value: bool) -> bool {
+    match usize::try_from(option).ok().and_then(|i| FLAGS.get(i)) {
+        Some(flag) => {
+            flag.store(value, Ordering::Relaxed);
+            true
+        }
+        None => false,
+    }
+}
+
+pub fn enabled(option: i32) -> bool {
+    usize::try_from(option)
+        .ok()
+        .and_then(|i| FLAGS.get(i))
+        .is_some_and(|flag| flag.load(Ordering::Relaxed))
+}
+
+/// Switches that change the exported output.
+const OUTPUT_OPTIONS: &[i32] = &[HIGHLIGHT, MATHML, CJK_SPACING, HEADING_ANCHORS, CODE_DECORATIONS, RESULT_TEXT, IMAGE_HINTS];
+
+/// The output-affecting switches as bits, for cache keys.
+pub fn output_bits() -> u32 {
+    OUTPUT_OPTIONS
+        .iter()
+        .enumerate()
+        .filter(|&(_, &option)| enabled(option))
+        .fold(0, |bits, (i, _)| bits | 1 << i)
+}
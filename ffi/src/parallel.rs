@@ -0,0 +1,410 @@
+//! Section-wise export of large documents.
+//!
+//! A parse tree cannot leave the thread that built it, so the text itself
+//! is split at top-level headlines and each section is parsed and exported
+//! on its own, on as many threads as it is worth. A top-level headline
+//! closes everything opened before it, so every section parses exactly as
+//! it does in the whole document. The one thing that depends on earlier
+//! sections is the `-2`, `-3` suffix of repeated headline ids, which must
+//! also avoid the slug of any later headline: each worker parses its whole
+//! batch and sends all of its headline titles to the calling thread in one
+//! message; once every batch has reported, that thread assigns ids in
+//! document order, and the batches are then exported concurrently. With a cache directory set,
+//! sections rendered by an earlier build are reused (see `sections`). The
+//! joined output is byte-identical to a sequential export.
+
+use std::ops::Range;
+use std::path::Path;
+use std::sync::mpsc;
+
+use orgize::Org;
+
+use crate::sections::{self, Fragment};
+use crate::slug::{self, SlugTable};
+use crate::stats::{self, Stage};
+use crate::{
+    body_c_string, extract_text, options, parse_config, source_len, toc_c_string, DocumentExport,
+    ExportedDocument, ExtractedText, MetadataCollector, MAIN_CLOSE, MAIN_OPEN,
+};
+
+/// Smaller documents are exported on the calling thread.
+const MIN_PARALLEL_BYTES: usize = 256 * 1024;
+
+/// Smaller documents are cheap enough to re-export whole.
+const MIN_MEMO_BYTES: usize = 64 * 1024;
+
+/// Each worker gets at least this much text.
+const MIN_PIECE_BYTES: usize = 64 * 1024;
+
+/// Exports `text` section by section on at most `threads` worker threads,
+/// or on the calling thread alone when given fewer than two. Returns `None` when the document is too small or
+/// cannot be split safely; the caller then exports it whole.
+pub fn export(text: &str, threads: usize, image_dir: Option<&Path>) -> Option<ExportedDocument> {
+    let memo = text.len() >= MIN_MEMO_BYTES && sections::enabled();
+    let settings = Settings { memo, image_dir };
+    if !memo && (text.len() < MIN_PARALLEL_BYTES || threads < 2) {
+        return None;
+    }
+    let units = split(text, &split_points(text)?);
+    if units.len() < 2 {
+        return None;
+    }
+
+    let exported = if threads < 2 {
+        export_units_inline(&units, settings)?
+    } else {
+        export_units(&units, threads, settings)?
+    };
+    if exported[..exported.len() - 1].iter().any(|unit| unit.dangling_attributes) {
+        return None;
+    }
+    stats::add_document(text.len());
+
+    let mut html: Vec<&str> = Vec::with_capacity(exported.len() + 2);
+    html.push(MAIN_OPEN);
+    html.extend(exported.iter().map(|unit| unit.html.as_str()));
+    html.push(MAIN_CLOSE);
+    let toc: Vec<&str> = exported.iter().map(|unit| unit.toc.as_str()).collect();
+    let html = body_c_string(&html)?;
+    let toc = toc_c_string(&toc)?;
+
+    let mut meta = MetadataCollector::new();
+    let mut text = options::enabled(options::RESULT_TEXT).then(|| ExtractedText {
+        text: String::with_capacity(text.len() / 2),
+        headings: Vec::new(),
+    });
+    for unit in exported {
+        meta.merge(unit.meta);
+        if let (Some(text), Some(unit)) = (&mut text, unit.text) {
+            text.append(unit);
+        }
+    }
+
+    Some(ExportedDocument { html: Some(html), toc, meta, text })
+}
+
+/// Byte offsets of the top-level headlines the text can be split at, or
+/// `None` if in-buffer settings could make a piece parse differently on
+/// its own.
+fn split_points(text: &str) -> Option<Vec<usize>> {
+    let mut points = Vec::new();
+    let mut block_depth = 0usize;
+    let mut offset = 0;
+
+    for line in text.split_inclusive('\n') {
+        let start = offset;
+        offset += line.len();
+
+        if let Some(directive) = line.trim_start().strip_prefix("#+") {
+            if starts_with_ignore_case(directive, "begin_") {
+                block_depth += 1;
+            } else if starts_with_ignore_case(directive, "end_") {
+                block_depth = block_depth.saturating_sub(1);
+            } else if ["todo:", "seq_todo:", "typ_todo:"]
+                .iter()
+                .any(|setting| starts_with_ignore_case(directive, setting))
+            {
+                return None;
+            }
+        } else if block_depth == 0 && start > 0 && line.starts_with("* ") {
+            points.push(start);
+        }
+    }
+
+    Some(points)
+}
+
+fn starts_with_ignore_case(text: &str, prefix: &str) -> bool {
+    text.len() >= prefix.len() && text.as_bytes()[..prefix.len()].eq_ignore_ascii_case(prefix.as_bytes())
+}
+
+/// Cuts `text` at `points`.
+fn split<'a>(text: &'a str, points: &[usize]) -> Vec<&'a str> {
+    let mut units = Vec::with_capacity(points.len() + 1);
+    let mut start = 0;
+    for &point in points {
+        units.push(&text[start..point]);
+        start = point;
+    }
+    units.push(&text[start..]);
+    units
+}
+
+/// Groups consecutive units into at most `threads` runs of similar size.
+fn batches(sizes: &[usize], threads: usize) -> Vec<Range<usize>> {
+    let total: usize = sizes.iter().sum();
+    let target = (total / threads.max(1)).max(MIN_PIECE_BYTES);
+    let mut batches = Vec::new();
+    let mut start = 0;
+    let mut bytes = 0;
+
+    for (i, &size) in sizes.iter().enumerate() {
+        bytes += size;
+        if bytes >= target && batches.len() + 1 < threads && i + 1 < sizes.len() {
+            batches.push(start..i + 1);
+            start = i + 1;
+            bytes = 0;
+        }
+    }
+    if start < sizes.len() {
+        batches.push(start..sizes.len());
+    }
+    batches
+}
+
+/// What every unit of one document is exported with.
+#[derive(Clone, Copy)]
+struct Settings<'a> {
+    /// Whether sections are looked up in and stored to the section memo.
+    memo: bool,
+    /// Directory the document's relative image paths resolve against.
+    image_dir: Option<&'a Path>,
+}
+
+/// A unit to export, with its headline ids once they are known.
+struct Job<'a> {
+    index: usize,
+    text: &'a str,
+    ids: Option<Vec<String>>,
+}
+
+/// The calling thread's end of a worker's id exchange: the titles of every
+/// unit in the worker's batch arrive in one message, and their ids go back
+/// in one.
+struct Exchange {
+    titles: mpsc::Receiver<Vec<Vec<String>>>,
+    ids: mpsc::Sender<Vec<Vec<String>>>,
+}
+
+/// The worker's end of an `Exchange`.
+type WorkerExchange = (mpsc::Sender<Vec<Vec<String>>>, mpsc::Receiver<Vec<Vec<String>>>);
+
+fn export_units(units: &[&str], threads: usize, settings: Settings) -> Option<Vec<Fragment>> {
+    let mut fragments: Vec<Option<Fragment>> = units.iter().map(|_| None).collect();
+    let titles: Vec<Option<Vec<String>>> = units
+        .iter()
+        .map(|unit| if settings.memo { sections::cached_titles(unit) } else { None })
+        .collect();
+
+    // Units whose titles are unknown are parsed first. A worker parses its
+    // whole batch before sending the titles, and the calling thread hands
+    // out ids only once every batch has reported, since a title anywhere in
+    // the document can keep an earlier repeat off its suffix. The batches
+    // are then exported side by side rather than one after another.
+    let jobs = units
+        .iter()
+        .enumerate()
+        .filter(|&(index, _)| titles[index].is_none())
+        .map(|(index, &text)| Job { index, text, ids: None })
+        .collect();
+
+    let mut known_ids: Vec<Option<Vec<String>>> = units.iter().map(|_| None).collect();
+    run(jobs, threads, settings, &mut fragments, |exchanges| {
+        // A worker that died sends nothing. Returning drops every
+        // exchange, so the remaining workers stop too, and the missing
+        // units make the whole export fall back.
+        let mut received = Vec::with_capacity(exchanges.len());
+        for exchange in &exchanges {
+            let Ok(batch_titles) = exchange.titles.recv() else { return };
+            received.push(batch_titles);
+        }
+
+        let mut slugs = SlugTable::default();
+        for unit_titles in titles.iter().flatten().chain(received.iter().flatten()) {
+            for title in unit_titles {
+                slugs.reserve(title);
+            }
+        }
+
+        let mut batches = exchanges.into_iter().zip(received);
+        let mut batch: Option<(std::vec::IntoIter<Vec<String>>, Vec<Vec<String>>, mpsc::Sender<_>)> = None;
+        for (index, unit_titles) in titles.into_iter().enumerate() {
+            if let Some(unit_titles) = unit_titles {
+                known_ids[index] = Some(unit_titles.iter().map(|title| slugs.unique(title)).collect());
+                continue;
+            }
+            if batch.is_none() {
+                let Some((exchange, batch_titles)) = batches.next() else { return };
+                batch = Some((batch_titles.into_iter(), Vec::new(), exchange.ids));
+            }
+            let Some((pending, ids, _)) = batch.as_mut() else { return };
+            let Some(unit_titles) = pending.next() else { return };
+            ids.push(unit_titles.iter().map(|title| slugs.unique(title)).collect());
+            if pending.len() == 0 {
+                if let Some((_, ids, ids_tx)) = batch.take() {
+                    let _ = ids_tx.send(ids);
+                }
+            }
+        }
+    });
+
+    // Units whose titles were cached are only rendered again if their
+    // text or ids changed.
+    let mut jobs = Vec::new();
+    for (index, ids) in known_ids.into_iter().enumerate() {
+        let Some(ids) = ids else { continue };
+        let key = sections::fragment_key(units[index], &ids, settings.image_dir);
+        match sections::cached_fragment(key, settings.image_dir) {
+            Some(fragment) => {
+                stats::add_sections(0, 1);
+                fragments[index] = Some(fragment);
+            }
+            None => jobs.push(Job { index, text: units[index], ids: Some(ids) }),
+        }
+    }
+    run(jobs, threads, settings, &mut fragments, |_| {});
+
+    fragments.into_iter().collect()
+}
+
+/// `export_units` for a caller with no threads to spare, used only with the
+/// section memo: each unit is parsed on the calling thread, and only when
+/// its titles or its fragment are not cached. All titles are gathered
+/// before the first id is assigned.
+fn export_units_inline(units: &[&str], settings: Settings) -> Option<Vec<Fragment>> {
+    let mut slugs = SlugTable::default();
+    let mut orgs: Vec<Option<Org>> = Vec::with_capacity(units.len());
+    let mut titles = Vec::with_capacity(units.len());
+
+    for &text in units {
+        let mut org = None;
+        let unit_titles = sections::cached_titles(text).unwrap_or_else(|| {
+            let parsed = stats::time(&[Stage::Parse], || parse_config().parse(text));
+            let titles = slug::titles(&parsed.document());
+            sections::store_titles(text, &titles);
+            org = Some(parsed);
+            titles
+        });
+        for title in &unit_titles {
+            slugs.reserve(title);
+        }
+        orgs.push(org);
+        titles.push(unit_titles);
+    }
+
+    let mut fragments = Vec::with_capacity(units.len());
+    for ((&text, unit_titles), parsed) in units.iter().zip(titles).zip(orgs) {
+        let ids: Vec<String> = unit_titles.iter().map(|title| slugs.unique(title)).collect();
+
+        let key = sections::fragment_key(text, &ids, settings.image_dir);
+        if let Some(fragment) = sections::cached_fragment(key, settings.image_dir) {
+            stats::add_sections(0, 1);
+            fragments.push(fragment);
+            continue;
+        }
+        let org = parsed.unwrap_or_else(|| stats::time(&[Stage::Parse], || parse_config().parse(text)));
+        fragments.push(export_unit(text, &org, ids, settings));
+    }
+    Some(fragments)
+}
+
+/// Runs `jobs` on worker threads, storing each result in `fragments`, while
+/// `coordinate` runs on the calling thread with the exchanges of the
+/// workers whose units still need ids.
+fn run<'a>(
+    jobs: Vec<Job<'a>>,
+    threads: usize,
+    settings: Settings,
+    fragments: &mut [Option<Fragment>],
+    coordinate: impl FnOnce(Vec<Exchange>),
+) {
+    if jobs.is_empty() {
+        coordinate(Vec::new());
+        return;
+    }
+    let sizes: Vec<usize> = jobs.iter().map(|job| job.text.len()).collect();
+    let ranges = batches(&sizes, threads);
+
+    std::thread::scope(|scope| {
+        let mut jobs = jobs.into_iter();
+        let mut exchanges = Vec::new();
+        let workers: Vec<_> = ranges
+            .into_iter()
+            .map(|range| {
+                let batch: Vec<Job> = jobs.by_ref().take(range.len()).collect();
+                let exchange = batch.iter().any(|job| job.ids.is_none()).then(|| {
+                    let (titles_tx, titles_rx) = mpsc::channel();
+                    let (ids_tx, ids_rx) = mpsc::channel();
+                    exchanges.push(Exchange { titles: titles_rx, ids: ids_tx });
+                    (titles_tx, ids_rx)
+                });
+                scope.spawn(move || export_batch(batch, exchange, settings))
+            })
+            .collect();
+
+        coordinate(exchanges);
+
+        for worker in workers {
+            if let Ok(results) = worker.join() {
+                for (index, fragment) in results {
+                    fragments[index] = fragment;
+                }
+            }
+        }
+    });
+}
+
+/// Parses every unit of a batch, trades the titles of those without ids
+/// for their ids in one round trip, then exports them all.
+fn export_batch(
+    mut batch: Vec<Job>,
+    exchange: Option<WorkerExchange>,
+    settings: Settings,
+) -> Vec<(usize, Option<Fragment>)> {
+    let orgs: Vec<Org> = batch
+        .iter()
+        .map(|job| stats::time(&[Stage::Parse], || parse_config().parse(job.text)))
+        .collect();
+    let mut ids: Vec<Option<Vec<String>>> = batch.iter_mut().map(|job| job.ids.take()).collect();
+
+    if let Some((titles_tx, ids_rx)) = exchange {
+        let titles: Vec<Vec<String>> = orgs.iter().map(|org| slug::titles(&org.document())).collect();
+        if settings.memo {
+            for (job, titles) in batch.iter().zip(&titles) {
+                sections::store_titles(job.text, titles);
+            }
+        }
+        let received = titles_tx.send(titles).ok().and_then(|_| ids_rx.recv().ok());
+        match received {
+            Some(received) if received.len() == batch.len() => {
+                ids = received.into_iter().map(Some).collect();
+            }
+            _ => return batch.iter().map(|job| (job.index, None)).collect(),
+        }
+    }
+
+    batch
+        .iter()
+        .zip(orgs.iter().zip(ids))
+        .map(|(job, (org, ids))| (job.index, ids.map(|ids| export_unit(job.text, org, ids, settings))))
+        .collect()
+}
+
+fn export_unit(text: &str, org: &Org, ids: Vec<String>, settings: Settings) -> Fragment {
+    let _exporting = stats::exporting_section();
+    let key = settings.memo.then(|| sections::fragment_key(text, &ids, settings.image_dir));
+    let fragment = export_fragment(org, ids, settings.image_dir);
+    if let Some(key) = key {
+        sections::store_fragment(key, &fragment);
+    }
+    stats::add_sections(1, 0);
+    fragment
+}
+
+fn export_fragment(org: &Org, ids: Vec<String>, image_dir: Option<&Path>) -> Fragment {
+    let mut export = DocumentExport::new(source_len(org), None, SlugTable::from_ids(ids));
+    export.html.image_dir = image_dir.map(Path::to_path_buf);
+    export.html.fragment = true;
+    stats::time(&[Stage::Traverse], || org.traverse(&mut export));
+    export.clock.commit();
+    let text = options::enabled(options::RESULT_TEXT).then(|| extract_text(org, &mut export.slugs, false));
+
+    Fragment {
+        text,
+        images: std::mem::take(&mut export.html.probed_images),
+        dangling_attributes: export.html.pending_attributes.is_some(),
+        html: export.html.finish_fragment(),
+        toc: export.toc.finish_fragment(),
+        meta: export.meta,
+    }
+}
@@ -0,0 +1,78 @@
+//! Per-thread buffers the exporters borrow for one document and hand back
+//! when they are dropped, so a warmed-up thread renders without growing any
+//! of them. Finished output is copied once, at its final size, into the
+//! string handed to C.
+
+use std::cell::Cell;
+use std::collections::HashMap;
+use std::sync::atomic::{AtomicU32, Ordering};
+
+/// Buffers that grew past this are freed rather than kept, so one huge post
+/// does not pin its memory for the rest of the build.
+const MAX_RETAINED: usize = 4 * 1024 * 1024;
+
+/// Inputs shorter than this say little about the expansion ratio.
+const MIN_SAMPLE: usize = 256;
+
+/// HTML bytes produced per org byte, in 1/256ths, as a moving average over
+/// the documents exported so far. Starts at 1.5.
+static EXPANSION: AtomicU32 = AtomicU32::new(384);
+
+#[derive(Default)]
+pub struct HtmlBuffers {
+    pub output: String,
+    pub paragraph_start_len: Vec<usize>,
+    pub in_descriptive_list: Vec<bool>,
+    pub attributes: HashMap<String, String>,
+}
+
+thread_local! {
+    static HTML: Cell<Option<HtmlBuffers>> = const { Cell::new(None) };
+    static TOC: Cell<Option<String>> = const { Cell::new(None) };
+}
+
+/// Takes this thread's HTML buffers, or fresh ones if they are in use.
+pub fn take_html() -> HtmlBuffers {
+    HTML.with(Cell::take).unwrap_or_default()
+}
+
+pub fn release_html(mut buffers: HtmlBuffers) {
+    if buffers.output.capacity() > MAX_RETAINED {
+        return;
+    }
+    buffers.output.clear();
+    buffers.paragraph_start_len.clear();
+    buffers.in_descriptive_list.clear();
+    buffers.attributes.clear();
+    HTML.with(|slot| slot.set(Some(buffers)));
+}
+
+pub fn take_toc() -> String {
+    TOC.with(Cell::take).unwrap_or_default()
+}
+
+pub fn release_toc(mut toc: String) {
+    if toc.capacity() > MAX_RETAINED {
+        return;
+    }
+    toc.clear();
+    TOC.with(|slot| slot.set(Some(toc)));
+}
+
+/// Expected HTML size for `input_len` bytes of org, with an eighth of
+/// headroom so a typical document does not regrow near the end.
+pub fn predict_output(input_len: usize) -> usize {
+    let ratio = EXPANSION.load(Ordering::Relaxed) as usize;
+    input_len.saturating_mul(ratio) / 256 * 9 / 8
+}
+
+/// Folds one finished document into the expansion ratio. Concurrent updates
+/// may lose a sample, which only slows the average down.
+pub fn observe_output(input_len: usize, output_len: usize) {
+    if input_len < MIN_SAMPLE {
+        return;
+    }
+    let sample = (output_len.saturating_mul(256) / input_len).min(u32::MAX as usize) as u32;
+    let old = EXPANSION.load(Ordering::Relaxed);
+    EXPANSION.store(old - old / 8 + sample / 8, Ordering::Relaxed);
+}
@@ -0,0 +1,215 @@
+//! Memo of rendered top-level sections, kept in the on-disk cache.
+//!
+//! Two entries are kept per section. The first, keyed by the section text,
+//! lists its headline titles, which is all the calling thread needs to
+//! assign ids without parsing. The second, keyed by the text, the ids and
+//! the output switches, holds the rendered HTML, TOC and metadata. Editing
+//! one paragraph of a long post misses on that section alone; renaming a
+//! headline also re-renders later sections whose de-duplicated ids moved.
+
+use std::fmt::Write;
+use std::path::Path;
+
+use crate::{cache, highlight, images, mathml, options, ExtractedText, MetadataCollector};
+
+/// Bump when the exporter's output changes, to drop every stored section.
+const VERSION: &str = "5";
+
+/// One exported top-level section, or the text before the first one.
+pub struct Fragment {
+    pub html: String,
+    pub toc: String,
+    pub meta: MetadataCollector,
+    /// Plain text, with `options::RESULT_TEXT`.
+    pub text: Option<ExtractedText>,
+    /// Images given their pixel size, with the size used. The section is
+    /// rendered again once any of them changes.
+    pub images: Vec<(String, Option<(u32, u32)>)>,
+    /// An `#+attr_html` with nothing to apply to yet; in a sequential
+    /// export it would carry over into the next section.
+    pub dangling_attributes: bool,
+}
+
+pub fn enabled() -> bool {
+    cache::enabled()
+}
+
+fn titles_key(text: &str) -> u64 {
+    cache::hash(&[VERSION.as_bytes(), text.as_bytes()])
+}
+
+/// Headline titles of a section seen before.
+pub fn cached_titles(text: &str) -> Option<Vec<String>> {
+    let titles = cache::get("section-titles", titles_key(text))?;
+    Some(titles.lines().map(str::to_string).collect())
+}
+
+pub fn store_titles(text: &str, titles: &[String]) {
+    let mut value = String::new();
+    for title in titles {
+        value.push_str(title);
+        value.push('\n');
+    }
+    cache::insert("section-titles", titles_key(text), &value);
+}
+
+/// Key of a section rendered with the headline ids `ids`, its images
+/// resolved against `image_dir`.
+pub fn fragment_key(text: &str, ids: &[String], image_dir: Option<&Path>) -> u64 {
+    let bits = options::output_bits().to_le_bytes();
+    let dir = image_dir.map_or(&[][..], |dir| dir.as_os_str().as_encoded_bytes());
+    let mut parts: Vec<&[u8]> = vec![
+        VERSION.as_bytes(),
+        highlight::VERSION.as_bytes(),
+        mathml::VERSION.as_bytes(),
+        &bits,
+        dir,
+        text.as_bytes(),
+    ];
+    parts.extend(ids.iter().map(|id| id.as_bytes()));
+    cache::hash(&parts)
+}
+
+pub fn cached_fragment(key: u64, image_dir: Option<&Path>) -> Option<Fragment> {
+    let fragment = decode(&cache::get("sections", key)?)?;
+    let current = match image_dir {
+        Some(dir) => fragment.images.iter().all(|(src, size)| images::size(dir, src) == *size),
+        None => fragment.images.is_empty(),
+    };
+    current.then_some(fragment)
+}
+
+pub fn store_fragment(key: u64, fragment: &Fragment) {
+    cache::insert("sections", key, &encode(fragment));
+}
+
+/// A header line of field lengths, `-` for an unset field, followed by the
+/// fields back to back: dangling flag, HTML, TOC, plain text, its headings
+/// as `offset id` lines, probed images as `width height src` lines (`- -`
+/// for no size), title, date, description, then each tag.
+fn encode(fragment: &Fragment) -> String {
+    let meta = &fragment.meta;
+    let (text, headings) = match &fragment.text {
+        Some(text) => {
+            let mut headings = String::new();
+            for (offset, id) in &text.headings {
+                let _ = writeln!(headings, "{offset} {id}");
+            }
+            (Some(text.text.clone()), Some(headings))
+        }
+        None => (None, None),
+    };
+    let mut images = String::new();
+    for (src, size) in &fragment.images {
+        match size {
+            Some((width, height)) => {
+                let _ = writeln!(images, "{width} {height} {src}");
+            }
+            None => {
+                let _ = writeln!(images, "- - {src}");
+            }
+        }
+    }
+    let images = Some(images);
+    let optional = [&text, &headings, &images, &meta.title, &meta.date, &meta.description];
+    let payload = fragment.html.len() + fragment.toc.len() + 64;
+    let mut out = String::with_capacity(payload);
+
+    let _ = write!(
+        out,
+        "{} {} {}",
+        fragment.dangling_attributes as u8,
+        fragment.html.len(),
+        fragment.toc.len()
+    );
+    for field in optional {
+        match field {
+            Some(value) => {
+                let _ = write!(out, " {}", value.len());
+            }
+            None => out.push_str(" -"),
+        }
+    }
+    for tag in &meta.tags {
+        let _ = write!(out, " {}", tag.len());
+    }
+    out.push('\n');
+
+    out.push_str(&fragment.html);
+    out.push_str(&fragment.toc);
+    for value in optional.into_iter().flatten() {
+        out.push_str(value);
+    }
+    for tag in &meta.tags {
+        out.push_str(tag);
+    }
+    out
+}
+
+/// Reverses `encode`. Returns `None` for a damaged entry, which is then
+/// treated as a miss and overwritten.
+fn decode(entry: &str) -> Option<Fragment> {
+    let (header, mut rest) = entry.split_once('\n')?;
+    let mut lengths = header.split(' ');
+
+    let mut take = |len: &str| -> Option<String> {
+        let len: usize = len.parse().ok()?;
+        let (field, tail) = (rest.get(..len)?, rest.get(len..)?);
+        rest = tail;
+        Some(field.to_string())
+    };
+
+    let dangling_attributes = match lengths.next()? {
+        "0" => false,
+        "1" => true,
+        _ => return None,
+    };
+    let html = take(lengths.next()?)?;
+    let toc = take(lengths.next()?)?;
+    let mut optional = [None, None, None, None, None, None];
+    for field in &mut optional {
+        *field = match lengths.next()? {
+            "-" => None,
+            len => Some(take(len)?),
+        };
+    }
+    let tags = lengths.map(&mut take).collect::<Option<Vec<_>>>()?;
+    if !rest.is_empty() {
+        return None;
+    }
+
+    let [text, headings, images, title, date, description] = optional;
+    let images = images?
+        .lines()
+        .map(|line| {
+            let mut fields = line.splitn(3, ' ');
+            let size = match (fields.next()?, fields.next()?) {
+                ("-", "-") => None,
+                (width, height) => Some((width.parse().ok()?, height.parse().ok()?)),
+            };
+            Some((fields.next()?.to_string(), size))
+        })
+        .collect::<Option<Vec<_>>>()?;
+    let text = match (text, headings) {
+        (Some(text), Some(headings)) => {
+            let headings = headings
+                .lines()
+                .map(|line| {
+                    let (offset, id) = line.split_once(' ')?;
+                    Some((offset.parse().ok()?, id.to_string()))
+                })
+                .collect::<Option<Vec<_>>>()?;
+            Some(ExtractedText { text, headings })
+        }
+        (None, None) => None,
+        _ => return None,
+    };
+    Some(Fragment {
+        html,
+        toc,
+        meta: MetadataCollector { title, date, description, tags, ..MetadataCollector::new() },
+        text,
+        images,
+        dangling_attributes,
+    })
+}
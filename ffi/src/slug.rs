@@ -0,0 +1,214 @@
+//! Headline anchor ids.
+//!
+//! ASCII letters and digits go through a lookup table; other alphanumeric
+//! characters, CJK included, are kept as they are instead of being
+//! transliterated. Every other run of characters becomes a single `-`.
+//! A headline with a `CUSTOM_ID` property takes that id as written.
+
+use std::collections::HashSet;
+use std::fmt::Write;
+
+use orgize::ast::{Document, Headline};
+use orgize::rowan::ast::AstNode;
+
+/// Lowercased output byte for each ASCII byte, or 0 for a separator.
+static ASCII: [u8; 128] = {
+    let mut table = [0u8; 128];
+    let mut b = 0;
+    while b < 128 {
+        table[b] = match b as u8 {
+            c @ (b'a'..=b'z' | b'0'..=b'9') => c,
+            c @ b'A'..=b'Z' => c + (b'a' - b'A'),
+            _ => 0,
+        };
+        b += 1;
+    }
+    table
+};
+
+/// Id used when a title has no letters or digits at all.
+const FALLBACK: &str = "section";
+
+/// Appends the slug of `text` to `out`.
+pub fn slugify_into(out: &mut String, text: &str) {
+    let start = out.len();
+    let mut separator = false;
+
+    for c in text.chars() {
+        let mapped = if c.is_ascii() {
+            match ASCII[c as usize] {
+                0 => None,
+                b => Some(b as char),
+            }
+        } else if c.is_alphanumeric() {
+            Some(c)
+        } else {
+            None
+        };
+
+        match mapped {
+            Some(c) => {
+                if separator && out.len() > start {
+                    out.push('-');
+                }
+                separator = false;
+                if c.is_ascii() {
+                    out.push(c);
+                } else {
+                    out.extend(c.to_lowercase());
+                }
+            }
+            None => separator = true,
+        }
+    }
+}
+
+/// Slug of `text`, or the fallback id when it has no letters or digits.
+/// This is the id of the first headline with that title.
+pub fn slugify(text: &str) -> String {
+    let mut slug = String::with_capacity(text.len());
+    slugify_into(&mut slug, text);
+    if slug.is_empty() {
+        slug.push_str(FALLBACK);
+    }
+    slug
+}
+
+/// Starts a key holding a custom id rather than a title. Titles are
+/// single lines of text and never contain it.
+const CUSTOM: char = '\0';
+
+/// Appends the key a headline's id is computed from: `CUSTOM` and the
+/// `CUSTOM_ID` property when it has one, otherwise the title as written.
+pub fn title_text(out: &mut String, headline: &Headline) {
+    let custom = headline
+        .properties()
+        .and_then(|properties| properties.get("CUSTOM_ID"))
+        .filter(|id| !id.trim().is_empty());
+    if let Some(id) = custom {
+        out.push(CUSTOM);
+        out.push_str(id.trim());
+        return;
+    }
+    for element in headline.title() {
+        let _ = write!(out, "{}", element);
+    }
+}
+
+/// Keys of every headline under `document`, as `title_text` writes them,
+/// in the order the exporter visits them.
+pub fn titles(document: &Document) -> Vec<String> {
+    fn visit(headline: Headline, titles: &mut Vec<String>) {
+        let mut title = String::new();
+        title_text(&mut title, &headline);
+        titles.push(title);
+        for child in headline.headlines() {
+            visit(child, titles);
+        }
+    }
+
+    let mut titles = Vec::new();
+    for headline in document.headlines() {
+        visit(headline, &mut titles);
+    }
+    titles
+}
+
+/// The document `headline` belongs to.
+fn document_of(headline: &Headline) -> Option<Document> {
+    let mut node = headline.syntax().clone();
+    while let Some(parent) = node.parent() {
+        node = parent;
+    }
+    Document::cast(node)
+}
+
+/// Ids for one document's headlines in document order. The first pass
+/// over a document computes them, appending `-2`, `-3`, ... to repeated
+/// slugs but skipping any suffixed id that is another headline's own slug,
+/// so `Foo`, `Foo`, `Foo 2` get `foo`, `foo-3`, `foo-2`. Later passes
+/// replay the table so the body and TOC always agree. Custom ids are
+/// never given to another headline, suffixed or not.
+#[derive(Default)]
+pub struct SlugTable {
+    ids: Vec<String>,
+    used: HashSet<String>,
+    /// Slugs of every title in the document, which suffixes may not take.
+    reserved: HashSet<String>,
+    /// Every custom id in the document.
+    custom: HashSet<String>,
+    cursor: usize,
+    title: String,
+}
+
+impl SlugTable {
+    /// A table that replays ids assigned elsewhere.
+    pub fn from_ids(ids: Vec<String>) -> Self {
+        SlugTable {
+            ids,
+            ..SlugTable::default()
+        }
+    }
+
+    /// Moves the table out, rewound for a new pass over the document.
+    pub fn replay(&mut self) -> SlugTable {
+        let mut table = std::mem::take(self);
+        table.cursor = 0;
+        table
+    }
+
+    /// Returns the id of the next headline.
+    pub fn next_id(&mut self, headline: &Headline) -> &str {
+        if self.cursor == self.ids.len() {
+            if self.ids.is_empty() {
+                // The first new id of a document; nothing has been taken yet.
+                if let Some(document) = document_of(headline) {
+                    for title in titles(&document) {
+                        self.reserve(&title);
+                    }
+                }
+            }
+            self.title.clear();
+            title_text(&mut self.title, headline);
+            let title = std::mem::take(&mut self.title);
+            let id = self.unique(&title);
+            self.title = title;
+            self.ids.push(id);
+        }
+        self.cursor += 1;
+        &self.ids[self.cursor - 1]
+    }
+
+    /// Keeps the slug of a headline titled `title` from being taken as
+    /// the suffixed id of an earlier one. Every title of the document must
+    /// be reserved before the first `unique` call.
+    pub fn reserve(&mut self, title: &str) {
+        match title.strip_prefix(CUSTOM) {
+            Some(id) => self.custom.insert(id.to_string()),
+            None => self.reserved.insert(slugify(title)),
+        };
+    }
+
+    /// Assigns the id for a headline titled `title`, after all earlier ones.
+    pub fn unique(&mut self, title: &str) -> String {
+        if let Some(id) = title.strip_prefix(CUSTOM) {
+            self.used.insert(id.to_string());
+            return id.to_string();
+        }
+        let base = slugify(title);
+        let mut id = base.clone();
+        let mut n = 2;
+        // Slugs are reserved by their first headline, which always gets
+        // its own; only suffixed ids need to avoid them.
+        while self.used.contains(&id)
+            || self.custom.contains(&id)
+            || (n > 2 && self.reserved.contains(&id))
+        {
+            id.clear();
+            let _ = write!(id, "{}-{}", base, n);
+            n += 1;
+        }
+        self.used.insert(id.clone());
+        id
+    }
+}
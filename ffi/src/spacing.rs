@@ -0,0 +1,93 @@
+//! Spaces between CJK and Latin text, inserted at build time with the same
+//! core rules as pangu.js: a space goes between a CJK character and an
+//! adjacent half-width letter, digit or symbol. pangu's extra rules for
+//! quotes and brackets are not applied.
+
+use std::borrow::Cow;
+
+/// CJK ranges pangu.js spaces around: radicals, kana, bopomofo, enclosed
+/// CJK, unified ideographs and compatibility ideographs.
+fn is_cjk(c: char) -> bool {
+    matches!(c,
+        '\u{2e80}'..='\u{2eff}'
+        | '\u{2f00}'..='\u{2fdf}'
+        | '\u{3040}'..='\u{309f}'
+        | '\u{30a0}'..='\u{30fa}'
+        | '\u{30fc}'..='\u{30ff}'
+        | '\u{3100}'..='\u{312f}'
+        | '\u{3200}'..='\u{32ff}'
+        | '\u{3400}'..='\u{4dbf}'
+        | '\u{4e00}'..='\u{9fff}'
+        | '\u{f900}'..='\u{faff}')
+}
+
+/// Half-width characters that get a space on either side of CJK.
+fn is_alphanumeric(c: char) -> bool {
+    matches!(c,
+        'A'..='Z' | 'a'..='z' | '0'..='9'
+        | '$' | '%' | '^' | '&' | '*' | '-' | '+' | '\\' | '=' | '|' | '/'
+        | '\u{00a1}'..='\u{00ff}'
+        | '\u{0370}'..='\u{03ff}'
+        | '\u{2150}'..='\u{218f}'
+        | '\u{2700}'..='\u{27bf}')
+}
+
+/// Whether a space belongs between `prev` and `next`.
+pub fn needs_space(prev: char, next: char) -> bool {
+    if is_cjk(prev) {
+        is_alphanumeric(next) || next == '@'
+    } else if is_cjk(next) {
+        is_alphanumeric(prev) || matches!(prev, '~' | '!' | ';' | ':' | ',' | '.' | '?')
+    } else {
+        false
+    }
+}
+
+/// Byte offsets in `text` where a space belongs.
+pub fn gaps(text: &str) -> impl Iterator<Item = usize> + '_ {
+    // Pure ASCII text has nothing to space around; skip the char walk.
+    let chars = if text.is_ascii() { "" } else { text };
+    chars
+        .char_indices()
+        .zip(chars.chars().skip(1))
+        .filter(|&((_, prev), next)| needs_space(prev, next))
+        .map(|((i, prev), _)| i + prev.len_utf8())
+}
+
+/// `text` with spaces inserted, borrowed when there are none to insert.
+pub fn spaced(text: &str) -> Cow<'_, str> {
+    let mut gaps = gaps(text).peekable();
+    if gaps.peek().is_none() {
+        return Cow::Borrowed(text);
+    }
+    let mut out = String::with_capacity(text.len() + 8);
+    let mut start = 0;
+    for gap in gaps {
+        out.push_str(&text[start..gap]);
+        out.push(' ');
+        start = gap;
+    }
+    out.push_str(&text[start..]);
+    Cow::Owned(out)
+}
+
+/// Whether `html` is nothing but inline tags, so that text on either side
+/// of it reads as one run.
+pub fn only_inline_tags(mut html: &str) -> bool {
+    const INLINE: &[&str] = &["a", "b", "i", "u", "s", "em", "strong", "sub", "sup"];
+    while !html.is_empty() {
+        let Some(rest) = html.strip_prefix('<') else {
+            return false;
+        };
+        let Some(end) = rest.find('>') else {
+            return false;
+        };
+        let tag = rest[..end].trim_start_matches('/');
+        let name = tag.split(' ').next().unwrap_or_default();
+        if !INLINE.contains(&name) {
+            return false;
+        }
+        html = &rest[end + 1..];
+    }
+    true
+}
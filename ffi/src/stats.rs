@@ -0,0 +1,170 @@
+//! Cumulative instrumentation counters behind `org_get_stats()`.
+//!
+//! Counters are process-wide atomics so batch workers can update them
+//! without locking. Durations add up across threads, so with a parallel
+//! batch they can exceed the wall-clock time of the build.
+
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::time::Instant;
+
+#[derive(Clone, Copy)]
+pub enum Stage {
+    Parse,
+    Traverse,
+    Html,
+    Toc,
+    Meta,
+}
+
+/// Mirrors `OrgStats` in org-ffi.h.
+#[repr(C)]
+pub struct OrgStats {
+    pub parse_ns: u64,
+    pub traverse_ns: u64,
+    pub html_ns: u64,
+    pub toc_ns: u64,
+    pub meta_ns: u64,
+    pub bytes_in: u64,
+    pub bytes_out: u64,
+    pub documents: u64,
+    pub output_allocations: u64,
+    pub sections_rendered: u64,
+    pub sections_reused: u64,
+    pub sections_concurrent: u64,
+}
+
+#[allow(clippy::declare_interior_mutable_const)]
+const ZERO: AtomicU64 = AtomicU64::new(0);
+
+static STAGE_NS: [AtomicU64; 5] = [ZERO; 5];
+static BYTES_IN: AtomicU64 = AtomicU64::new(0);
+static BYTES_OUT: AtomicU64 = AtomicU64::new(0);
+static DOCUMENTS: AtomicU64 = AtomicU64::new(0);
+static OUTPUT_ALLOCATIONS: AtomicU64 = AtomicU64::new(0);
+static SECTIONS_RENDERED: AtomicU64 = AtomicU64::new(0);
+static SECTIONS_REUSED: AtomicU64 = AtomicU64::new(0);
+static SECTIONS_EXPORTING: AtomicU64 = AtomicU64::new(0);
+static SECTIONS_CONCURRENT: AtomicU64 = AtomicU64::new(0);
+
+pub fn add_ns(stage: Stage, ns: u64) {
+    STAGE_NS[stage as usize].fetch_add(ns, Ordering::Relaxed);
+}
+
+/// Runs `f` and adds its duration to each of `stages`.
+pub fn time<T>(stages: &[Stage], f: impl FnOnce() -> T) -> T {
+    let start = Instant::now();
+    let value = f();
+    let ns = start.elapsed().as_nanos() as u64;
+    for &stage in stages {
+        add_ns(stage, ns);
+    }
+    value
+}
+
+/// Splits one traversal's time between the stages that share it. Laps are
+/// summed locally and published once by `commit`, so the per-event cost is
+/// two clock reads and no shared writes. A disabled clock does nothing.
+pub struct StageClock {
+    last: Option<Instant>,
+    ns: [u64; 5],
+}
+
+impl StageClock {
+    pub fn new(enabled: bool) -> Self {
+        StageClock { last: enabled.then(Instant::now), ns: [0; 5] }
+    }
+
+    /// Restarts the lap without charging the time since the last one.
+    pub fn start(&mut self) {
+        if let Some(last) = &mut self.last {
+            *last = Instant::now();
+        }
+    }
+
+    /// Charges the time since the last lap to `stage`.
+    pub fn lap(&mut self, stage: Stage) {
+        if let Some(last) = &mut self.last {
+            let now = Instant::now();
+            self.ns[stage as usize] += (now - *last).as_nanos() as u64;
+            *last = now;
+        }
+    }
+
+    pub fn commit(&self) {
+        for (i, &ns) in self.ns.iter().enumerate() {
+            if ns > 0 {
+                STAGE_NS[i].fetch_add(ns, Ordering::Relaxed);
+            }
+        }
+    }
+}
+
+pub fn add_document(bytes_in: usize) {
+    DOCUMENTS.fetch_add(1, Ordering::Relaxed);
+    BYTES_IN.fetch_add(bytes_in as u64, Ordering::Relaxed);
+}
+
+/// Records output handed to C, and how many allocations producing it took.
+pub fn add_output(bytes: usize, allocations: usize) {
+    if bytes > 0 {
+        BYTES_OUT.fetch_add(bytes as u64, Ordering::Relaxed);
+    }
+    if allocations > 0 {
+        OUTPUT_ALLOCATIONS.fetch_add(allocations as u64, Ordering::Relaxed);
+    }
+}
+
+/// Records top-level sections exported separately, and how many of them
+/// came from the section memo.
+pub fn add_sections(rendered: usize, reused: usize) {
+    SECTIONS_RENDERED.fetch_add(rendered as u64, Ordering::Relaxed);
+    SECTIONS_REUSED.fetch_add(reused as u64, Ordering::Relaxed);
+}
+
+/// Counts a section as being exported until the guard is dropped, keeping
+/// the most that were exported at once.
+pub fn exporting_section() -> SectionGuard {
+    let exporting = SECTIONS_EXPORTING.fetch_add(1, Ordering::Relaxed) + 1;
+    SECTIONS_CONCURRENT.fetch_max(exporting, Ordering::Relaxed);
+    SectionGuard
+}
+
+pub struct SectionGuard;
+
+impl Drop for SectionGuard {
+    fn drop(&mut self) {
+        SECTIONS_EXPORTING.fetch_sub(1, Ordering::Relaxed);
+    }
+}
+
+pub fn snapshot() -> OrgStats {
+    let ns = |stage: Stage| STAGE_NS[stage as usize].load(Ordering::Relaxed);
+    OrgStats {
+        parse_ns: ns(Stage::Parse),
+        traverse_ns: ns(Stage::Traverse),
+        html_ns: ns(Stage::Html),
+        toc_ns: ns(Stage::Toc),
+        meta_ns: ns(Stage::Meta),
+        bytes_in: BYTES_IN.load(Ordering::Relaxed),
+        bytes_out: BYTES_OUT.load(Ordering::Relaxed),
+        documents: DOCUMENTS.load(Ordering::Relaxed),
+        output_allocations: OUTPUT_ALLOCATIONS.load(Ordering::Relaxed),
+        sections_rendered: SECTIONS_RENDERED.load(Ordering::Relaxed),
+        sections_reused: SECTIONS_REUSED.load(Ordering::Relaxed),
+        sections_concurrent: SECTIONS_CONCURRENT.load(Ordering::Relaxed),
+    }
+}
+
+pub fn reset() {
+    for counter in STAGE_NS.iter().chain([
+        &BYTES_IN,
+        &BYTES_OUT,
+        &DOCUMENTS,
+        &OUTPUT_ALLOCATIONS,
+        &SECTIONS_RENDERED,
+        &SECTIONS_REUSED,
+        &SECTIONS_CONCURRENT,
+    ]) {
+        counter.store(0, Ordering::Relaxed);
+    }
+}
@@ -2,6 +2,7 @@
 #define ORG_FFI_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -11,11 +12,199 @@ extern "C" {
     typedef struct OrgDocument OrgDocument;
     typedef struct OrgMetadata OrgMetadata;
 
+/** A headline's position in OrgText. */
+    typedef struct {
+        size_t offset;  /* Byte offset of the headline title in text */
+        char* id;       /* Anchor id, as in the exported HTML */
+    } OrgTextHeading;
+
+/**
+ * Plain text of a document, for search indexes and excerpts. Words are
+ * separated by single spaces and each headline title starts a new line.
+ * Markup, keywords, comments, property drawers and images are left out;
+ * links keep their description, or their target when they have none.
+ */
+    typedef struct {
+        char* text;                 /* Null-terminated text */
+        size_t len;                 /* Length of text in bytes */
+        OrgTextHeading* headings;   /* Headlines in document order */
+        size_t heading_count;
+    } OrgText;
+
+/** Flags for org_extract_text(). */
+    typedef enum {
+        ORG_TEXT_SKIP_SOURCE = 1    /* Leave out source blocks */
+    } OrgTextFlag;
+
+/**
+ * Everything the site builder needs from one post, produced by a single
+ * parse and traversal. All fields are owned by the result.
+ */
+    typedef struct {
+        char* html;         /* Body HTML */
+        char* toc;          /* Table of contents HTML */
+        OrgMetadata* meta;  /* Title, date, description and tags */
+        OrgText text;       /* Plain text; empty unless ORG_OPTION_RESULT_TEXT is on */
+    } OrgResult;
+
+/**
+ * One document for org_process_batch(). The data is borrowed for the
+ * duration of the call and need not be null-terminated.
+ *
+ * With ORG_OPTION_IMAGE_HINTS on, local images are sized from image_dir,
+ * a directory or a list of them separated by ':' as in PATH. A relative
+ * image path is looked up in each in turn, with ".." taken off the path
+ * the way a browser does, so the directories on the way need not exist.
+ * Only the header bytes holding the size of a PNG, JPEG, GIF or WebP file
+ * are read, and with a cache directory set, sizes are cached by path,
+ * modification time and length. Images sized by #+ATTR_HTML, remote
+ * images and files that cannot be read get no width or height. A document
+ * handle takes the same directories from org_document_set_image_dir(); the
+ * one-shot functions taking org text, such as org_process_document() and
+ * org_write_html(), never size images.
+ */
+    typedef struct {
+        const char* data;      /* UTF-8 org-mode content */
+        size_t len;            /* Length of data in bytes */
+        const char* image_dir; /* Directories relative image paths are looked up in, normally
+                                  the post's source directory first; NULL to leave images unsized */
+    } OrgInput;
+
+/**
+ * Sink for streamed HTML output.
+ *
+ * Called with consecutive chunks of the document; data is not
+ * null-terminated and is only valid for the duration of the call.
+ * Return 0 to continue, non-zero to stop writing.
+ */
+    typedef int (*OrgWriteFn)(void* userdata, const char* data, size_t len);
+
+/**
+ * Export switches for org_set_option(). All are off by default.
+ */
+    typedef enum {
+        ORG_OPTION_HIGHLIGHT = 0,        /* Syntax-highlight source blocks at build time */
+        ORG_OPTION_MATHML = 1,           /* Render LaTeX fragments as MathML; unsupported TeX stays raw */
+        ORG_OPTION_STAGE_TIMING = 2,     /* Fill html_ns, toc_ns and meta_ns for combined exports */
+        ORG_OPTION_CJK_SPACING = 3,      /* Space CJK and Latin text apart, like pangu.js; not in code or URLs */
+        ORG_OPTION_HEADING_ANCHORS = 4,  /* Wrap h2-h4 in a sticky div.heading-wrapper with a # self-link */
+        ORG_OPTION_CODE_DECORATIONS = 5, /* Source blocks get data-lang and copy/expand buttons */
+        ORG_OPTION_RESULT_TEXT = 6,      /* Fill OrgResult.text, source blocks included */
+        ORG_OPTION_IMAGE_HINTS = 7,      /* Images get width/height (see OrgInput.image_dir), loading="lazy" and decoding="async" */
+        ORG_OPTION_SECTION_THREADS = 8   /* org_process_document() exports large documents on a thread per CPU */
+    } OrgOption;
+
+/**
+ * Cumulative counters reported by org_get_stats().
+ *
+ * Times are summed over all threads, so during org_process_batch() they
+ * can exceed wall-clock time. traverse_ns covers whole tree walks and
+ * includes the html_ns, toc_ns and meta_ns spent inside them. The
+ * combined exports (org_process_document() and friends) only split their
+ * walk into those three stages while ORG_OPTION_STAGE_TIMING is on, since
+ * that costs two clock reads per event; single-purpose exports always
+ * charge their own stage.
+ */
+    typedef struct {
+        uint64_t parse_ns;           /* Parsing org text into a syntax tree */
+        uint64_t traverse_ns;        /* Walking syntax trees */
+        uint64_t html_ns;            /* HTML export */
+        uint64_t toc_ns;             /* Table of contents building */
+        uint64_t meta_ns;            /* Metadata collection */
+        uint64_t bytes_in;           /* Org text parsed */
+        uint64_t bytes_out;          /* HTML, TOC and metadata handed back */
+        uint64_t documents;          /* Documents parsed */
+        uint64_t output_allocations; /* Output buffer allocations and regrowths */
+        uint64_t sections_rendered;  /* Top-level sections of large documents exported */
+        uint64_t sections_reused;    /* ...and those taken from the render cache instead */
+        uint64_t sections_concurrent; /* Most sections exported at the same time */
+    } OrgStats;
+
+/**
+ * Element kinds in an OrgAst, see org_node_kind_name().
+ */
+    typedef enum {
+        ORG_NODE_DOCUMENT,
+        ORG_NODE_SECTION,
+        ORG_NODE_HEADLINE,
+        ORG_NODE_PARAGRAPH,
+        ORG_NODE_TEXT,
+        ORG_NODE_BOLD,
+        ORG_NODE_ITALIC,
+        ORG_NODE_UNDERLINE,
+        ORG_NODE_STRIKE,
+        ORG_NODE_VERBATIM,
+        ORG_NODE_CODE,
+        ORG_NODE_SUBSCRIPT,
+        ORG_NODE_SUPERSCRIPT,
+        ORG_NODE_LINK,
+        ORG_NODE_TARGET,
+        ORG_NODE_RADIO_TARGET,
+        ORG_NODE_FN_REF,
+        ORG_NODE_FN_DEF,
+        ORG_NODE_LIST,
+        ORG_NODE_LIST_ITEM,
+        ORG_NODE_TABLE,
+        ORG_NODE_TABLE_ROW,
+        ORG_NODE_TABLE_CELL,
+        ORG_NODE_SOURCE_BLOCK,
+        ORG_NODE_EXAMPLE_BLOCK,
+        ORG_NODE_QUOTE_BLOCK,
+        ORG_NODE_VERSE_BLOCK,
+        ORG_NODE_CENTER_BLOCK,
+        ORG_NODE_COMMENT_BLOCK,
+        ORG_NODE_EXPORT_BLOCK,
+        ORG_NODE_SPECIAL_BLOCK,
+        ORG_NODE_DRAWER,
+        ORG_NODE_PROPERTY_DRAWER,
+        ORG_NODE_KEYWORD,
+        ORG_NODE_COMMENT,
+        ORG_NODE_FIXED_WIDTH,
+        ORG_NODE_RULE,
+        ORG_NODE_TIMESTAMP,
+        ORG_NODE_CLOCK,
+        ORG_NODE_LATEX_FRAGMENT,
+        ORG_NODE_LATEX_ENVIRONMENT,
+        ORG_NODE_ENTITY,
+        ORG_NODE_LINE_BREAK,
+        ORG_NODE_SNIPPET,
+        ORG_NODE_MACRO,
+        ORG_NODE_COOKIE,
+        ORG_NODE_INLINE_SRC,
+        ORG_NODE_INLINE_CALL,
+        ORG_NODE_BABEL_CALL
+    } OrgNodeKind;
+
+/** Index value meaning "no node" in OrgNode links. */
+#define ORG_NODE_NONE UINT32_MAX
+
+/**
+ * One element of a flattened syntax tree. Records are in preorder, so a
+ * node's first child, if any, is the record right after it.
+ */
+    typedef struct {
+        uint16_t kind;          /* OrgNodeKind */
+        uint16_t level;         /* Headline level; 0 for other kinds */
+        uint32_t parent;        /* Index of the parent; ORG_NODE_NONE for the document */
+        uint32_t next_sibling;  /* Index of the next sibling, or ORG_NODE_NONE */
+        uint32_t offset;        /* Byte offset of the element's text in the input */
+        uint32_t len;           /* Length of the element's text in bytes */
+    } OrgNode;
+
+/**
+ * Flattened syntax tree from org_ast_build(). All nodes live in one array
+ * owned by the tree.
+ */
+    typedef struct {
+        OrgNode* nodes;
+        size_t count;
+    } OrgAst;
+
 /**
  * Parse org-mode content and return HTML string.
  *
- * @param input Null-terminated org-mode content string
- * @param len Length of input string (excluding null terminator)
+ * @param input UTF-8 org-mode content; need not be null-terminated
+ * @param len Length of input in bytes
  * @return Heap-allocated null-terminated HTML string, or NULL on error
  *
  * The returned string must be freed using org_free_string().
@@ -25,14 +214,31 @@ extern "C" {
 /**
  * Extract metadata from org-mode content.
  *
- * @param input Null-terminated org-mode content string
- * @param len Length of input string (excluding null terminator)
+ * @param input UTF-8 org-mode content; need not be null-terminated
+ * @param len Length of input in bytes
  * @return Pointer to OrgMetadata struct, or NULL on error
  *
  * The returned metadata must be freed using org_free_metadata().
  */
     OrgMetadata* org_extract_metadata(const char* input, size_t len);
 
+/**
+ * Read metadata from the keyword lines at the top of org-mode content.
+ *
+ * Fast path for listings: scans #+TITLE, #+DATE, #+DESCRIPTION and
+ * #+FILETAGS lines without parsing the document, skipping blank lines,
+ * comments and a leading property drawer, and stops at the first headline
+ * or content line. Keywords that appear after that point are not seen;
+ * use org_extract_metadata() when they matter.
+ *
+ * @param input UTF-8 org-mode content; need not be null-terminated
+ * @param len Length of input in bytes
+ * @return Pointer to OrgMetadata struct, or NULL on error
+ *
+ * The returned metadata must be freed using org_free_metadata().
+ */
+    OrgMetadata* org_scan_header(const char* input, size_t len);
+
 /**
  * Free a string allocated by org_parse_to_html() or metadata fields.
  *
@@ -43,7 +249,8 @@ extern "C" {
 /**
  * Free metadata struct allocated by org_extract_metadata().
  *
- * This also frees all strings within the metadata struct.
+ * The struct, its strings and the tags array share a single allocation,
+ * so this releases all of them at once.
  *
  * @param meta Pointer to metadata to free (can be NULL)
  */
@@ -101,14 +308,333 @@ extern "C" {
 /**
  * Extract Table of Contents from org-mode content.
  *
- * @param input Null-terminated org-mode content string
- * @param len Length of input string (excluding null terminator)
+ * @param input UTF-8 org-mode content; need not be null-terminated
+ * @param len Length of input in bytes
  * @return Heap-allocated null-terminated HTML TOC string, or NULL on error
  *
  * The returned string must be freed using org_free_string().
  */
     char* org_extract_toc(const char* input, size_t len);
 
+/**
+ * Parse org-mode content once and fill in body HTML, TOC and metadata.
+ *
+ * Equivalent to calling org_parse_to_html(), org_extract_toc() and
+ * org_extract_metadata() on the same input, but the document is parsed
+ * and traversed only once. Runs on the calling thread unless
+ * ORG_OPTION_SECTION_THREADS is on; then very large documents are split at
+ * top-level headlines and the sections exported on several threads. The
+ * output is the same either way.
+ *
+ * @param input UTF-8 org-mode content; need not be null-terminated
+ * @param len Length of input in bytes
+ * @param out Result to fill in; all fields are set to NULL on error
+ * @return 0 on success, non-zero on error
+ *
+ * The result must be released using org_free_result().
+ */
+    int org_process_document(const char* input, size_t len, OrgResult* out);
+
+/**
+ * Free the fields of a result filled in by org_process_document() or
+ * org_process_batch().
+ *
+ * The OrgResult itself is owned by the caller; its fields are reset to NULL.
+ *
+ * @param result Pointer to result to clear (can be NULL)
+ */
+    void org_free_result(OrgResult* result);
+
+/**
+ * Parse and export many documents on a pool of worker threads.
+ *
+ * Each out[i] is filled in exactly as org_process_document() would for
+ * inputs[i]; results are in input order regardless of which thread
+ * produced them. The call returns once every document is done, and no
+ * callbacks are made, so the caller needs no locking of its own. Large
+ * documents only get section threads of their own from the CPUs left over
+ * after the workers; otherwise each is exported on its worker's thread.
+ *
+ * @param inputs Array of n documents
+ * @param n Number of documents
+ * @param out Array of n results to fill in; failed entries are all NULL
+ * @param threads Number of worker threads, or 0 to use one per CPU
+ * @return Number of documents that failed, so 0 on success
+ *
+ * Each result must be released using org_free_result().
+ */
+    int org_process_batch(const OrgInput* inputs, size_t n, OrgResult* out, int threads);
+
+/* Persistent documents */
+
+/**
+ * Parse org-mode content into a document handle.
+ *
+ * The handle keeps the parsed tree alive so HTML, TOC and metadata can be
+ * requested repeatedly without parsing the content again. The input buffer
+ * is not referenced after this call returns.
+ *
+ * @param input UTF-8 org-mode content; need not be null-terminated
+ * @param len Length of input in bytes
+ * @return Document handle, or NULL on error
+ *
+ * The returned handle must be freed using org_document_free().
+ */
+    OrgDocument* org_document_parse(const char* input, size_t len);
+
+/**
+ * Set the directories relative image paths in a document are looked up
+ * in, for the HTML exports of the handle; see OrgInput.image_dir.
+ *
+ * @param doc Document handle
+ * @param image_dir Directory or ':'-separated list, copied; NULL to leave
+ *                  images unsized, which is the default
+ * @return 0 on success, non-zero if doc is NULL or image_dir is empty or
+ *         not UTF-8
+ */
+    int org_document_set_image_dir(OrgDocument* doc, const char* image_dir);
+
+/**
+ * Render the body HTML of a parsed document.
+ *
+ * @param doc Document handle
+ * @return Heap-allocated null-terminated HTML string, or NULL on error
+ *
+ * The returned string must be freed using org_free_string().
+ */
+    char* org_document_html(const OrgDocument* doc);
+
+/**
+ * Render the Table of Contents of a parsed document.
+ *
+ * @param doc Document handle
+ * @return Heap-allocated null-terminated HTML TOC string, or NULL on error
+ *
+ * The returned string must be freed using org_free_string().
+ */
+    char* org_document_toc(const OrgDocument* doc);
+
+/**
+ * Extract metadata from a parsed document.
+ *
+ * @param doc Document handle
+ * @return Pointer to OrgMetadata struct, or NULL on error
+ *
+ * The returned metadata must be freed using org_free_metadata().
+ */
+    OrgMetadata* org_document_metadata(const OrgDocument* doc);
+
+/**
+ * Fill in body HTML, TOC and metadata of a parsed document in one traversal.
+ *
+ * @param doc Document handle
+ * @param out Result to fill in; all fields are set to NULL on error
+ * @return 0 on success, non-zero on error
+ *
+ * The result must be released using org_free_result().
+ */
+    int org_document_process(const OrgDocument* doc, OrgResult* out);
+
+/* Streaming export */
+
+/**
+ * Parse org-mode content and stream its body HTML into a sink.
+ *
+ * No intermediate HTML string is returned; chunks are passed to write as
+ * they are produced, so the sink can append to a caller-owned buffer or
+ * write straight to a file.
+ *
+ * @param input UTF-8 org-mode content; need not be null-terminated
+ * @param len Length of input in bytes
+ * @param write Sink callback
+ * @param userdata Passed through to write
+ * @return 0 on success, non-zero on parse error or if the sink failed
+ */
+    int org_write_html(const char* input, size_t len, OrgWriteFn write, void* userdata);
+
+/**
+ * Stream the body HTML of a parsed document into a sink.
+ *
+ * @param doc Document handle
+ * @param write Sink callback
+ * @param userdata Passed through to write
+ * @return 0 on success, non-zero on error or if the sink failed
+ */
+    int org_document_write_html(const OrgDocument* doc, OrgWriteFn write, void* userdata);
+
+/**
+ * Like org_document_process(), but the body HTML is streamed into a sink
+ * instead of being returned; out->html is left NULL.
+ *
+ * @param doc Document handle
+ * @param write Sink callback
+ * @param userdata Passed through to write
+ * @param out Result to fill in with TOC and metadata
+ * @return 0 on success, non-zero on error or if the sink failed
+ *
+ * The result must be released using org_free_result().
+ */
+    int org_document_process_to(const OrgDocument* doc, OrgWriteFn write, void* userdata, OrgResult* out);
+
+/**
+ * Free a document handle returned by org_document_parse().
+ *
+ * @param doc Document handle to free (can be NULL)
+ */
+    void org_document_free(OrgDocument* doc);
+
+/* Syntax tree */
+
+/**
+ * Parse org-mode content into a flat preorder array of nodes.
+ *
+ * Only elements with an OrgNodeKind are recorded, plus text; syntax such
+ * as headline stars and block delimiters is left out and its children
+ * belong to the nearest recorded ancestor. Offsets index the input
+ * buffer, which the caller keeps to read node text.
+ *
+ * @param input UTF-8 org-mode content; need not be null-terminated
+ * @param len Length of input in bytes
+ * @param out Tree to fill in; set to empty on error
+ * @return 0 on success, non-zero on error
+ *
+ * The tree must be released using org_free_ast().
+ */
+    int org_ast_build(const char* input, size_t len, OrgAst* out);
+
+/**
+ * Like org_ast_build() for an already parsed document. Offsets index the
+ * input the document was parsed from.
+ *
+ * @param doc Document handle
+ * @param out Tree to fill in; set to empty on error
+ * @return 0 on success, non-zero on error
+ *
+ * The tree must be released using org_free_ast().
+ */
+    int org_document_ast(const OrgDocument* doc, OrgAst* out);
+
+/**
+ * Free the nodes of a tree and set it to empty.
+ *
+ * @param ast Tree to free (can be NULL)
+ */
+    void org_free_ast(OrgAst* ast);
+
+/**
+ * Parse org-mode content and extract its plain text.
+ *
+ * @param input UTF-8 org-mode content; need not be null-terminated
+ * @param len Length of input in bytes
+ * @param flags OrgTextFlag values or'ed together
+ * @param out Text to fill in; set to empty on error
+ * @return 0 on success, non-zero on error
+ *
+ * The text must be released using org_free_text().
+ */
+    int org_extract_text(const char* input, size_t len, unsigned flags, OrgText* out);
+
+/**
+ * Like org_extract_text() for an already parsed document. Heading ids
+ * match the document's HTML and TOC exports.
+ *
+ * @param doc Document handle
+ * @param flags OrgTextFlag values or'ed together
+ * @param out Text to fill in; set to empty on error
+ * @return 0 on success, non-zero on error
+ *
+ * The text must be released using org_free_text().
+ */
+    int org_document_text(const OrgDocument* doc, unsigned flags, OrgText* out);
+
+/**
+ * Free the text and headings of an OrgText and set it to empty. Not
+ * needed for the text of an OrgResult, which org_free_result() releases.
+ *
+ * @param text Text to free (can be NULL)
+ */
+    void org_free_text(OrgText* text);
+
+/**
+ * Name of a node kind, such as "headline" or "source-block".
+ *
+ * @param kind Node kind
+ * @return Static string, or NULL for an unknown kind
+ */
+    const char* org_node_kind_name(OrgNodeKind kind);
+
+/* Escaping */
+
+/**
+ * HTML-escape text (< > & ' ") and pass the result to a sink.
+ *
+ * Uses the same routine as the HTML exporter, so template values come out
+ * escaped exactly like document text. The input is treated as bytes and
+ * need not be valid UTF-8; every other byte is passed through as is. Each
+ * run of bytes between special characters goes to the sink in one call,
+ * followed by the entity for the special character.
+ *
+ * @param input Text; need not be null-terminated
+ * @param len Length of input in bytes
+ * @param write Sink callback
+ * @param userdata Passed through to write
+ * @return 0 on success, non-zero if input is NULL or the sink failed
+ */
+    int org_escape_html(const char* input, size_t len, OrgWriteFn write, void* userdata);
+
+/* Options */
+
+/**
+ * Turn an export option on or off for all subsequent exports.
+ *
+ * Exports already in progress keep the settings they started with.
+ *
+ * @param option Option to change
+ * @param value Non-zero to enable, 0 to disable
+ * @return 0 on success, non-zero for an unknown option
+ */
+    int org_set_option(OrgOption option, int value);
+
+/**
+ * Set the directory for the on-disk render cache.
+ *
+ * Expensive fragments such as highlighted source blocks and MathML are stored here,
+ * keyed by a hash of their input, and reused by later builds. So are the
+ * top-level sections of documents over 64 KiB, so that editing one section
+ * of a long post only exports that section again. The directory is created
+ * on first write.
+ *
+ * @param path Null-terminated directory path, or NULL to disable caching
+ * @return 0 on success, non-zero if path is empty or not valid UTF-8
+ */
+    int org_set_cache_dir(const char* path);
+
+/**
+ * Remove the render cache entries no export has read or written since
+ * org_set_cache_dir(), such as sections of earlier versions of a post.
+ *
+ * Call it only after exporting every document that uses the cache, or the
+ * entries of the documents left out are removed too.
+ *
+ * @return Number of files removed; 0 without a cache directory
+ */
+    size_t org_prune_cache(void);
+
+/* Statistics */
+
+/**
+ * Read the instrumentation counters accumulated since startup or the last
+ * org_reset_stats().
+ *
+ * @param out Receives the counters; ignored if NULL
+ */
+    void org_get_stats(OrgStats* out);
+
+/**
+ * Zero all instrumentation counters.
+ */
+    void org_reset_stats(void);
+
 #ifdef __cplusplus
 }
 #endif
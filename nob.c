@@ -6,6 +6,20 @@ static const char *rust_inputs[] = {
     "ffi/Cargo.toml",
     "ffi/Cargo.lock",
     "ffi/src/lib.rs",
+    "ffi/src/ast.rs",
+    "ffi/src/cache.rs",
+    "ffi/src/escape.rs",
+    "ffi/src/highlight.rs",
+    "ffi/src/images.rs",
+    "ffi/src/links.rs",
+    "ffi/src/mathml.rs",
+    "ffi/src/options.rs",
+    "ffi/src/parallel.rs",
+    "ffi/src/scratch.rs",
+    "ffi/src/sections.rs",
+    "ffi/src/slug.rs",
+    "ffi/src/spacing.rs",
+    "ffi/src/stats.rs",
 };
 
 static const char *c_headers[] = {
@@ -21,6 +35,8 @@ static const char *c_headers[] = {
     "src/site-builder/org-parser.h",
     "src/site-builder/post-management.h",
     "src/site-builder/tag-pages.h",
+    "src/site-builder/search-index.h",
+    "src/site-builder/link-check.h",
 };
 
 static const char *core_sources[] = {
@@ -31,6 +47,8 @@ static const char *core_sources[] = {
     "src/site-builder/org-parser.c",
     "src/site-builder/post-management.c",
     "src/site-builder/tag-pages.c",
+    "src/site-builder/search-index.c",
+    "src/site-builder/link-check.c",
     "src/rss.c",
     "src/main.c",
 };
@@ -120,19 +138,22 @@ static bool build_and_run_test(const char *test_name, const char *test_source, c
     return nob_cmd_run(&cmd);
 }
 
-static bool build_and_run_ffi_test(const char *test_source)
+static bool build_and_run_ffi_test(const char *test_name, const char *test_source, const char **objects, size_t object_count)
 {
+    const char *output = nob_temp_sprintf("build/%s", test_name);
     Nob_Cmd cmd = {0};
     nob_cc(&cmd);
     nob_cc_flags(&cmd);
     nob_cmd_append(&cmd, "-pedantic", "-std=c99", "-I", "include", "-I", "src");
     nob_cmd_append(&cmd, "-L", "ffi/target/release", "-Wl,-rpath,ffi/target/release");
-    nob_cmd_append(&cmd, "-l", "org_ffi", "-l", "dl", test_source);
-    nob_cc_output(&cmd, "build/test_ffi");
+    nob_cmd_append(&cmd, test_source);
+    nob_da_append_many(&cmd, objects, object_count);
+    nob_cmd_append(&cmd, "-l", "org_ffi", "-l", "dl");
+    nob_cc_output(&cmd, output);
     if (!nob_cmd_run(&cmd)) return false;
 
     cmd.count = 0;
-    nob_cmd_append(&cmd, "./build/test_ffi");
+    nob_cmd_append(&cmd, output);
     return nob_cmd_run(&cmd);
 }
 
@@ -184,7 +205,16 @@ int main(int argc, char **argv)
         if (!build_and_run_test("test_template", "test/test_template.c", objects, 2)) return 1;
 
         nob_log(INFO, "Building FFI test");
-        if (!build_and_run_ffi_test("test/test_ffi.c")) return 1;
+        if (!build_and_run_ffi_test("test_ffi", "test/test_ffi.c", NULL, 0)) return 1;
+
+        /* Every builder source but main.c, which is last */
+        nob_log(INFO, "Building site builder test");
+        const char *builder_objects[NOB_ARRAY_LEN(core_sources) - 1];
+        for (size_t i = 0; i < NOB_ARRAY_LEN(builder_objects); ++i) {
+            builder_objects[i] = nob_temp_sprintf("build/%s.o", nob_path_name(core_sources[i]));
+            if (!compile_object(core_sources[i], builder_objects[i])) return 1;
+        }
+        if (!build_and_run_ffi_test("test_site_builder", "test/test_site_builder.c", builder_objects, NOB_ARRAY_LEN(builder_objects))) return 1;
 
         nob_log(INFO, "Building page structure test");
         if (!build_and_run_page_structure_test("test/test_page_structure.c")) return 1;
@@ -193,6 +223,21 @@ int main(int argc, char **argv)
         return 0;
     }
 
+    if (strcmp(argv[0], "scaling") == 0) {
+        nob_log(INFO, "Running scaling tests");
+        if (!nob_mkdir_if_not_exists("build")) return 1;
+        if (!build_rust_ffi()) return 1;
+
+        const char *objects[] = {"build/org-string.o", "build/template.o"};
+        if (!compile_object("src/org-string.c", objects[0])) return 1;
+        if (!compile_object("src/template.c", objects[1])) return 1;
+
+        if (!build_and_run_ffi_test("test_scaling", "test/test_scaling.c", objects, 2)) return 1;
+
+        nob_log(INFO, "All scaling tests passed");
+        return 0;
+    }
+
     if (strcmp(argv[0], "blog") == 0) {
         nob_log(INFO, "Building blog before run");
         if (!build_project()) return 1;
@@ -203,6 +248,6 @@ int main(int argc, char **argv)
     }
 
     nob_log(ERROR, "Unknown command: %s", argv[0]);
-    nob_log(INFO, "Usage: %s [clean|test|blog]", program);
+    nob_log(INFO, "Usage: %s [clean|test|scaling|blog]", program);
     return 1;
 }
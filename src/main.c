@@ -2,8 +2,51 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
 #include <unistd.h>
 #include "site-builder/site-builder.h"
+#include "site-builder/post-management.h"
+#include "site-builder/search-index.h"
+#include "site-builder/link-check.h"
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static double ms(uint64_t ns) {
+    return (double)ns / 1e6;
+}
+
+/* FFI times are summed over worker threads, so with a parallel build they
+ * are CPU time and can exceed the wall time of the phase they ran in. */
+static void print_build_stats(uint64_t posts_ns, uint64_t pages_ns, uint64_t assets_ns) {
+    OrgStats stats;
+    org_get_stats(&stats);
+
+    printf("\nBuild statistics:\n");
+    printf("  Documents:         %llu (%.1f KiB in, %.1f KiB out, %llu output allocations)\n",
+           (unsigned long long)stats.documents,
+           (double)stats.bytes_in / 1024.0,
+           (double)stats.bytes_out / 1024.0,
+           (unsigned long long)stats.output_allocations);
+    if (stats.sections_rendered + stats.sections_reused > 0) {
+        printf("  Large-post sections: %llu exported, %llu from cache, up to %llu at once\n",
+               (unsigned long long)stats.sections_rendered,
+               (unsigned long long)stats.sections_reused,
+               (unsigned long long)stats.sections_concurrent);
+    }
+    printf("  Org parsing:       %8.2f ms cpu\n", ms(stats.parse_ns));
+    printf("  Tree traversal:    %8.2f ms cpu\n", ms(stats.traverse_ns));
+    printf("    HTML export:     %8.2f ms cpu\n", ms(stats.html_ns));
+    printf("    TOC building:    %8.2f ms cpu\n", ms(stats.toc_ns));
+    printf("    Metadata:        %8.2f ms cpu\n", ms(stats.meta_ns));
+    printf("  Post pages:        %8.2f ms wall (parsing, export, templating, I/O)\n", ms(posts_ns));
+    printf("  Index/tag/RSS:     %8.2f ms wall\n", ms(pages_ns));
+    printf("  Assets:            %8.2f ms wall\n", ms(assets_ns));
+}
 
 int main(int argc, char **argv) {
     setbuf(stdout, NULL);
@@ -16,19 +59,25 @@ int main(int argc, char **argv) {
     char *input_dir = "posts";
     char *output_dir = "blog";
     char *template_dir = "templates";
+    char *cache_dir = ".org-cache";
     char *site_title = "Vandee's Blog";
     char *blog_base_url = "https://www.vandee.art/blog/";
     bool show_index_description = true;
+    bool show_stats = false;
+    bool listing_only = false;
 
     int opt;
-    while ((opt = getopt(argc, argv, "o:c:t:d:")) != -1) {
+    while ((opt = getopt(argc, argv, "o:c:t:d:k:sl")) != -1) {
         switch (opt) {
         case 'o': output_dir = optarg; break;
         case 'c': input_dir = optarg; break;
         case 't': template_dir = optarg; break;
+        case 'k': cache_dir = optarg; break;
+        case 's': show_stats = true; break;
+        case 'l': listing_only = true; break;
         case 'd': show_index_description = (strcmp(optarg, "true") == 0 || strcmp(optarg, "1") == 0); break;
         default:
-            fprintf(stderr, "Usage: %s [-o output_dir] [-c content_dir] [-t template_dir] [-d show_index_description (true/false, default true)]\n", argv[0]);
+            fprintf(stderr, "Usage: %s [-o output_dir] [-c content_dir] [-t template_dir] [-d show_index_description (true/false, default true)] [-k cache_dir] [-s] [-l]\n", argv[0]);
             return 1;
         }
     }
@@ -49,13 +98,39 @@ int main(int argc, char **argv) {
     printf("Input directory:  %s\n", builder.input_dir);
     printf("Output directory: %s\n", builder.output_dir);
     printf("Template directory: %s\n", builder.template_dir);
+    printf("Cache directory: %s\n", cache_dir);
     printf("Site title: %s\n", builder.site_title);
     printf("Blog base URL: %s\n", builder.blog_base_url);
 
     mkdir_p(builder.output_dir);
 
-    printf("\nGenerating blog posts pages...\n");
-    int errors = process_directory(&builder, builder.input_dir, builder.output_dir);
+    org_set_option(ORG_OPTION_HIGHLIGHT, 1);
+    org_set_option(ORG_OPTION_MATHML, 1);
+    org_set_option(ORG_OPTION_CJK_SPACING, 1);
+    org_set_option(ORG_OPTION_HEADING_ANCHORS, 1);
+    org_set_option(ORG_OPTION_CODE_DECORATIONS, 1);
+    org_set_option(ORG_OPTION_RESULT_TEXT, 1);
+    org_set_option(ORG_OPTION_IMAGE_HINTS, 1);
+    if (org_set_cache_dir(cache_dir) != 0) {
+        fprintf(stderr, "WARNING: Invalid cache directory %s, render cache disabled\n", cache_dir);
+    }
+    if (show_stats) {
+        org_set_option(ORG_OPTION_STAGE_TIMING, 1);
+    }
+
+    uint64_t phase_start = monotonic_ns();
+    int errors;
+    if (listing_only) {
+        /* Post pages, the search index and the link check need the bodies */
+        printf("\nReading post headers...\n");
+        errors = scan_directory(&builder, builder.input_dir, builder.output_dir);
+    } else {
+        printf("\nGenerating blog posts pages...\n");
+        open_search_index(&builder);
+        errors = process_directory(&builder, builder.input_dir, builder.output_dir);
+        close_search_index(&builder);
+    }
+    uint64_t posts_ns = monotonic_ns() - phase_start;
 
     if (errors > 0) {
         printf("\nWARNING: %d errors occurred during build\n", errors);
@@ -63,18 +138,41 @@ int main(int argc, char **argv) {
     }
 
     printf("\nGenerating index, tags, individual tag pages, and archive pages...\n");
+    phase_start = monotonic_ns();
     generate_index_page(&builder, show_index_description);
     generate_tags_page(&builder);
     generate_individual_tag_pages(&builder);
     generate_archive_page(&builder);
     generate_rss_feed(&builder);
+    uint64_t pages_ns = monotonic_ns() - phase_start;
+
+    /* Every post went through the exporter, so whatever it did not use is
+     * left over from earlier versions of the site. */
+    if (!listing_only) {
+        size_t pruned = org_prune_cache();
+        if (pruned > 0) {
+            printf("Removed %zu stale render cache entries\n", pruned);
+        }
+    }
 
     printf("\nCopying template assets...\n");
+    phase_start = monotonic_ns();
     int copy_errors = copy_template_assets(&builder);
+    uint64_t assets_ns = monotonic_ns() - phase_start;
     if (copy_errors > 0) {
         printf("\nWARNING: %d errors occurred during asset copying\n", copy_errors);
     }
 
+    if (!listing_only) {
+        report_broken_links(&builder);
+    }
+
+    free_posts(&builder);
+
+    if (show_stats) {
+        print_build_stats(posts_ns, pages_ns, assets_ns);
+    }
+
     printf("\nBuild complete!\n");
     return 0;
 }
@@ -74,6 +74,14 @@ char *string_to_cstr(const String *s) {
     return result;
 }
 
+char *string_release(String *s) {
+    if (!s) return NULL;
+
+    char *data = s->data;
+    free(s);
+    return data;
+}
+
 void string_free(String *s) {
     if (s) {
         if (s->data) {
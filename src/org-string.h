@@ -14,6 +14,7 @@ String *string_create(size_t initial_capacity);
 void string_append(String *s, const char *data, size_t len);
 void string_append_cstr(String *s, const char *str);
 char *string_to_cstr(const String *s);
+char *string_release(String *s);
 void string_free(String *s);
 
 #endif
@@ -4,6 +4,7 @@
 #include <string.h>
 #include <time.h>
 #include "site-builder/site-builder.h"
+#include "site-builder/org-parser.h"
 #include "org-ffi.h"
 
 static const char *WEEKDAYS[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
@@ -47,32 +48,6 @@ static char *convert_to_rfc2822(const char *org_date) {
     return format_rfc2822_date(year, month, day, hour, minute);
 }
 
-static char *read_org_file(const char *path, size_t *out_size) {
-    FILE *f = fopen(path, "r");
-    if (!f) {
-        fprintf(stderr, "ERROR: Failed to open %s\n", path);
-        *out_size = 0;
-        return NULL;
-    }
-
-    fseek(f, 0, SEEK_END);
-    long file_size = ftell(f);
-    fseek(f, 0, SEEK_SET);
-
-    char *content = malloc(file_size + 1);
-    if (!content) {
-        fprintf(stderr, "ERROR: Failed to allocate memory for %s\n", path);
-        fclose(f);
-        *out_size = 0;
-        return NULL;
-    }
-
-    *out_size = fread(content, 1, file_size, f);
-    content[*out_size] = '\0';
-    fclose(f);
-    return content;
-}
-
 typedef void (*TagCallback)(FILE *fp, const char *tag, const char *base_url, void *data);
 
 static void process_tags(const char *tags_str, TagCallback callback, FILE *fp, const char *base_url, void *data) {
@@ -104,6 +79,30 @@ static void write_category_element(FILE *fp, const char *tag, const char *base_u
     fprintf(fp, "  <category><![CDATA[%s]]></category>\n", tag);
 }
 
+static int write_to_file(void *userdata, const char *data, size_t len) {
+    return fwrite(data, 1, len, userdata) == len ? 0 : 1;
+}
+
+/* Parses a post again and streams its body straight into the feed, so no
+ * post is ever held here as HTML. */
+static int write_post_body(SiteBuilder *builder, const PostInfo *post, FILE *fp) {
+    char *content = NULL;
+    size_t size = 0;
+    if (read_org_file(post->source, &content, &size) != 0) return 1;
+
+    OrgDocument *doc = org_document_parse(content, size);
+    free(content);
+    if (!doc) return 1;
+
+    char *image_dirs = post_image_dirs(builder, post->source, post->path);
+    org_document_set_image_dir(doc, image_dirs);
+    free(image_dirs);
+
+    int result = org_document_write_html(doc, write_to_file, fp);
+    org_document_free(doc);
+    return result;
+}
+
 int generate_rss_feed(SiteBuilder *builder) {
     if (builder->post_count == 0) {
         printf("Warning: No posts to generate RSS feed\n");
@@ -150,21 +149,9 @@ int generate_rss_feed(SiteBuilder *builder) {
         fprintf(fp, "  <title><![CDATA[%s]]></title>\n", post->title);
         fprintf(fp, "  <description><![CDATA[");
 
-        size_t org_path_len = strlen(builder->input_dir) + strlen(post->filename) + 6;
-        char *org_path = malloc(org_path_len);
-        snprintf(org_path, org_path_len, "%s/%s.org", builder->input_dir, post->filename);
-
-        size_t content_size = 0;
-        char *content = read_org_file(org_path, &content_size);
-        if (content) {
-            char *html = org_parse_to_html(content, content_size);
-            if (html) {
-                fprintf(fp, "%s", html);
-                org_free_string(html);
-            }
-            free(content);
+        if (write_post_body(builder, post, fp) != 0) {
+            fprintf(stderr, "WARNING: Failed to read %s for the RSS feed\n", post->source);
         }
-        free(org_path);
 
         if (post->tags && strlen(post->tags) > 0) {
             fprintf(fp, "<div class=\"taglist\"><a href=\"%stags.html\">Tags</a>: ", builder->blog_base_url);
@@ -61,7 +61,7 @@ char* join_path(const char *dir, const char *file) {
     return result;
 }
 
-int process_regular_file(SiteBuilder *builder, const char *input_path, const char *output_dir, const char *filename) {
+int queue_regular_file(OrgJobList *jobs, const char *input_path, const char *output_dir, const char *filename) {
     size_t name_len = strlen(filename);
     int is_org = name_len >= 4 && strcmp(filename + name_len - 4, ".org") == 0;
 
@@ -75,13 +75,10 @@ int process_regular_file(SiteBuilder *builder, const char *input_path, const cha
     sprintf(html_filename, "%s.html", final_path);
     free(final_path);
 
-    int result = process_org_file(builder, input_path, html_filename);
-    free(html_filename);
-
-    return result;
+    return push_org_job(jobs, strdup(input_path), html_filename);
 }
 
-int process_directory(SiteBuilder *builder, const char *input_dir, const char *output_dir) {
+static int collect_org_jobs(OrgJobList *jobs, const char *input_dir, const char *output_dir) {
     DIR *dir = opendir(input_dir);
     if (!dir) {
         fprintf(stderr, "ERROR: Failed to open directory %s\n", input_dir);
@@ -103,9 +100,9 @@ int process_directory(SiteBuilder *builder, const char *input_dir, const char *o
         if (stat(input_path, &st) == 0) {
             if (S_ISDIR(st.st_mode)) {
                 mkdir_p(output_path);
-                error_count += process_directory(builder, input_path, output_path);
+                error_count += collect_org_jobs(jobs, input_path, output_path);
             } else if (S_ISREG(st.st_mode)) {
-                error_count += process_regular_file(builder, input_path, output_dir, entry->d_name);
+                error_count += queue_regular_file(jobs, input_path, output_dir, entry->d_name);
             }
         }
 
@@ -117,6 +114,25 @@ int process_directory(SiteBuilder *builder, const char *input_dir, const char *o
     return error_count;
 }
 
+/* Walks the whole tree first so every post can be parsed in one batch. */
+int process_directory(SiteBuilder *builder, const char *input_dir, const char *output_dir) {
+    OrgJobList jobs = {0};
+    int error_count = collect_org_jobs(&jobs, input_dir, output_dir);
+    error_count += process_org_batch(builder, jobs.items, jobs.count);
+    free_org_jobs(&jobs);
+    return error_count;
+}
+
+/* Fills the post list from the headers of the posts alone, for rebuilding
+ * the listings without their pages. */
+int scan_directory(SiteBuilder *builder, const char *input_dir, const char *output_dir) {
+    OrgJobList jobs = {0};
+    int error_count = collect_org_jobs(&jobs, input_dir, output_dir);
+    error_count += scan_org_batch(builder, jobs.items, jobs.count);
+    free_org_jobs(&jobs);
+    return error_count;
+}
+
 int copy_file(const char *src, const char *dst) {
     FILE *in = fopen(src, "rb");
     if (!in) {
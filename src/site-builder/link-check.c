@@ -0,0 +1,260 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "site-builder/link-check.h"
+#include "site-builder.h"
+#include "site-builder/filesystem.h"
+
+/* Open-addressing table from the page path, relative to output_dir, to
+ * post, sized to stay at most half full so probes stay short. */
+typedef struct {
+    PostInfo **slots;
+    size_t mask;
+} PostIndex;
+
+static uint64_t hash_name(const char *s, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static int post_index_init(PostIndex *index, SiteBuilder *builder) {
+    size_t size = 16;
+    while (size < (size_t)builder->post_count * 2) size *= 2;
+    index->slots = calloc(size, sizeof(PostInfo *));
+    if (!index->slots) return 1;
+    index->mask = size - 1;
+
+    for (int i = 0; i < builder->post_count; i++) {
+        PostInfo *post = &builder->posts[i];
+        size_t slot = hash_name(post->path, strlen(post->path)) & index->mask;
+        while (index->slots[slot]) slot = (slot + 1) & index->mask;
+        index->slots[slot] = post;
+    }
+    return 0;
+}
+
+static PostInfo *post_index_find(const PostIndex *index, const char *path) {
+    size_t len = strlen(path);
+    size_t slot = hash_name(path, len) & index->mask;
+    while (index->slots[slot]) {
+        PostInfo *post = index->slots[slot];
+        if (strcmp(post->path, path) == 0) return post;
+        slot = (slot + 1) & index->mask;
+    }
+    return NULL;
+}
+
+static int has_anchor(const PostInfo *post, const char *id, size_t len) {
+    const PostLinks *links = &post->links;
+    if (!links->anchors) return 0;
+    size_t slot = hash_name(id, len) & links->anchor_mask;
+    while (links->anchors[slot]) {
+        const char *anchor = links->anchors[slot];
+        if (strncmp(anchor, id, len) == 0 && anchor[len] == '\0') return 1;
+        slot = (slot + 1) & links->anchor_mask;
+    }
+    return 0;
+}
+
+static int output_file_exists(SiteBuilder *builder, const char *path) {
+    char *full = join_path(builder->output_dir, path);
+    struct stat st;
+    int exists = stat(full, &st) == 0;
+    free(full);
+    return exists;
+}
+
+/* The first len bytes of href, a path relative to the page at `page`, as a
+ * path relative to output_dir with `.` and `..` resolved. A `..` above the
+ * output directory is kept. Returns NULL when out of memory. */
+static char *resolve_href(const char *page, const char *href, size_t len) {
+    const char *slash = strrchr(page, '/');
+    size_t dir_len = slash ? (size_t)(slash - page) + 1 : 0;
+    char *joined = malloc(dir_len + len + 1);
+    char *out = malloc(dir_len + len + 1);
+    if (!joined || !out) {
+        free(joined);
+        free(out);
+        return NULL;
+    }
+    memcpy(joined, page, dir_len);
+    memcpy(joined + dir_len, href, len);
+    joined[dir_len + len] = '\0';
+
+    size_t out_len = 0;
+    size_t kept = 0;    /* Segments in out that a `..` can remove */
+    for (char *segment = joined; segment; ) {
+        char *next = strchr(segment, '/');
+        size_t segment_len = next ? (size_t)(next - segment) : strlen(segment);
+        if (segment_len == 0 || (segment_len == 1 && segment[0] == '.')) {
+            /* Nothing to add */
+        } else if (segment_len == 2 && segment[0] == '.' && segment[1] == '.' && kept > 0) {
+            while (out_len > 0 && out[out_len - 1] != '/') out_len--;
+            if (out_len > 0) out_len--;
+            kept--;
+        } else {
+            if (out_len > 0 && out[out_len - 1] != '/') out[out_len++] = '/';
+            memcpy(out + out_len, segment, segment_len);
+            out_len += segment_len;
+            if (!(segment_len == 2 && segment[0] == '.' && segment[1] == '.')) kept++;
+        }
+        segment = next ? next + 1 : NULL;
+    }
+    out[out_len] = '\0';
+    free(joined);
+    return out;
+}
+
+static int is_external(const char *href, size_t len) {
+    if (len == 0 || href[0] == '/') return 1;
+    for (size_t i = 0; i < len && href[i] != '/' && href[i] != '#'; i++) {
+        if (href[i] == ':') return 1;
+    }
+    return 0;
+}
+
+/* Appends a copy of the first len bytes of s to a growing array. */
+static int push_copy(char ***items, size_t *count, size_t *capacity, const char *s, size_t len) {
+    if (*count >= *capacity) {
+        size_t new_cap = *capacity == 0 ? 8 : *capacity * 2;
+        char **new_items = realloc(*items, new_cap * sizeof(char *));
+        if (!new_items) return 1;
+        *items = new_items;
+        *capacity = new_cap;
+    }
+    char *copy = strndup(s, len);
+    if (!copy) return 1;
+    (*items)[(*count)++] = copy;
+    return 0;
+}
+
+/* Adds a copy of the first len bytes of id to the anchor set, growing it
+ * to stay at most half full. Ids already in it are skipped. */
+static int add_anchor(PostLinks *links, const char *id, size_t len) {
+    size_t size = links->anchors ? links->anchor_mask + 1 : 0;
+    if ((links->anchor_count + 1) * 2 > size) {
+        size_t new_size = size == 0 ? 16 : size * 2;
+        char **slots = calloc(new_size, sizeof(char *));
+        if (!slots) return 1;
+        for (size_t i = 0; i < size; i++) {
+            char *anchor = links->anchors[i];
+            if (!anchor) continue;
+            size_t slot = hash_name(anchor, strlen(anchor)) & (new_size - 1);
+            while (slots[slot]) slot = (slot + 1) & (new_size - 1);
+            slots[slot] = anchor;
+        }
+        free(links->anchors);
+        links->anchors = slots;
+        links->anchor_mask = new_size - 1;
+    }
+
+    size_t slot = hash_name(id, len) & links->anchor_mask;
+    while (links->anchors[slot]) {
+        const char *anchor = links->anchors[slot];
+        if (strncmp(anchor, id, len) == 0 && anchor[len] == '\0') return 0;
+        slot = (slot + 1) & links->anchor_mask;
+    }
+    char *copy = strndup(id, len);
+    if (!copy) return 1;
+    links->anchors[slot] = copy;
+    links->anchor_count++;
+    return 0;
+}
+
+/* Keeps the internal links of a post body and the ids in it, so the body
+ * can be freed once its page is written. Returns 1 when out of memory,
+ * keeping what was collected. */
+int collect_post_links(PostLinks *links, const char *html) {
+    memset(links, 0, sizeof(*links));
+    if (!html) return 0;
+
+    size_t href_capacity = 0;
+    for (const char *p = strstr(html, "<a href=\""); p; p = strstr(p, "<a href=\"")) {
+        p += 9;
+        const char *end = strchr(p, '"');
+        if (!end) break;
+        size_t len = (size_t)(end - p);
+        if (!is_external(p, len) && push_copy(&links->hrefs, &links->href_count, &href_capacity, p, len) != 0) {
+            return 1;
+        }
+        p = end;
+    }
+
+    for (const char *p = strstr(html, " id=\""); p; p = strstr(p, " id=\"")) {
+        p += 5;
+        const char *end = strchr(p, '"');
+        if (!end) break;
+        if (add_anchor(links, p, (size_t)(end - p)) != 0) return 1;
+        p = end;
+    }
+    return 0;
+}
+
+void free_post_links(PostLinks *links) {
+    for (size_t i = 0; i < links->href_count; i++) free(links->hrefs[i]);
+    if (links->anchors) {
+        for (size_t i = 0; i <= links->anchor_mask; i++) free(links->anchors[i]);
+    }
+    free(links->hrefs);
+    free(links->anchors);
+    memset(links, 0, sizeof(*links));
+}
+
+/* Why `href` in `post` is broken, or NULL when it resolves. */
+static const char *check_link(SiteBuilder *builder, const PostIndex *index, const PostInfo *post, const char *href, size_t len) {
+    const char *hash = memchr(href, '#', len);
+    size_t path_len = hash ? (size_t)(hash - href) : len;
+    const char *fragment = hash ? hash + 1 : NULL;
+    size_t fragment_len = hash ? len - path_len - 1 : 0;
+
+    const PostInfo *target = post;
+    if (path_len > 0) {
+        char *path = resolve_href(post->path, href, path_len);
+        if (!path) return NULL;
+        target = post_index_find(index, path);
+        int exists = target || output_file_exists(builder, path);
+        free(path);
+        if (!exists) return "no such page or file";
+        if (!target) return NULL;
+    }
+
+    if (fragment_len > 0 && !has_anchor(target, fragment, fragment_len)) {
+        return "no such heading";
+    }
+    return NULL;
+}
+
+/* Checks the links collected from every post body against the posts just
+ * built and the files in the output directory, each resolved against the
+ * directory of the page it is on, and prints the ones that lead nowhere. Returns the number of broken links. */
+int report_broken_links(SiteBuilder *builder) {
+    PostIndex index;
+    if (builder->post_count == 0 || post_index_init(&index, builder) != 0) return 0;
+
+    printf("\nChecking internal links...\n");
+    int broken = 0;
+    int checked = 0;
+    for (int i = 0; i < builder->post_count; i++) {
+        PostInfo *post = &builder->posts[i];
+        for (size_t j = 0; j < post->links.href_count; j++) {
+            const char *href = post->links.hrefs[j];
+            checked++;
+            const char *reason = check_link(builder, &index, post, href, strlen(href));
+            if (reason) {
+                printf("  BROKEN: %s -> %s (%s)\n", post->path, href, reason);
+                broken++;
+            }
+        }
+    }
+
+    printf("  %d internal links checked, %d broken\n", checked, broken);
+    free(index.slots);
+    return broken;
+}
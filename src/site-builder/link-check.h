@@ -0,0 +1,10 @@
+#ifndef LINK_CHECK_H
+#define LINK_CHECK_H
+
+#include "site-builder.h"
+
+int collect_post_links(PostLinks *links, const char *html);
+void free_post_links(PostLinks *links);
+int report_broken_links(SiteBuilder *builder);
+
+#endif
@@ -7,6 +7,8 @@
 #include "site-builder/page-renderer.h"
 #include "site-builder/filesystem.h"
 #include "site-builder/post-management.h"
+#include "site-builder/search-index.h"
+#include "site-builder/link-check.h"
 #include "org-ffi.h"
 #include "org-string.h"
 
@@ -34,12 +36,19 @@ int read_org_file(const char *path, char **out_content, size_t *out_size) {
     return 0;
 }
 
+int append_html_chunk(void *userdata, const char *data, size_t len) {
+    String *s = userdata;
+    size_t before = s->len;
+    string_append(s, data, len);
+    return s->len == before + len ? 0 : 1;
+}
+
 void free_org_file_resources(OrgFileResources *r, int free_post_tpl) {
     free(r->filename);
     free(r->formatted_date);
     free(r->content);
-    if (r->meta) org_free_metadata(r->meta);
-    if (r->html) org_free_string(r->html);
+    free(r->image_dir);
+    org_free_result(&r->result);
     if (r->base_tpl) template_free(r->base_tpl);
     if (free_post_tpl && r->post_tpl) template_free(r->post_tpl);
 }
@@ -83,87 +92,349 @@ String *generate_tags_html(const char *tags) {
     return tags_html;
 }
 
-int render_post_page(SiteBuilder *builder, OrgFileResources *r, const char *title, const char *description, const char *tags, const char *filename_only, const char *output_path) {
-    r->post_tpl = template_create(join_path(builder->template_dir, "post.html"), builder->template_dir);
+/* Writes a page as the text before its body, the body, and the text after
+ * it, so the body is never copied into a page-sized buffer. */
+static int write_page_around(const char *path, const String *before, const char *body, size_t body_len, const String *after) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "ERROR: Failed to open %s for writing\n", path);
+        return 1;
+    }
+
+    fwrite(before->data, 1, before->len, f);
+    fwrite(body, 1, body_len, f);
+    fwrite(after->data, 1, after->len, f);
+    int failed = ferror(f);
+    if (fclose(f) != 0) failed = 1;
+    if (failed) {
+        fprintf(stderr, "ERROR: Failed to write %s\n", path);
+        return 1;
+    }
+
+    printf("Generated: %s\n", path);
+    return 0;
+}
+
+/* Renders the base and post templates around the body rather than with it
+ * filled in; the body goes straight from its buffer to the file. */
+int render_post_page(SiteBuilder *builder, OrgFileResources *r, const char *title, const char *description, const char *tags, const char *filename_only, const char *body, size_t body_len, const char *output_path) {
+    char *post_path = join_path(builder->template_dir, "post.html");
+    r->post_tpl = template_create(post_path, builder->template_dir);
+    free(post_path);
     if (!r->post_tpl) {
         fprintf(stderr, "ERROR: Failed to load post template\n");
         return 1;
     }
 
-    String *tags_html = generate_tags_html(tags);
+    String *before = string_create(OUTPUT_BUFFER_SIZE);
+    String *after = string_create(DEFAULT_STRING_BUFFER_SIZE);
+    String *base_after = string_create(DEFAULT_STRING_BUFFER_SIZE);
 
-    char *toc = org_extract_toc(r->content, strlen(r->content));
+    set_template_common_vars(r->base_tpl, builder, title, description, "", "", filename_only);
+    template_render_split(r->base_tpl, "content", before, base_after);
 
+    String *tags_html = generate_tags_html(tags);
     template_set_var(r->post_tpl, "date", r->formatted_date);
-    template_set_var(r->post_tpl, "title", title);
+    set_template_var_escaped(r->post_tpl, "title", title);
     template_set_var(r->post_tpl, "filename", filename_only);
-    template_set_var(r->post_tpl, "content", r->html);
-    template_set_var(r->post_tpl, "tags", string_to_cstr(tags_html));
-    template_set_var(r->post_tpl, "toc", toc ? toc : "");
-
-    String *post_content = string_create(DEFAULT_STRING_BUFFER_SIZE);
-    template_render(r->post_tpl, post_content);
+    template_set_var(r->post_tpl, "tags", tags_html->data);
+    /* Borrowed rather than copied; it must be released with
+     * org_free_string(), not free(). */
+    template_set_var_borrowed(r->post_tpl, "toc", r->result.toc);
+    template_render_split(r->post_tpl, "content", before, after);
+    string_append(after, base_after->data, base_after->len);
 
-    set_template_common_vars(r->base_tpl, builder, title, description, "", "", filename_only);
-    template_set_var(r->base_tpl, "content", string_to_cstr(post_content));
+    template_free(r->post_tpl);
+    r->post_tpl = NULL;
 
-    String *output = string_create(OUTPUT_BUFFER_SIZE);
-    template_render(r->base_tpl, output);
-    write_html_file(output_path, output, output_path);
+    int result = write_page_around(output_path, before, body, body_len, after);
 
-    string_free(output);
-    string_free(post_content);
+    string_free(before);
+    string_free(after);
+    string_free(base_after);
     string_free(tags_html);
-    if (toc) org_free_string(toc);
-    return 0;
+    return result;
 }
 
-int process_org_file(SiteBuilder *builder, const char *input_path, const char *output_path) {
-    OrgFileResources r = {0};
-    size_t content_size;
+static char *parent_dir(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return slash ? strndup(path, slash - path) : strdup(".");
+}
 
-    if (read_org_file(input_path, &r.content, &content_size) != 0) {
+/* The part of a page's path below the output directory. */
+static const char *page_in_output(SiteBuilder *builder, const char *output_path) {
+    size_t output_len = strlen(builder->output_dir);
+    if (strncmp(output_path, builder->output_dir, output_len) != 0) return output_path;
+    output_path += output_len;
+    while (*output_path == '/') output_path++;
+    return output_path;
+}
+
+/* Where the relative image links of a post are looked up, as a PATH-style
+ * list for OrgInput.image_dir: next to its source, then at the page's place
+ * in the custom template directory, which is copied over the output after
+ * the posts are built. page is relative to the output directory. */
+char *post_image_dirs(SiteBuilder *builder, const char *source, const char *page) {
+    char *source_dir = parent_dir(source);
+    char *page_dir = parent_dir(page);
+    char *custom_dir = join_path(builder->template_dir, "custom");
+    char *mirror_dir = join_path(custom_dir, page_dir);
+
+    size_t len = strlen(source_dir) + strlen(mirror_dir) + 2;
+    char *dirs = malloc(len);
+    if (dirs) snprintf(dirs, len, "%s:%s", source_dir, mirror_dir);
+
+    free(source_dir);
+    free(page_dir);
+    free(custom_dir);
+    free(mirror_dir);
+    return dirs;
+}
+
+/* Renders one post from its result and body HTML, which is either the
+ * result's own or was streamed separately, and adds it to the post list. */
+static int finish_org_file(SiteBuilder *builder, OrgFileResources *r, const char *body, size_t body_len, const char *input_path, const char *output_path) {
+    const char *title = org_meta_get_title(r->result.meta);
+    title = title ? title : "Untitled";
+    const char *description = org_meta_get_description(r->result.meta);
+    /* Posts without #+DESCRIPTION get the opening of their text instead. */
+    char *excerpt = NULL;
+    if (!description || description[0] == '\0') {
+        excerpt = text_excerpt(&r->result.text, EXCERPT_MAX_BYTES);
+        description = excerpt;
+    }
+    description = description ? description : "";
+    const char *raw_date = org_meta_get_date(r->result.meta);
+    const char *tags = org_meta_get_tags(r->result.meta);
+    tags = tags ? tags : "";
+
+    r->formatted_date = raw_date ? format_date(raw_date) : strdup("");
+
+    r->filename = get_filename_without_ext(output_path);
+    char *filename_only = strrchr(r->filename, '/');
+    filename_only = filename_only ? filename_only + 1 : r->filename;
+
+    r->base_tpl = load_base_template(builder);
+    if (!r->base_tpl) {
+        fprintf(stderr, "ERROR: Failed to load template for %s\n", input_path);
+        free_org_file_resources(r, 0);
         return 1;
     }
 
-    r.html = org_parse_to_html(r.content, content_size);
-    if (!r.html) {
+    int result = render_post_page(builder, r, title, description, tags, filename_only, body, body_len, output_path);
+
+    /* Only the listing fields and the links stay in the post list; the text
+     * goes to the search index now, and the feed parses its posts again. */
+    add_to_search_index(builder, filename_only, title, raw_date ? raw_date : "", &r->result.text);
+    PostLinks links;
+    collect_post_links(&links, body);
+    if (add_post_to_builder(builder, raw_date ? raw_date : "", r->formatted_date, title, tags, description, filename_only, input_path, page_in_output(builder, output_path), links) != 0) {
+        free_post_links(&links);
+    }
+
+    free(excerpt);
+    free_org_file_resources(r, 1);
+    return result;
+}
+
+/* Parses one post through a document handle, streaming its body HTML into
+ * a single buffer instead of having the library build it and hand it over.
+ * Takes over r, whose content holds the len bytes of the post. */
+static int stream_org_file(SiteBuilder *builder, OrgFileResources *r, size_t len, const char *input_path, const char *output_path) {
+    OrgDocument *doc = org_document_parse(r->content, len);
+    free(r->content);
+    r->content = NULL;
+
+    String *body = string_create(DEFAULT_STRING_BUFFER_SIZE);
+    int failed = !doc || !body;
+    if (!failed) {
+        org_document_set_image_dir(doc, r->image_dir);
+        failed = org_document_process_to(doc, append_html_chunk, body, &r->result) != 0;
+    }
+    org_document_free(doc);
+    if (failed) {
         fprintf(stderr, "ERROR: Failed to parse %s\n", input_path);
-        free_org_file_resources(&r, 0);
+        string_free(body);
+        free_org_file_resources(r, 0);
         return 1;
     }
 
-    r.meta = org_extract_metadata(r.content, content_size);
-    if (!r.meta) {
-        fprintf(stderr, "ERROR: Failed to extract metadata from %s\n", input_path);
-        free_org_file_resources(&r, 0);
+    int result = finish_org_file(builder, r, body->data, body->len, input_path, output_path);
+    string_free(body);
+    return result;
+}
+
+/* Parses up to ORG_BATCH_MAX_FILES posts, or ORG_BATCH_MAX_BYTES of org
+ * text, in one org_process_batch() call so the FFI library can spread them
+ * over every core, then renders them here one at a time. Each source and
+ * result is freed as its page is written, so only one batch is held at a
+ * time. A post too large to share a batch is streamed instead, as at that
+ * size memory rather than time is the limit. Stores the number of jobs used
+ * in *taken. */
+static int process_org_chunk(SiteBuilder *builder, const OrgJob *jobs, size_t count, size_t *taken) {
+    if (count > ORG_BATCH_MAX_FILES) count = ORG_BATCH_MAX_FILES;
+
+    OrgFileResources *res = calloc(count, sizeof(OrgFileResources));
+    OrgInput *inputs = calloc(count, sizeof(OrgInput));
+    OrgResult *results = calloc(count, sizeof(OrgResult));
+    if (!res || !inputs || !results) {
+        fprintf(stderr, "ERROR: Failed to allocate batch of %zu files\n", count);
+        free(res);
+        free(inputs);
+        free(results);
+        *taken = count;
+        return (int)count;
+    }
+
+    int error_count = 0;
+    size_t n = 0, batch_bytes = 0;
+    while (n < count && (n == 0 || batch_bytes < ORG_BATCH_MAX_BYTES)) {
+        size_t content_size = 0;
+        /* Unreadable files go in with len 0 and come back as failed. */
+        if (read_org_file(jobs[n].input_path, &res[n].content, &content_size) == 0) {
+            res[n].image_dir = post_image_dirs(builder, jobs[n].input_path, page_in_output(builder, jobs[n].output_path));
+            inputs[n].data = res[n].content;
+            inputs[n].len = content_size;
+            inputs[n].image_dir = res[n].image_dir;
+            batch_bytes += content_size;
+        }
+        n++;
+    }
+
+    if (n == 1 && res[0].content && batch_bytes >= ORG_BATCH_MAX_BYTES) {
+        error_count = stream_org_file(builder, &res[0], batch_bytes, jobs[0].input_path, jobs[0].output_path);
+        free(res);
+        free(inputs);
+        free(results);
+        *taken = 1;
+        return error_count;
+    }
+
+    org_process_batch(inputs, n, results, 0);
+
+    for (size_t i = 0; i < n; i++) {
+        res[i].result = results[i];
+        if (!res[i].content || !res[i].result.html) {
+            if (res[i].content) fprintf(stderr, "ERROR: Failed to parse %s\n", jobs[i].input_path);
+            free_org_file_resources(&res[i], 0);
+            error_count++;
+            continue;
+        }
+        free(res[i].content);
+        res[i].content = NULL;
+        const char *html = res[i].result.html;
+        error_count += finish_org_file(builder, &res[i], html, strlen(html), jobs[i].input_path, jobs[i].output_path);
+    }
+
+    free(res);
+    free(inputs);
+    free(results);
+    *taken = n;
+    return error_count;
+}
+
+int process_org_batch(SiteBuilder *builder, const OrgJob *jobs, size_t count) {
+    int error_count = 0;
+    size_t done = 0;
+    while (done < count) {
+        size_t taken = 0;
+        error_count += process_org_chunk(builder, jobs + done, count - done, &taken);
+        done += taken;
+    }
+    return error_count;
+}
+
+int process_org_file(SiteBuilder *builder, const char *input_path, const char *output_path) {
+    OrgFileResources r = {0};
+    size_t len = 0;
+    if (read_org_file(input_path, &r.content, &len) != 0) return 1;
+    r.image_dir = post_image_dirs(builder, input_path, page_in_output(builder, output_path));
+    return stream_org_file(builder, &r, len, input_path, output_path);
+}
+
+/* Adds a post to the post list from the keyword lines at the top of its
+ * file, without parsing it, for builds that only regenerate the listings.
+ * A post without #+DESCRIPTION is parsed for its text after all, so it
+ * gets the same excerpt as in a full build. */
+static int scan_org_file(SiteBuilder *builder, const OrgJob *job) {
+    char *content = NULL;
+    size_t len = 0;
+    if (read_org_file(job->input_path, &content, &len) != 0) return 1;
+
+    OrgMetadata *meta = org_scan_header(content, len);
+    if (!meta) {
+        fprintf(stderr, "ERROR: Failed to read the header of %s\n", job->input_path);
+        free(content);
         return 1;
     }
 
-    const char *title = org_meta_get_title(r.meta);
+    const char *title = org_meta_get_title(meta);
     title = title ? title : "Untitled";
-    const char *description = org_meta_get_description(r.meta);
+    const char *description = org_meta_get_description(meta);
+    char *excerpt = NULL;
+    if (!description || description[0] == '\0') {
+        OrgText text;
+        if (org_extract_text(content, len, 0, &text) == 0) {
+            excerpt = text_excerpt(&text, EXCERPT_MAX_BYTES);
+        }
+        org_free_text(&text);
+        description = excerpt;
+    }
     description = description ? description : "";
-    const char *raw_date = org_meta_get_date(r.meta);
-    const char *tags = org_meta_get_tags(r.meta);
+    const char *raw_date = org_meta_get_date(meta);
+    const char *tags = org_meta_get_tags(meta);
     tags = tags ? tags : "";
 
-    r.formatted_date = raw_date ? format_date(raw_date) : strdup("");
+    char *date = raw_date ? format_date(raw_date) : strdup("");
+    char *filename = get_filename_without_ext(job->output_path);
+    char *filename_only = strrchr(filename, '/');
+    filename_only = filename_only ? filename_only + 1 : filename;
 
-    r.filename = get_filename_without_ext(output_path);
-    char *filename_only = strrchr(r.filename, '/');
-    filename_only = filename_only ? filename_only + 1 : r.filename;
+    PostLinks links = {0};
+    int result = add_post_to_builder(builder, raw_date ? raw_date : "", date, title, tags, description, filename_only, job->input_path, page_in_output(builder, job->output_path), links);
 
-    r.base_tpl = load_base_template(builder);
-    if (!r.base_tpl) {
-        fprintf(stderr, "ERROR: Failed to load template for %s\n", input_path);
-        free_org_file_resources(&r, 0);
-        return 1;
+    free(date);
+    free(filename);
+    free(excerpt);
+    org_free_metadata(meta);
+    free(content);
+    return result;
+}
+
+int scan_org_batch(SiteBuilder *builder, const OrgJob *jobs, size_t count) {
+    int error_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        error_count += scan_org_file(builder, &jobs[i]);
+    }
+    return error_count;
+}
+
+int push_org_job(OrgJobList *jobs, char *input_path, char *output_path) {
+    if (jobs->count >= jobs->capacity) {
+        size_t new_cap = jobs->capacity == 0 ? INITIAL_POST_CAPACITY : jobs->capacity * 2;
+        OrgJob *new_items = realloc(jobs->items, new_cap * sizeof(OrgJob));
+        if (!new_items) {
+            free(input_path);
+            free(output_path);
+            return 1;
+        }
+        jobs->items = new_items;
+        jobs->capacity = new_cap;
     }
 
-    add_post_to_builder(builder, raw_date ? raw_date : "", r.formatted_date, title, tags, description, filename_only);
+    jobs->items[jobs->count].input_path = input_path;
+    jobs->items[jobs->count].output_path = output_path;
+    jobs->count++;
+    return 0;
+}
 
-    int result = render_post_page(builder, &r, title, description, tags, filename_only, output_path);
-    free_org_file_resources(&r, 1);
-    return result;
+void free_org_jobs(OrgJobList *jobs) {
+    for (size_t i = 0; i < jobs->count; i++) {
+        free((char *)jobs->items[i].input_path);
+        free((char *)jobs->items[i].output_path);
+    }
+    free(jobs->items);
+    jobs->items = NULL;
+    jobs->count = 0;
+    jobs->capacity = 0;
 }
@@ -10,17 +10,34 @@ typedef struct {
     char *filename;
     char *formatted_date;
     char *content;
-    OrgMetadata *meta;
-    char *html;
+    char *image_dir;
+    OrgResult result;
     Template *base_tpl;
     Template *post_tpl;
 } OrgFileResources;
 
+typedef struct {
+    const char *input_path;
+    const char *output_path;
+} OrgJob;
+
+typedef struct {
+    OrgJob *items;
+    size_t count;
+    size_t capacity;
+} OrgJobList;
+
+int append_html_chunk(void *userdata, const char *data, size_t len);
 int read_org_file(const char *path, char **out_content, size_t *out_size);
 void free_org_file_resources(OrgFileResources *r, int free_post_tpl);
 char *format_date(const char *raw_date);
 String *generate_tags_html(const char *tags);
-int render_post_page(SiteBuilder *builder, OrgFileResources *r, const char *title, const char *description, const char *tags, const char *filename_only, const char *output_path);
+char *post_image_dirs(SiteBuilder *builder, const char *source, const char *page);
+int render_post_page(SiteBuilder *builder, OrgFileResources *r, const char *title, const char *description, const char *tags, const char *filename_only, const char *body, size_t body_len, const char *output_path);
 int process_org_file(SiteBuilder *builder, const char *input_path, const char *output_path);
+int process_org_batch(SiteBuilder *builder, const OrgJob *jobs, size_t count);
+int scan_org_batch(SiteBuilder *builder, const OrgJob *jobs, size_t count);
+int push_org_job(OrgJobList *jobs, char *input_path, char *output_path);
+void free_org_jobs(OrgJobList *jobs);
 
 #endif
@@ -4,12 +4,27 @@
 #include "site-builder/page-renderer.h"
 #include "site-builder.h"
 #include "site-builder/filesystem.h"
+#include "site-builder/org-parser.h"
 #include "template.h"
 #include "org-string.h"
 
+/* Same escaping routine the exporter uses for document text. */
+void append_escaped_html(String *output, const char *text) {
+    if (!output || !text) return;
+    org_escape_html(text, strlen(text), append_html_chunk, output);
+}
+
+void set_template_var_escaped(Template *tpl, const char *key, const char *value) {
+    if (!tpl || !key || !value) return;
+    String *escaped = string_create(strlen(value) + 16);
+    if (!escaped) return;
+    append_escaped_html(escaped, value);
+    template_set_var_owned(tpl, key, string_release(escaped));
+}
+
 void set_template_common_vars(Template *tpl, SiteBuilder *builder, const char *title, const char *description, const char *date, const char *tags, const char *filename) {
-    template_set_var(tpl, "title", title);
-    template_set_var(tpl, "description", description);
+    set_template_var_escaped(tpl, "title", title);
+    set_template_var_escaped(tpl, "description", description);
     template_set_var(tpl, "site_title", builder->site_title);
     template_set_var(tpl, "blog_base_url", builder->blog_base_url);
     template_set_var(tpl, "date", date);
@@ -31,9 +46,7 @@ int write_html_file(const char *path, String *content, const char *name) {
         return 1;
     }
 
-    char *output_str = string_to_cstr(content);
-    fputs(output_str, f);
-    free(output_str);
+    fwrite(content->data, 1, content->len, f);
     fclose(f);
 
     printf("Generated: %s\n", name);
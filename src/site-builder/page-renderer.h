@@ -5,6 +5,8 @@
 #include "site-builder.h"
 #include "org-string.h"
 
+void append_escaped_html(String *output, const char *text);
+void set_template_var_escaped(Template *tpl, const char *key, const char *value);
 void set_template_common_vars(Template *tpl, SiteBuilder *builder, const char *title, const char *description, const char *date, const char *tags, const char *filename);
 Template *load_base_template(SiteBuilder *builder);
 void set_page_content(Template *tpl, String *content);
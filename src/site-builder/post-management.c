@@ -7,9 +7,10 @@
 #include "site-builder.h"
 #include "site-builder/page-renderer.h"
 #include "site-builder/filesystem.h"
+#include "site-builder/link-check.h"
 #include "org-string.h"
 
-int add_post_to_builder(SiteBuilder *builder, const char *raw_date, const char *date, const char *title, const char *tags, const char *description, const char *filename) {
+int add_post_to_builder(SiteBuilder *builder, const char *raw_date, const char *date, const char *title, const char *tags, const char *description, const char *filename, const char *source, const char *path, PostLinks links) {
     if (builder->post_count >= builder->post_capacity) {
         int new_cap = builder->post_capacity == 0 ? INITIAL_POST_CAPACITY : builder->post_capacity * 2;
         PostInfo *new_posts = realloc(builder->posts, new_cap * sizeof(PostInfo));
@@ -25,24 +26,46 @@ int add_post_to_builder(SiteBuilder *builder, const char *raw_date, const char *
     builder->posts[builder->post_count].tags = strdup(tags);
     builder->posts[builder->post_count].description = strdup(description);
     builder->posts[builder->post_count].filename = strdup(filename);
+    builder->posts[builder->post_count].source = strdup(source);
+    builder->posts[builder->post_count].path = strdup(path);
+    builder->posts[builder->post_count].links = links;
     builder->post_count++;
 
     return 0;
 }
 
+void free_posts(SiteBuilder *builder) {
+    for (int i = 0; i < builder->post_count; i++) {
+        PostInfo *post = &builder->posts[i];
+        free(post->raw_date);
+        free(post->date);
+        free(post->title);
+        free(post->tags);
+        free(post->description);
+        free(post->filename);
+        free(post->source);
+        free(post->path);
+        free_post_links(&post->links);
+    }
+    free(builder->posts);
+    builder->posts = NULL;
+    builder->post_count = 0;
+    builder->post_capacity = 0;
+}
+
 void append_post_link(String *content, PostInfo *post, const char *blog_base_url, bool show_description) {
     string_append_cstr(content, "<h2 class=\"post-title\"><a href=\"");
     string_append_cstr(content, blog_base_url);
     string_append_cstr(content, post->filename);
     string_append_cstr(content, ".html\">");
-    string_append_cstr(content, post->title);
+    append_escaped_html(content, post->title);
     string_append_cstr(content, "</a></h2><div class=\"post-date\">");
     string_append_cstr(content, post->date);
     string_append_cstr(content, "</div>");
 
     if (show_description && strlen(post->description) > 0) {
         string_append_cstr(content, "<p class=\"post-description\">");
-        string_append_cstr(content, post->description);
+        append_escaped_html(content, post->description);
         string_append_cstr(content, "</p>");
     }
 
@@ -4,7 +4,8 @@
 #include <stdbool.h>
 #include "site-builder.h"
 
-int add_post_to_builder(SiteBuilder *builder, const char *raw_date, const char *date, const char *title, const char *tags, const char *description, const char *filename);
+int add_post_to_builder(SiteBuilder *builder, const char *raw_date, const char *date, const char *title, const char *tags, const char *description, const char *filename, const char *source, const char *path, PostLinks links);
+void free_posts(SiteBuilder *builder);
 int compare_posts(const void *a, const void *b);
 void sort_posts(SiteBuilder *builder);
 void append_post_link(String *content, PostInfo *post, const char *blog_base_url, bool show_description);
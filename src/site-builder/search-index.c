@@ -0,0 +1,175 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "site-builder/search-index.h"
+#include "site-builder.h"
+#include "site-builder/filesystem.h"
+#include "org-ffi.h"
+#include "org-string.h"
+
+static int is_heading_line(const OrgText *text, size_t offset) {
+    for (size_t i = 0; i < text->heading_count; i++) {
+        if (text->headings[i].offset == offset) return 1;
+    }
+    return 0;
+}
+
+/* Start of the UTF-8 character that contains byte `at`. */
+static size_t char_boundary(const char *s, size_t at) {
+    while (at > 0 && ((unsigned char)s[at] & 0xC0) == 0x80) at--;
+    return at;
+}
+
+/* The first max_bytes of body text, headline titles left out, cut at a
+ * space when there is one and ending in an ellipsis when cut. Returns NULL
+ * when the post has no body text. */
+char *text_excerpt(const OrgText *text, size_t max_bytes) {
+    if (!text->text || text->len == 0) return NULL;
+
+    String *out = string_create(max_bytes + 8);
+    size_t offset = 0;
+    int cut = 0;
+    while (offset < text->len && !cut) {
+        const char *line = text->text + offset;
+        const char *newline = memchr(line, '\n', text->len - offset);
+        size_t line_len = newline ? (size_t)(newline - line) : text->len - offset;
+
+        if (line_len > 0 && !is_heading_line(text, offset)) {
+            if (out->len > 0) {
+                if (out->len + 1 >= max_bytes) {
+                    cut = 1;
+                    break;
+                }
+                string_append_cstr(out, " ");
+            }
+            size_t room = max_bytes > out->len ? max_bytes - out->len : 0;
+            if (line_len > room) {
+                size_t end = char_boundary(line, room);
+                const char *space = NULL;
+                for (size_t i = end; i > 0; i--) {
+                    if (line[i - 1] == ' ') {
+                        space = line + i - 1;
+                        break;
+                    }
+                }
+                /* Text without spaces, such as CJK, is cut mid-run. */
+                if (space && space > line) end = (size_t)(space - line);
+                line_len = end;
+                cut = 1;
+            }
+            string_append(out, line, line_len);
+        }
+        offset += line_len + 1;
+    }
+
+    if (out->len == 0) {
+        string_free(out);
+        return NULL;
+    }
+    if (cut) string_append_cstr(out, "\xE2\x80\xA6");
+    return string_release(out);
+}
+
+static void write_json_string(FILE *fp, const char *s, size_t len) {
+    fputc('"', fp);
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)s[i];
+        switch (c) {
+        case '"': fputs("\\\"", fp); break;
+        case '\\': fputs("\\\\", fp); break;
+        case '\n': fputs("\\n", fp); break;
+        case '\r': fputs("\\r", fp); break;
+        case '\t': fputs("\\t", fp); break;
+        /* Keeps the file safe to inline in a <script> tag. */
+        case '<': fputs("\\u003c", fp); break;
+        default:
+            if (c < 0x20) {
+                fprintf(fp, "\\u%04x", c);
+            } else {
+                fputc(c, fp);
+            }
+        }
+    }
+    fputc('"', fp);
+}
+
+/* One section per headline, plus the text before the first one under an
+ * empty id. A section's text starts with its headline title. */
+static void write_sections(FILE *fp, const OrgText *text) {
+    fputs("[", fp);
+    int first = 1;
+    size_t start = 0;
+    for (size_t i = 0; i <= text->heading_count; i++) {
+        size_t end = i < text->heading_count ? text->headings[i].offset : text->len;
+        size_t len = end - start;
+        while (len > 0 && text->text[start + len - 1] == '\n') len--;
+
+        /* Posts that open with a headline have no untitled section. */
+        if (i > 0 || len > 0) {
+            const char *id = i > 0 && text->headings[i - 1].id ? text->headings[i - 1].id : "";
+            if (!first) fputs(",", fp);
+            first = 0;
+            fputs("{\"id\":", fp);
+            write_json_string(fp, id, strlen(id));
+            fputs(",\"text\":", fp);
+            write_json_string(fp, text->text + start, len);
+            fputs("}", fp);
+        }
+        start = end;
+    }
+    fputs("]", fp);
+}
+
+/* Starts search.json: the plain text of every post split at its
+ * headlines, so search.js need not download and parse each page. It is
+ * opened before the posts are built and each post is written out with its
+ * page, so no text is kept until the end of the build. */
+int open_search_index(SiteBuilder *builder) {
+    char *index_path = join_path(builder->output_dir, "search.json");
+    builder->search_index = fopen(index_path, "w");
+    if (!builder->search_index) {
+        fprintf(stderr, "ERROR: Failed to create search index: %s\n", index_path);
+        free(index_path);
+        return 1;
+    }
+    free(index_path);
+
+    fputs("[", builder->search_index);
+    builder->search_entries = 0;
+    return 0;
+}
+
+void add_to_search_index(SiteBuilder *builder, const char *filename, const char *title, const char *raw_date, const OrgText *text) {
+    FILE *fp = builder->search_index;
+    if (!fp || !text->text) return;
+
+    if (builder->search_entries++ > 0) fputs(",\n", fp);
+    fputs("{\"url\":", fp);
+    String *url = string_create(strlen(filename) + 6);
+    string_append_cstr(url, filename);
+    string_append_cstr(url, ".html");
+    write_json_string(fp, url->data, url->len);
+    string_free(url);
+    fputs(",\"title\":", fp);
+    write_json_string(fp, title, strlen(title));
+    fputs(",\"date\":", fp);
+    write_json_string(fp, raw_date, strlen(raw_date));
+    fputs(",\"sections\":", fp);
+    write_sections(fp, text);
+    fputs("}", fp);
+}
+
+int close_search_index(SiteBuilder *builder) {
+    FILE *fp = builder->search_index;
+    if (!fp) return 1;
+
+    fputs("]\n", fp);
+    fclose(fp);
+    builder->search_index = NULL;
+
+    char *index_path = join_path(builder->output_dir, "search.json");
+    printf("  Search index generated: %s (%d posts)\n", index_path, builder->search_entries);
+    free(index_path);
+    return 0;
+}
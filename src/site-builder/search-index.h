@@ -0,0 +1,14 @@
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+#include <stddef.h>
+#include "site-builder.h"
+
+#define EXCERPT_MAX_BYTES 160
+
+char *text_excerpt(const OrgText *text, size_t max_bytes);
+int open_search_index(SiteBuilder *builder);
+void add_to_search_index(SiteBuilder *builder, const char *filename, const char *title, const char *raw_date, const OrgText *text);
+int close_search_index(SiteBuilder *builder);
+
+#endif
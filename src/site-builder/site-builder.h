@@ -2,7 +2,9 @@
 #define SITE_BUILDER_H
 
 #include <stdbool.h>
+#include <stdio.h>
 #include "org-string.h"
+#include "org-ffi.h"
 
 /* Constants */
 #define MAX_PATH_LEN 512
@@ -15,6 +17,18 @@
 #define OUTPUT_BUFFER_SIZE 16384
 #define DATE_BUFFER_SIZE 32
 #define PAGE_TITLE_BUFFER_SIZE 128
+#define ORG_BATCH_MAX_FILES 256
+#define ORG_BATCH_MAX_BYTES (32 * 1024 * 1024)
+
+/* What the link check needs from a post body: its internal links and the
+ * ids it can be linked to. */
+typedef struct {
+    char **hrefs;
+    size_t href_count;
+    char **anchors;         /* Open-addressing set of ids, NULL slots empty */
+    size_t anchor_count;
+    size_t anchor_mask;     /* Slot count minus one */
+} PostLinks;
 
 typedef struct {
     char *raw_date;
@@ -23,6 +37,9 @@ typedef struct {
     char *tags;
     char *description;
     char *filename;
+    char *source;   /* The .org file, read again for the RSS feed */
+    char *path;     /* The page, relative to output_dir */
+    PostLinks links;
 } PostInfo;
 
 typedef struct {
@@ -36,6 +53,8 @@ typedef struct {
     int post_count;
     int post_capacity;
     int max_rss_items;
+    FILE *search_index; /* search.json while posts are being built */
+    int search_entries;
 } SiteBuilder;
 
 int mkdir_p(const char *path);
@@ -43,6 +62,7 @@ char *get_filename_without_ext(const char *filename);
 char *join_path(const char *dir, const char *file);
 int process_org_file(SiteBuilder *builder, const char *input_path, const char *output_path);
 int process_directory(SiteBuilder *builder, const char *input_dir, const char *output_dir);
+int scan_directory(SiteBuilder *builder, const char *input_dir, const char *output_dir);
 int generate_index_page(SiteBuilder *builder, bool show_description);
 int generate_tags_page(SiteBuilder *builder);
 int generate_individual_tag_pages(SiteBuilder *builder);
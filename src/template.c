@@ -1,32 +1,10 @@
 #define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include "template.h"
 
-static char *extract_include_filename(const char *cstr, size_t *i, size_t len) {
-    size_t start = *i + 2;
-
-    if (strncmp(cstr + start, "include ", 8) != 0) return NULL;
-
-    size_t pos = start + 8;
-    while (pos < len && !(cstr[pos] == '}' && pos + 1 < len && cstr[pos + 1] == '}')) {
-        pos++;
-    }
-
-    if (pos >= len) return NULL;
-
-    size_t filename_len = pos - (start + 8);
-    char *filename = malloc(filename_len + 1);
-    if (filename) {
-        strncpy(filename, cstr + start + 8, filename_len);
-        filename[filename_len] = '\0';
-        *i = pos + 2;
-    }
-
-    return filename;
-}
-
 static int read_file_content(const char *path, String *output) {
     FILE *f = fopen(path, "r");
     if (!f) return 1;
@@ -46,43 +24,41 @@ static int read_file_content(const char *path, String *output) {
     return 0;
 }
 
-static void process_single_include(const char *template_dir, String *result, char *filename) {
+static void process_single_include(const char *template_dir, String *result, const char *filename, size_t filename_len) {
     char full_path[512];
-    snprintf(full_path, sizeof(full_path), "%s/%s", template_dir, filename);
+    snprintf(full_path, sizeof(full_path), "%s/%.*s", template_dir, (int)filename_len, filename);
 
     if (read_file_content(full_path, result) != 0) {
         fprintf(stderr, "Warning: Could not include template file: %s\n", full_path);
     }
-
-    free(filename);
 }
 
+/* Copies the text between {{include file}} directives in whole spans. Once
+ * a directive has no closing braces, none after it can have any either, so
+ * the rest is copied as is instead of being searched again. */
 static void process_includes(String *content, const char *template_dir) {
     if (!content || !template_dir) return;
 
-    char *cstr = string_to_cstr(content);
-    size_t len = strlen(cstr);
-    String *result = string_create(len);
+    const char *cstr = content->data;
+    String *result = string_create(content->len + 1);
+    const char *copied = cstr;
 
-    for (size_t i = 0; i < len; i++) {
-        if (cstr[i] == '{' && i + 1 < len && cstr[i + 1] == '{') {
-            char *filename = extract_include_filename(cstr, &i, len);
-            if (filename) {
-                process_single_include(template_dir, result, filename);
-                continue;
-            }
-        }
-        string_append(result, &cstr[i], 1);
+    for (const char *open = strstr(cstr, "{{include "); open; open = strstr(copied, "{{include ")) {
+        const char *filename = open + 10;
+        const char *close = strstr(filename, "}}");
+        if (!close) break;
+
+        string_append(result, copied, (size_t)(open - copied));
+        process_single_include(template_dir, result, filename, (size_t)(close - filename));
+        copied = close + 2;
     }
+    string_append(result, copied, content->len - (size_t)(copied - cstr));
 
-    char *result_str = string_to_cstr(result);
     free(content->data);
-    content->data = strdup(result_str);
-    content->len = strlen(result_str);
-    content->cap = content->len + 1;
-    string_free(result);
-    free(result_str);
-    free(cstr);
+    content->data = result->data;
+    content->len = result->len;
+    content->cap = result->cap;
+    free(result);
 }
 
 Template *template_create(const char *filename, const char *template_dir) {
@@ -93,6 +69,8 @@ Template *template_create(const char *filename, const char *template_dir) {
     t->vars = NULL;
     t->var_count = 0;
     t->var_capacity = 0;
+    t->index = NULL;
+    t->index_capacity = 0;
 
     FILE *f = fopen(filename, "r");
     if (!f) {
@@ -135,96 +113,153 @@ void template_free(Template *t) {
 
     for (int i = 0; i < t->var_count; i++) {
         free(t->vars[i].key);
-        free(t->vars[i].value);
+        if (!t->vars[i].borrowed) free(t->vars[i].value);
     }
 
     if (t->vars) {
         free(t->vars);
     }
+    free(t->index);
 
     free(t);
 }
 
+static uint32_t hash_key(const char *key, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)key[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* Slot in t->index for the key, which is either its variable or empty. */
+static size_t find_slot(const Template *t, const char *key, size_t len) {
+    size_t mask = (size_t)t->index_capacity - 1;
+    size_t slot = hash_key(key, len) & mask;
+    while (t->index[slot] >= 0) {
+        const char *existing = t->vars[t->index[slot]].key;
+        if (strncmp(existing, key, len) == 0 && existing[len] == '\0') break;
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+/* Keeps the index at most half full, rebuilding it when it grows. */
+static int grow_index(Template *t) {
+    if (t->index_capacity >= t->var_capacity * 2) return 0;
+
+    int new_cap = t->index_capacity == 0 ? 16 : t->index_capacity;
+    while (new_cap < t->var_capacity * 2) new_cap *= 2;
+    int *index = malloc(new_cap * sizeof(int));
+    if (!index) return 1;
+
+    free(t->index);
+    t->index = index;
+    t->index_capacity = new_cap;
+    for (int i = 0; i < new_cap; i++) t->index[i] = -1;
+    for (int i = 0; i < t->var_count; i++) {
+        t->index[find_slot(t, t->vars[i].key, strlen(t->vars[i].key))] = i;
+    }
+    return 0;
+}
+
+static const char *find_template_var(Template *t, const char *key, size_t len) {
+    if (t->var_count == 0) return "";
+    int var = t->index[find_slot(t, key, len)];
+    return var >= 0 && t->vars[var].value ? t->vars[var].value : "";
+}
+
 void template_set_var(Template *t, const char *key, const char *value) {
     if (!t || !key || !value) return;
+    template_set_var_owned(t, key, strdup(value));
+}
 
-    for (int i = 0; i < t->var_count; i++) {
-        if (strcmp(t->vars[i].key, key) == 0) {
-            free(t->vars[i].value);
-            t->vars[i].value = strdup(value);
-            return;
+/* Stores value under key, replacing any earlier value. Returns 1 without
+ * storing anything when out of memory. */
+static int store_var(Template *t, const char *key, char *value, int borrowed) {
+    size_t key_len = strlen(key);
+    if (t->var_count > 0) {
+        int existing = t->index[find_slot(t, key, key_len)];
+        if (existing >= 0) {
+            if (!t->vars[existing].borrowed) free(t->vars[existing].value);
+            t->vars[existing].value = value;
+            t->vars[existing].borrowed = borrowed;
+            return 0;
         }
     }
 
     if (t->var_count >= t->var_capacity) {
         int new_cap = t->var_capacity == 0 ? 8 : t->var_capacity * 2;
         TemplateVar *new_vars = realloc(t->vars, new_cap * sizeof(TemplateVar));
-        if (!new_vars) return;
+        if (!new_vars) return 1;
 
         t->vars = new_vars;
         t->var_capacity = new_cap;
     }
-
-    t->vars[t->var_count].key = strdup(key);
-    t->vars[t->var_count].value = strdup(value);
+    if (grow_index(t) != 0) return 1;
+
+    char *key_copy = strdup(key);
+    if (!key_copy) return 1;
+    t->vars[t->var_count].key = key_copy;
+    t->vars[t->var_count].value = value;
+    t->vars[t->var_count].borrowed = borrowed;
+    t->index[find_slot(t, key, key_len)] = t->var_count;
     t->var_count++;
+    return 0;
 }
 
-static const char *find_template_var(Template *t, const char *key) {
-    for (int i = 0; i < t->var_count; i++) {
-        if (strcmp(t->vars[i].key, key) == 0) {
-            return t->vars[i].value;
-        }
+/* Takes ownership of a malloc'd value, avoiding a copy for large content. */
+void template_set_var_owned(Template *t, const char *key, char *value) {
+    if (!value) return;
+    if (!t || !key || store_var(t, key, value, 0) != 0) {
+        free(value);
     }
-    return "";
 }
 
-static int extract_var_key(const char *content, size_t *i, size_t len, char **key_out) {
-    size_t start = *i + 2;
-    size_t pos = start;
-
-    while (pos < len && !(content[pos] == '}' && pos + 1 < len && content[pos + 1] == '}')) {
-        pos++;
-    }
-
-    if (pos >= len) return 0;
-
-    size_t key_len = pos - start;
-    *key_out = malloc(key_len + 1);
-    if (*key_out) {
-        strncpy(*key_out, content + start, key_len);
-        (*key_out)[key_len] = '\0';
-    }
-
-    *i = pos + 1;
-    return *key_out != NULL;
+/* Refers to a value the caller keeps alive until the template is freed or
+ * the key is set again, avoiding a copy for large content. The template
+ * never frees it, so it may come from any allocator. */
+void template_set_var_borrowed(Template *t, const char *key, const char *value) {
+    if (!t || !key || !value) return;
+    store_var(t, key, (char *)value, 1);
 }
 
-static int process_var_substitution(Template *t, String *output, const char *content, size_t *i, size_t len) {
-    char *key = NULL;
-    if (!extract_var_key(content, i, len, &key)) return 0;
-
-    const char *value = find_template_var(t, key);
-    string_append_cstr(output, value);
-    free(key);
-
-    return 1;
+/* Copies the text between {{key}} references in whole spans; see
+ * process_includes() for why an unclosed reference ends the search. Output
+ * goes to before until the first reference to split_key, which is left out,
+ * and to after from there on. */
+static void render_parts(Template *t, const char *split_key, String *before, String *after) {
+    const char *content = t->content->data;
+    const char *copied = content;
+    size_t split_len = split_key ? strlen(split_key) : 0;
+    String *output = before;
+
+    for (const char *open = strstr(content, "{{"); open; open = strstr(copied, "{{")) {
+        const char *key = open + 2;
+        const char *close = strstr(key, "}}");
+        if (!close) break;
+
+        size_t key_len = (size_t)(close - key);
+        string_append(output, copied, (size_t)(open - copied));
+        if (split_key && output == before && key_len == split_len && strncmp(key, split_key, key_len) == 0) {
+            output = after;
+        } else {
+            string_append_cstr(output, find_template_var(t, key, key_len));
+        }
+        copied = close + 2;
+    }
+    string_append(output, copied, t->content->len - (size_t)(copied - content));
 }
 
 void template_render(Template *t, String *output) {
     if (!t || !output) return;
+    render_parts(t, NULL, output, output);
+}
 
-    char *content = string_to_cstr(t->content);
-    size_t len = strlen(content);
-
-    for (size_t i = 0; i < len; i++) {
-        if (content[i] == '{' && i + 1 < len && content[i + 1] == '{') {
-            if (process_var_substitution(t, output, content, &i, len)) {
-                continue;
-            }
-        }
-        string_append(output, &content[i], 1);
-    }
-
-    free(content);
+/* Renders the page around the first {{key}} instead of filling it in, so
+ * a value too large to copy can be written out between the two halves. */
+void template_render_split(Template *t, const char *key, String *before, String *after) {
+    if (!t || !key || !before || !after) return;
+    render_parts(t, key, before, after);
 }
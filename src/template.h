@@ -6,6 +6,7 @@
 typedef struct {
     char *key;
     char *value;
+    int borrowed;       /* value belongs to the caller and is never freed */
 } TemplateVar;
 
 typedef struct {
@@ -13,11 +14,16 @@ typedef struct {
     TemplateVar *vars;
     int var_count;
     int var_capacity;
+    int *index;         /* Open-addressed hash of vars by key; -1 is empty */
+    int index_capacity;
 } Template;
 
 Template *template_create(const char *filename, const char *template_dir);
 void template_free(Template *t);
 void template_set_var(Template *t, const char *key, const char *value);
+void template_set_var_owned(Template *t, const char *key, char *value);
+void template_set_var_borrowed(Template *t, const char *key, const char *value);
 void template_render(Template *t, String *output);
+void template_render_split(Template *t, const char *key, String *before, String *after);
 
 #endif
@@ -192,88 +192,44 @@ document.addEventListener("DOMContentLoaded", function () {
   }
 
   /**
-   * Fetches and trims all posts from the archive.html file.
+   * Fetches all posts from the search.json index written at build time.
    * @returns {Promise<Array>} An array of posts, each with the following properties:
    *   - url: the URL of the post
    *   - title: the title of the post
-   *   - content: the trimmed content of the post
+   *   - content: the plain text of the post
    *   - headers: an array of headers with their positions
    *     - id: the id of the header
-   *     - index: the index of the header in the trimmed content
-   *     - text: the text of the header
+   *     - index: the index of the header in the content
    */
   async function fetchAllPosts() {
     try {
-      // Fetch archive.html to get all post links
-      const response = await fetch("archive.html");
-      const archiveHtml = await response.text();
-      const parser = new DOMParser();
-      const archiveDoc = parser.parseFromString(archiveHtml, "text/html");
-
-      // Extract all post links from archive
-      const postLinks = Array.from(archiveDoc.querySelectorAll(".post-title a"));
-
-      // Fetch content for each blog post
-      const posts = await Promise.all(
-        postLinks.map(async (link) => {
-          let url = link.href;
-          // Convert absolute URLs to relative paths for local access
-          const localUrl = url.replace(/^https?:\/\/[^\/]+\/blog\//, "");
-
-          const postResponse = await fetch(localUrl);
-          const postHtml = await postResponse.text();
-          const postDoc = parser.parseFromString(postHtml, "text/html");
-          const content = postDoc.getElementById("content");
-
-          // Fetch and trim the title
-          const title =
-            content.querySelector(".post-title a")?.textContent.trim() || "";
-
-          // Remove title, toc, postamble, and taglist from the content
-          const postDate = content.querySelector(".post-date");
-          if (postDate) postDate.remove();
-          const postTitle = content.querySelector(".post-title");
-          if (postTitle) postTitle.remove();
-          const toc = content.querySelector("#table-of-contents");
-          if (toc) toc.remove();
-          const taglist = content.querySelector(".taglist");
-          if (taglist) taglist.remove();
-          const postamble = content.querySelector("#postamble");
-          if (postamble) postamble.remove();
-
-          // Trim the content before extracting headers
-          const cleanContent = content.textContent.replace(/\s+/g, " ").trim();
-
-          // Extract headers with their positions
-          // Cannot directly query the cleanContent as they are strings!
-          const headers = Array.from(
-            content.querySelectorAll("h1, h2, h3, h4, h5, h6"),
-          ).map((header, index) => {
-            const headerText = header.textContent.replace(/\s+/g, " ").trim();
-            let headerIndex = cleanContent.indexOf(headerText);
-
-            if (headerIndex === -1) {
-              console.warn(`Header not found: "${headerText}"`);
-            }
-
-            return {
-              // h1 does not have an id attribute
-              id: header.id, // h1 does not have an id
-              index: headerIndex,
-              text: headerText,
-            };
-          });
-
-          return {
-            url: localUrl,
-            title: title,
-            content: cleanContent,
-            headers: headers,
-          };
-        }),
-      );
+      const response = await fetch("search.json");
+      const index = await response.json();
+
+      // Posts are written in build order; list the newest first. Org
+      // timestamps sort as plain strings.
+      index.sort((a, b) => (a.date < b.date) - (a.date > b.date));
+
+      // Each section starts at a header; join them back into one string
+      // and remember where each header begins.
+      return index.map((post) => {
+        let content = "";
+        const headers = [];
+        post.sections.forEach((section) => {
+          if (content.length > 0) content += " ";
+          if (section.id) {
+            headers.push({ id: section.id, index: content.length });
+          }
+          content += section.text.replace(/\s+/g, " ");
+        });
 
-      return posts;
+        return {
+          url: post.url,
+          title: post.title,
+          content: content,
+          headers: headers,
+        };
+      });
     } catch (error) {
       console.error("Error fetching posts:", error);
       return [];
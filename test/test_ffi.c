@@ -1,7 +1,11 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <assert.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "../include/org-ffi.h"
 
 static void assert_contains(const char *haystack, const char *needle) {
@@ -312,6 +316,19 @@ void test_url_balanced_parentheses(void) {
     printf("  OK\n");
 }
 
+void test_url_in_cjk_text(void) {
+    printf("  test_url_in_cjk_text...");
+
+    char *input = "* 中文\n\n中文内容https://example.com/路径，后续文字 http 不是链接 httpx://no <b>&</b>";
+    char *html = parse_html(input);
+
+    assert_contains(html, "中文内容<a href=\"https://example.com/路径\">https://example.com/路径</a>，后续文字");
+    assert_contains(html, "http 不是链接 httpx://no &lt;b&gt;&amp;&lt;/b&gt;");
+
+    org_free_string(html);
+    printf("  OK\n");
+}
+
 void test_verbatim_url_no_link(void) {
     printf("  test_verbatim_url_no_link...");
 
@@ -345,6 +362,28 @@ void test_verbatim_url_no_link(void) {
     printf("  OK\n");
 }
 
+void test_internal_links(void) {
+    printf("  test_internal_links...");
+
+    char *input = "* Links\n"
+        "[[file:other.org][post]] [[file:other.org::*Some Heading][heading]] "
+        "[[file:dir/other.org::#custom][custom]] [[*Links][here]] [[file:other.org]] "
+        "[[file:img/a.png][file]] [[https://x.org/a.org][web]]\n";
+
+    char *html = parse_html(input);
+    assert_contains(html, "<a href=\"other.html\">post</a>");
+    assert_contains(html, "<a href=\"other.html#some-heading\">heading</a>");
+    assert_contains(html, "<a href=\"dir/other.html#custom\">custom</a>");
+    assert_contains(html, "<a href=\"#links\">here</a>");
+    assert_contains(html, "<a href=\"other.html\">other.org</a>");
+    assert_contains(html, "<a href=\"img/a.png\">file</a>");
+    assert_contains(html, "<a href=\"https://x.org/a.org\">web</a>");
+    assert(strstr(html, "file:") == NULL);
+    org_free_string(html);
+
+    printf("  OK\n");
+}
+
 void test_extract_toc_basic(void) {
     printf("  test_extract_toc_basic...");
 
@@ -443,6 +482,962 @@ void test_toc_and_html_consistency(void) {
     printf("  OK\n");
 }
 
+void test_duplicate_heading_ids(void) {
+    printf("  test_duplicate_heading_ids...");
+
+    char *input = "* Intro\n* Intro\n* Intro 2\n* 中文 标题\n* C++ & Rust!\n* ...";
+
+    OrgDocument *doc = org_document_parse(input, strlen(input));
+    assert(doc != NULL);
+    char *html = org_document_html(doc);
+    char *toc = org_document_toc(doc);
+
+    assert_contains(html, "<h2 id=\"intro\">Intro</h2>");
+    /* "Intro 2" keeps its own slug; the repeated "Intro" skips it. */
+    assert_contains(html, "<h2 id=\"intro-3\">Intro</h2>");
+    assert_contains(html, "<h2 id=\"intro-2\">Intro 2</h2>");
+    assert_contains(html, "id=\"中文-标题\"");
+    assert_contains(html, "id=\"c-rust\"");
+    assert_contains(html, "id=\"section\"");
+
+    assert_contains(toc, "href=\"#intro\">Intro</a>");
+    assert_contains(toc, "href=\"#intro-3\">Intro</a>");
+    assert_contains(toc, "href=\"#intro-2\">Intro 2</a>");
+    assert_contains(toc, "href=\"#中文-标题\"");
+
+    org_free_string(toc);
+    org_free_string(html);
+    org_document_free(doc);
+
+    char *standalone = extract_toc(input);
+    assert_contains(standalone, "href=\"#intro-3\">Intro</a>");
+    org_free_string(standalone);
+
+    /* Suffixes skip every slug a title claims, wherever it appears. */
+    char *repeats = "* Foo\n* Foo\n* Foo 2\n* Foo 2\n* Foo 3";
+    char *claimed = org_parse_to_html(repeats, strlen(repeats));
+    assert_contains(claimed, "<h2 id=\"foo\">Foo</h2>");
+    assert_contains(claimed, "<h2 id=\"foo-4\">Foo</h2>");
+    assert_contains(claimed, "<h2 id=\"foo-2\">Foo 2</h2>");
+    assert_contains(claimed, "<h2 id=\"foo-2-2\">Foo 2</h2>");
+    assert_contains(claimed, "<h2 id=\"foo-3\">Foo 3</h2>");
+    org_free_string(claimed);
+
+    /* A CUSTOM_ID is the headline's id, and no other headline takes it. */
+    char *custom = "* Custom\n* Named\n:PROPERTIES:\n:CUSTOM_ID: custom\n:END:\n";
+    OrgDocument *custom_doc = org_document_parse(custom, strlen(custom));
+    assert(custom_doc != NULL);
+    char *custom_html = org_document_html(custom_doc);
+    char *custom_toc = org_document_toc(custom_doc);
+    assert_contains(custom_html, "<h2 id=\"custom-2\">Custom</h2>");
+    assert_contains(custom_html, "<h2 id=\"custom\">Named</h2>");
+    assert_contains(custom_toc, "href=\"#custom\">Named</a>");
+    org_free_string(custom_toc);
+    org_free_string(custom_html);
+    org_document_free(custom_doc);
+
+    printf("  OK\n");
+}
+
+void test_process_document(void) {
+    printf("  test_process_document...");
+
+    char *input = "#+title: Combined\n#+filetags: a b\n\n* Introduction\n\nText.\n\n** Details\n\nMore.";
+
+    OrgResult result = {0};
+    assert(org_process_document(input, strlen(input), &result) == 0);
+    assert(result.html != NULL);
+    assert(result.toc != NULL);
+    assert(result.meta != NULL);
+
+    char *html = parse_html(input);
+    char *toc = extract_toc(input);
+    assert(strcmp(result.html, html) == 0);
+    assert(strcmp(result.toc, toc) == 0);
+    assert(strcmp(org_meta_get_title(result.meta), "Combined") == 0);
+    assert(strcmp(org_meta_get_tags(result.meta), "a b") == 0);
+
+    org_free_string(html);
+    org_free_string(toc);
+    org_free_result(&result);
+    assert(result.html == NULL && result.toc == NULL && result.meta == NULL);
+
+    assert(org_process_document("", 0, &result) != 0);
+    assert(org_process_document(NULL, 0, &result) != 0);
+    assert(result.html == NULL);
+
+    printf("  OK\n");
+}
+
+void test_parallel_large_document(void) {
+    printf("  test_parallel_large_document...");
+
+    /* Large enough to be exported in sections on several threads */
+    size_t cap = 1024 * 1024, len = 0;
+    char *input = malloc(cap);
+    assert(input != NULL);
+    len += snprintf(input + len, cap - len, "#+title: Large\n\nPreamble.\n\n");
+    for (int i = 0; len < 600 * 1024; i++) {
+        len += snprintf(input + len, cap - len,
+                        "* Chapter %d\n\nSee https://example.com/%d here.\n\n"
+                        "** Notes\n\n#+begin_src c\n* not a headline\n#+end_src\n\n"
+                        "- term :: *bold* and /italic/ text %d\n\n",
+                        i % 50, i, i);
+    }
+    len += snprintf(input + len, cap - len, "#+filetags: big\n");
+
+    /* No threads unless asked for */
+    OrgStats stats;
+    org_reset_stats();
+    OrgResult single = {0};
+    assert(org_process_document(input, len, &single) == 0);
+    org_get_stats(&stats);
+    assert(stats.sections_concurrent <= 1);
+
+    assert(org_set_option(ORG_OPTION_SECTION_THREADS, 1) == 0);
+    org_reset_stats();
+    OrgResult parallel = {0};
+    assert(org_process_document(input, len, &parallel) == 0);
+    assert(org_set_option(ORG_OPTION_SECTION_THREADS, 0) == 0);
+    org_get_stats(&stats);
+    assert(stats.sections_rendered > 1);
+    /* Sections of different workers are exported side by side, not one
+       worker after another */
+    if (sysconf(_SC_NPROCESSORS_ONLN) >= 4) {
+        assert(stats.sections_concurrent >= 2);
+    }
+
+    OrgDocument *doc = org_document_parse(input, len);
+    assert(doc != NULL);
+    OrgResult sequential = {0};
+    assert(org_document_process(doc, &sequential) == 0);
+
+    assert(strcmp(parallel.html, sequential.html) == 0);
+    assert(strcmp(parallel.toc, sequential.toc) == 0);
+    assert(strcmp(single.html, sequential.html) == 0);
+    assert(strcmp(org_meta_get_title(parallel.meta), "Large") == 0);
+    assert(strcmp(org_meta_get_tags(parallel.meta), "big") == 0);
+    assert_contains(parallel.html, "id=\"notes-2\"");
+    assert_contains(parallel.html, "id=\"chapter-0-2\"");
+
+    org_free_result(&sequential);
+    org_free_result(&parallel);
+    org_free_result(&single);
+    org_document_free(doc);
+    free(input);
+
+    printf("  OK\n");
+}
+
+static size_t write_journal(char *buf, size_t cap, int chapters, const char *edit) {
+    size_t len = snprintf(buf, cap, "#+title: Journal\n\nPreamble.\n\n");
+    for (int i = 0; i < chapters; i++) {
+        len += snprintf(buf + len, cap - len, "* Day %d\n\n%s\n\n** Notes\n\n", i % 10,
+                        i == chapters / 2 && edit ? edit : "Nothing new today.");
+        for (int j = 0; j < 12; j++) {
+            len += snprintf(buf + len, cap - len, "- entry %d of day %d, see https://example.com/%d\n", j, i, j);
+        }
+    }
+    return len;
+}
+
+static void assert_matches_sequential(const char *input, size_t len, const OrgResult *result) {
+    OrgDocument *doc = org_document_parse(input, len);
+    assert(doc != NULL);
+    OrgResult sequential = {0};
+    assert(org_document_process(doc, &sequential) == 0);
+    assert(strcmp(result->html, sequential.html) == 0);
+    assert(strcmp(result->toc, sequential.toc) == 0);
+    assert(strcmp(org_meta_get_title(result->meta), org_meta_get_title(sequential.meta)) == 0);
+    org_free_result(&sequential);
+    org_document_free(doc);
+}
+
+void test_section_memo(void) {
+    printf("  test_section_memo...");
+
+    enum { CHAPTERS = 100, SECTIONS = CHAPTERS + 1 };
+    size_t cap = 256 * 1024;
+    char *input = malloc(cap);
+    assert(input != NULL);
+    size_t len = write_journal(input, cap, CHAPTERS, NULL);
+    assert(len > 64 * 1024);
+
+    assert(org_set_cache_dir("build/test-section-cache") == 0);
+    OrgResult result = {0};
+    assert(org_process_document(input, len, &result) == 0);
+    assert_matches_sequential(input, len, &result);
+    org_free_result(&result);
+
+    /* Unchanged: every section comes from the cache */
+    OrgStats stats;
+    org_reset_stats();
+    assert(org_process_document(input, len, &result) == 0);
+    org_get_stats(&stats);
+    assert(stats.sections_rendered == 0);
+    assert(stats.sections_reused == SECTIONS);
+    assert_matches_sequential(input, len, &result);
+    org_free_result(&result);
+
+    /* One paragraph edited: only its section is exported again, unless an
+       earlier run already cached the same edit */
+    char edit[64];
+    snprintf(edit, sizeof(edit), "Edited at %ld.", (long)time(NULL));
+    len = write_journal(input, cap, CHAPTERS, edit);
+    org_reset_stats();
+    assert(org_process_document(input, len, &result) == 0);
+    org_get_stats(&stats);
+    assert(stats.sections_rendered <= 1);
+    assert(stats.sections_rendered + stats.sections_reused == SECTIONS);
+    assert_matches_sequential(input, len, &result);
+    assert_contains(result.html, edit);
+    org_free_result(&result);
+
+    /* A build of only the edited version leaves the old version of that
+       section unused, and pruning removes it but nothing the build used */
+    assert(org_set_cache_dir("build/test-section-cache") == 0);
+    assert(org_process_document(input, len, &result) == 0);
+    org_free_result(&result);
+    assert(org_prune_cache() >= 1);
+    org_reset_stats();
+    assert(org_process_document(input, len, &result) == 0);
+    org_get_stats(&stats);
+    assert(stats.sections_rendered == 0);
+    org_free_result(&result);
+
+    len = write_journal(input, cap, CHAPTERS, NULL);
+    org_reset_stats();
+    assert(org_process_document(input, len, &result) == 0);
+    org_get_stats(&stats);
+    assert(stats.sections_rendered == 1);
+    org_free_result(&result);
+
+    assert(org_set_cache_dir(NULL) == 0);
+    assert(org_prune_cache() == 0);
+    free(input);
+
+    printf("  OK\n");
+}
+
+void test_process_batch(void) {
+    printf("  test_process_batch...");
+
+    enum { BATCH = 24 };
+    char texts[BATCH][128];
+    OrgInput inputs[BATCH] = {{0}};
+    OrgResult results[BATCH];
+
+    for (int i = 0; i < BATCH; i++) {
+        snprintf(texts[i], sizeof(texts[i]), "#+title: Post %d\n\n* Heading %d\n\nBody %d.", i, i, i);
+        inputs[i].data = texts[i];
+        inputs[i].len = strlen(texts[i]);
+    }
+    inputs[5].data = "";
+    inputs[5].len = 0;
+
+    assert(org_process_batch(inputs, BATCH, results, 4) == 1);
+
+    for (int i = 0; i < BATCH; i++) {
+        if (i == 5) {
+            assert(results[i].html == NULL && results[i].toc == NULL && results[i].meta == NULL);
+            continue;
+        }
+
+        OrgResult single = {0};
+        assert(org_process_document(texts[i], strlen(texts[i]), &single) == 0);
+        assert(strcmp(results[i].html, single.html) == 0);
+        assert(strcmp(results[i].toc, single.toc) == 0);
+
+        char title[32];
+        snprintf(title, sizeof(title), "Post %d", i);
+        assert(strcmp(org_meta_get_title(results[i].meta), title) == 0);
+
+        org_free_result(&single);
+        org_free_result(&results[i]);
+    }
+
+    assert(org_process_batch(inputs, 1, results, 0) == 0);
+    org_free_result(&results[0]);
+    assert(org_process_batch(NULL, 0, NULL, 0) == 0);
+
+    printf("  OK\n");
+}
+
+void test_batch_thread_budget(void) {
+    printf("  test_batch_thread_budget...");
+
+    /* One large post per thread leaves no threads for their sections, so
+       each is exported whole on its own worker */
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 2) {
+        printf("  SKIP (single processor)\n");
+        return;
+    }
+
+    size_t cap = 320 * 1024, len = 0;
+    char *input = malloc(cap);
+    assert(input != NULL);
+    for (int i = 0; len < 300 * 1024; i++) {
+        len += snprintf(input + len, cap - len, "* Chapter %d\n\nSome text about chapter %d.\n\n", i, i);
+    }
+
+    OrgInput *inputs = calloc(threads, sizeof(OrgInput));
+    OrgResult *results = calloc(threads, sizeof(OrgResult));
+    assert(inputs != NULL && results != NULL);
+    for (long i = 0; i < threads; i++) {
+        inputs[i].data = input;
+        inputs[i].len = len;
+    }
+
+    OrgStats stats;
+    org_reset_stats();
+    assert(org_process_batch(inputs, threads, results, (int)threads) == 0);
+    org_get_stats(&stats);
+    assert(stats.sections_rendered == 0);
+    assert(stats.documents == (uint64_t)threads);
+
+    for (long i = 0; i < threads; i++) {
+        org_free_result(&results[i]);
+    }
+    free(results);
+    free(inputs);
+    free(input);
+
+    printf("  OK\n");
+}
+
+void test_document_handle(void) {
+    printf("  test_document_handle...");
+
+    char *input = "#+title: Handle\n#+description: kept alive\n\n* Intro\n\nBody text.";
+    OrgDocument *doc = org_document_parse(input, strlen(input));
+    assert(doc != NULL);
+
+    char *html = org_document_html(doc);
+    char *again = org_document_html(doc);
+    char *expected = parse_html(input);
+    assert(strcmp(html, expected) == 0);
+    assert(strcmp(again, expected) == 0);
+
+    char *toc = org_document_toc(doc);
+    assert_contains(toc, "href=\"#intro\"");
+
+    OrgMetadata *meta = org_document_metadata(doc);
+    assert(strcmp(org_meta_get_title(meta), "Handle") == 0);
+    assert(strcmp(org_meta_get_description(meta), "kept alive") == 0);
+
+    OrgResult result = {0};
+    assert(org_document_process(doc, &result) == 0);
+    assert(strcmp(result.html, expected) == 0);
+    assert(strcmp(result.toc, toc) == 0);
+
+    org_free_result(&result);
+    org_free_metadata(meta);
+    org_free_string(toc);
+    org_free_string(expected);
+    org_free_string(again);
+    org_free_string(html);
+    org_document_free(doc);
+
+    assert(org_document_parse("", 0) == NULL);
+    assert(org_document_html(NULL) == NULL);
+    assert(org_document_process(NULL, &result) != 0);
+    org_document_free(NULL);
+
+    printf("  OK\n");
+}
+
+void test_length_bounded_input(void) {
+    printf("  test_length_bounded_input...");
+
+    /* Not null-terminated: only the first len bytes belong to the document. */
+    const char buffer[] = {'*', ' ', 'B', 'o', 'u', 'n', 'd', 'e', 'd', '\n', '*', ' ', 'X'};
+    char *html = org_parse_to_html(buffer, 9);
+    assert(html != NULL);
+    assert_contains(html, "Bounded");
+    assert(strstr(html, "X") == NULL);
+    org_free_string(html);
+
+    /* Embedded NUL does not truncate the document. */
+    const char with_nul[] = "#+title: Nul\n\nbefore\0after\n\n* Tail";
+    html = org_parse_to_html(with_nul, sizeof(with_nul) - 1);
+    assert(html != NULL);
+    assert_contains(html, "before");
+    assert_contains(html, "after");
+    assert_contains(html, "Tail");
+    org_free_string(html);
+
+    OrgMetadata *meta = org_extract_metadata(with_nul, sizeof(with_nul) - 1);
+    assert(meta != NULL);
+    assert(strcmp(org_meta_get_title(meta), "Nul") == 0);
+    org_free_metadata(meta);
+
+    /* Invalid UTF-8 is rejected. */
+    const char invalid[] = {'*', ' ', (char)0xff, (char)0xfe};
+    assert(org_parse_to_html(invalid, sizeof(invalid)) == NULL);
+
+    printf("  OK\n");
+}
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    int calls;
+} ChunkBuffer;
+
+static int append_chunk(void *userdata, const char *data, size_t len) {
+    ChunkBuffer *buf = userdata;
+    if (buf->len + len + 1 > buf->cap) {
+        buf->cap = (buf->len + len + 1) * 2;
+        buf->data = realloc(buf->data, buf->cap);
+        assert(buf->data != NULL);
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+    buf->calls++;
+    return 0;
+}
+
+static int failing_chunk(void *userdata, const char *data, size_t len) {
+    (void)userdata;
+    (void)data;
+    (void)len;
+    return 1;
+}
+
+void test_streaming_export(void) {
+    printf("  test_streaming_export...");
+
+    char *input = "#+title: Stream\n\n* Streamed\n\nBody with https://example.com link.";
+    char *expected = parse_html(input);
+
+    ChunkBuffer buf = {0};
+    assert(org_write_html(input, strlen(input), append_chunk, &buf) == 0);
+    assert(strcmp(buf.data, expected) == 0);
+    free(buf.data);
+
+    OrgDocument *doc = org_document_parse(input, strlen(input));
+    memset(&buf, 0, sizeof(buf));
+    OrgResult result = {0};
+    assert(org_document_process_to(doc, append_chunk, &buf, &result) == 0);
+    assert(result.html == NULL);
+    assert(result.toc != NULL);
+    assert(strcmp(org_meta_get_title(result.meta), "Stream") == 0);
+    assert(strcmp(buf.data, expected) == 0);
+    free(buf.data);
+    org_free_result(&result);
+
+    assert(org_document_write_html(doc, failing_chunk, NULL) != 0);
+    assert(org_document_write_html(doc, NULL, NULL) != 0);
+    org_document_free(doc);
+    org_free_string(expected);
+
+    /* Large documents arrive in several chunks but match the one-shot export. */
+    size_t para_count = 4000;
+    const char *para = "Paragraph text that is long enough to fill the buffer.\n\n";
+    size_t big_len = para_count * strlen(para) + 16;
+    char *big = malloc(big_len);
+    strcpy(big, "* Big\n\n");
+    char *end = big + strlen(big);
+    for (size_t i = 0; i < para_count; i++) {
+        memcpy(end, para, strlen(para));
+        end += strlen(para);
+    }
+    *end = '\0';
+    expected = parse_html(big);
+    memset(&buf, 0, sizeof(buf));
+    assert(org_write_html(big, strlen(big), append_chunk, &buf) == 0);
+    assert(buf.calls > 1);
+    assert(strcmp(buf.data, expected) == 0);
+    free(buf.data);
+    org_free_string(expected);
+    free(big);
+
+    printf("  OK\n");
+}
+
+void test_scan_header(void) {
+    printf("  test_scan_header...");
+
+    char *input = "# leading comment\n"
+        "#+TITLE: Scanned Title\n"
+        "#+date: <2024-01-02 Tue 10:00>\n"
+        "\n"
+        "#+description:   padded description  \n"
+        "#+filetags: one two three\n"
+        "* Heading\n"
+        "#+title: Not This One\n";
+
+    OrgMetadata *scanned = org_scan_header(input, strlen(input));
+    OrgMetadata *parsed = org_extract_metadata(input, strlen(input));
+    assert(scanned != NULL && parsed != NULL);
+
+    assert(strcmp(org_meta_get_title(scanned), "Scanned Title") == 0);
+    assert(strcmp(org_meta_get_title(scanned), org_meta_get_title(parsed)) == 0);
+    assert(strcmp(org_meta_get_date(scanned), org_meta_get_date(parsed)) == 0);
+    assert(strcmp(org_meta_get_description(scanned), "padded description") == 0);
+    assert(strcmp(org_meta_get_tags(scanned), org_meta_get_tags(parsed)) == 0);
+
+    size_t count;
+    assert(org_meta_get_tags_array(scanned, &count) != NULL);
+    assert(count == 3);
+
+    org_free_metadata(scanned);
+    org_free_metadata(parsed);
+
+    char *late = "Some text first.\n#+title: Too Late\n";
+    scanned = org_scan_header(late, strlen(late));
+    assert(scanned != NULL);
+    assert(org_meta_get_title(scanned) == NULL);
+    org_free_metadata(scanned);
+
+    assert(org_scan_header("", 0) == NULL);
+
+    printf("  OK\n");
+}
+
+void test_escape_html(void) {
+    printf("  test_escape_html...");
+
+    ChunkBuffer buf = {0};
+    const char *input = "Tom & Jerry's <\"chase\"> 中文 plain tail that is longer than sixteen bytes";
+    assert(org_escape_html(input, strlen(input), append_chunk, &buf) == 0);
+    assert(strcmp(buf.data, "Tom &amp; Jerry&#39;s &lt;&quot;chase&quot;&gt; 中文 plain tail that is longer than sixteen bytes") == 0);
+    free(buf.data);
+
+    memset(&buf, 0, sizeof(buf));
+    const char *clean = "nothing to escape here";
+    assert(org_escape_html(clean, strlen(clean), append_chunk, &buf) == 0);
+    assert(strcmp(buf.data, clean) == 0);
+    assert(buf.calls == 1);
+    free(buf.data);
+
+    /* Each clean span and each entity goes to the sink as it is */
+    memset(&buf, 0, sizeof(buf));
+    assert(org_escape_html("a<b", 3, append_chunk, &buf) == 0);
+    assert(strcmp(buf.data, "a&lt;b") == 0);
+    assert(buf.calls == 3);
+    free(buf.data);
+
+    memset(&buf, 0, sizeof(buf));
+    assert(org_escape_html("", 0, append_chunk, &buf) == 0);
+    assert(buf.data == NULL);
+
+    assert(org_escape_html("<b>", 3, NULL, NULL) != 0);
+    /* Not UTF-8: escaped all the same, never passed through verbatim */
+    assert(org_escape_html("\xff<\"", 3, append_chunk, &buf) == 0);
+    assert(strcmp(buf.data, "\xff&lt;&quot;") == 0);
+    free(buf.data);
+
+    printf("  OK\n");
+}
+
+void test_source_highlighting(void) {
+    printf("  test_source_highlighting...");
+
+    char *input = "#+begin_src rust\n"
+        "fn main() { let s = \"<x>\"; // done\n}\n"
+        "#+end_src\n\n"
+        "#+begin_src unknown-lang\n"
+        "fn main() {}\n"
+        "#+end_src";
+
+    assert(org_set_option(ORG_OPTION_HIGHLIGHT, 1) == 0);
+    char *html = parse_html(input);
+    assert_contains(html, "<pre class=\"src src-rust\"><span class=\"hljs-keyword\">fn</span> "
+        "<span class=\"hljs-title function_\">main</span>()");
+    assert_contains(html, "<span class=\"hljs-string\">&quot;&lt;x&gt;&quot;</span>");
+    assert_contains(html, "<span class=\"hljs-comment\">// done</span>");
+    assert_contains(html, "<pre class=\"src src-unknown-lang\">fn main() {}");
+    org_free_string(html);
+
+    assert(org_set_option(ORG_OPTION_HIGHLIGHT, 0) == 0);
+    html = parse_html(input);
+    assert(strstr(html, "hljs-") == NULL);
+    org_free_string(html);
+
+    assert(org_set_option((OrgOption)99, 1) != 0);
+    assert(org_set_cache_dir("") != 0);
+    assert(org_set_cache_dir(NULL) == 0);
+
+    printf("  OK\n");
+}
+
+void test_latex_mathml(void) {
+    printf("  test_latex_mathml...");
+
+    char *input = "* Math\n\nInline \\(x^2 \\le \\alpha\\) and \\(\\unsupported{y}\\) here.";
+
+    char *html = parse_html(input);
+    assert_contains(html, "\\(x^2 \\le \\alpha\\)");
+    org_free_string(html);
+
+    assert(org_set_option(ORG_OPTION_MATHML, 1) == 0);
+    html = parse_html(input);
+    assert_contains(html, "<math display=\"inline\"><semantics><mrow><msup><mi>x</mi><mn>2</mn></msup><mo>≤</mo><mi>α</mi></mrow>");
+    assert_contains(html, "\\(\\unsupported{y}\\)");
+    org_free_string(html);
+    assert(org_set_option(ORG_OPTION_MATHML, 0) == 0);
+
+    printf("  OK\n");
+}
+
+static int find_node(const OrgAst *ast, OrgNodeKind kind) {
+    for (size_t i = 0; i < ast->count; i++) {
+        if (ast->nodes[i].kind == kind) return (int)i;
+    }
+    return -1;
+}
+
+static int node_text_is(const char *input, const OrgNode *node, const char *expected) {
+    return node->len == strlen(expected) && memcmp(input + node->offset, expected, node->len) == 0;
+}
+
+void test_ast_flat(void) {
+    printf("  test_ast_flat...");
+
+    char *input = "#+TITLE: T\n\n* Head\nSome *bold* text and [[https://x.org][a link]].\n** Sub\n";
+    OrgAst ast;
+    assert(org_ast_build(input, strlen(input), &ast) == 0);
+    assert(ast.count > 0);
+
+    assert(ast.nodes[0].kind == ORG_NODE_DOCUMENT);
+    assert(ast.nodes[0].parent == ORG_NODE_NONE);
+    assert(ast.nodes[0].offset == 0 && ast.nodes[0].len == strlen(input));
+
+    for (size_t i = 1; i < ast.count; i++) {
+        const OrgNode *node = &ast.nodes[i];
+        assert(node->parent < i);
+        assert(node->offset >= ast.nodes[node->parent].offset);
+        assert(node->offset + node->len <= ast.nodes[node->parent].offset + ast.nodes[node->parent].len);
+        if (node->next_sibling != ORG_NODE_NONE) {
+            assert(node->next_sibling > i);
+            assert(ast.nodes[node->next_sibling].parent == node->parent);
+        }
+    }
+
+    int head = find_node(&ast, ORG_NODE_HEADLINE);
+    assert(head > 0 && ast.nodes[head].level == 1);
+    assert(memcmp(input + ast.nodes[head].offset, "* Head", 6) == 0);
+
+    int bold = find_node(&ast, ORG_NODE_BOLD);
+    assert(bold > head && node_text_is(input, &ast.nodes[bold], "*bold*"));
+    assert(ast.nodes[bold + 1].kind == ORG_NODE_TEXT && ast.nodes[bold + 1].parent == (uint32_t)bold);
+    assert(node_text_is(input, &ast.nodes[bold + 1], "bold"));
+
+    int link = find_node(&ast, ORG_NODE_LINK);
+    assert(link > bold && node_text_is(input, &ast.nodes[link], "[[https://x.org][a link]]"));
+
+    int sub = -1;
+    for (size_t i = (size_t)head + 1; i < ast.count; i++) {
+        if (ast.nodes[i].kind == ORG_NODE_HEADLINE) { sub = (int)i; break; }
+    }
+    assert(sub > link && ast.nodes[sub].level == 2);
+    assert(ast.nodes[sub].parent == (uint32_t)head);
+
+    int keyword = find_node(&ast, ORG_NODE_KEYWORD);
+    assert(keyword > 0 && keyword < head);
+
+    assert(strcmp(org_node_kind_name(ORG_NODE_SOURCE_BLOCK), "source-block") == 0);
+    assert(org_node_kind_name((OrgNodeKind)1000) == NULL);
+
+    OrgDocument *doc = org_document_parse(input, strlen(input));
+    OrgAst again;
+    assert(org_document_ast(doc, &again) == 0);
+    assert(again.count == ast.count);
+    assert(memcmp(again.nodes, ast.nodes, ast.count * sizeof(OrgNode)) == 0);
+    org_free_ast(&again);
+    org_document_free(doc);
+
+    org_free_ast(&ast);
+    assert(ast.nodes == NULL && ast.count == 0);
+    org_free_ast(NULL);
+
+    assert(org_ast_build("", 0, &ast) != 0);
+    assert(ast.nodes == NULL && ast.count == 0);
+
+    printf("  OK\n");
+}
+
+void test_extract_text(void) {
+    printf("  test_extract_text...");
+
+    char *input = "#+TITLE: T\n\nIntro *bold* text, [[https://x.org][a link]] and [[https://y.org]].\n\n"
+        "* Head\nBody &alpha; one.\n#+begin_src c\nint x;\n#+end_src\n# comment\n** Head\nMore.\n";
+    OrgText text;
+    assert(org_extract_text(input, strlen(input), 0, &text) == 0);
+    assert(text.len == strlen(text.text));
+    assert(strncmp(text.text, "Intro bold text, a link and https://y.org.\nHead\nBody \xCE\xB1 one.", 60) == 0);
+    assert_contains(text.text, "int x;");
+    assert(strstr(text.text, "TITLE") == NULL && strstr(text.text, "comment") == NULL);
+    assert(strstr(text.text, "*") == NULL && strstr(text.text, "[[") == NULL);
+
+    assert(text.heading_count == 2);
+    assert(strcmp(text.headings[0].id, "head") == 0);
+    assert(strcmp(text.headings[1].id, "head-2") == 0);
+    assert(strncmp(text.text + text.headings[0].offset, "Head\nBody", 9) == 0);
+    assert(strcmp(text.text + text.headings[1].offset, "Head\nMore.") == 0);
+    assert(text.text[text.headings[1].offset - 1] == '\n');
+    org_free_text(&text);
+    assert(text.text == NULL && text.headings == NULL && text.heading_count == 0);
+
+    assert(org_extract_text(input, strlen(input), ORG_TEXT_SKIP_SOURCE, &text) == 0);
+    assert(strstr(text.text, "int x;") == NULL);
+    assert_contains(text.text, "one.\nHead\nMore.");
+    org_free_text(&text);
+
+    /* Ids agree with the document's HTML and with the combined result */
+    OrgDocument *doc = org_document_parse(input, strlen(input));
+    assert(doc != NULL);
+    assert(org_document_text(doc, 0, &text) == 0);
+    char *html = org_document_html(doc);
+    assert_contains(html, "id=\"head-2\"");
+    assert(strcmp(text.headings[1].id, "head-2") == 0);
+    org_free_string(html);
+    org_free_text(&text);
+    org_document_free(doc);
+
+    OrgResult result;
+    assert(org_process_document(input, strlen(input), &result) == 0);
+    assert(result.text.text == NULL && result.text.heading_count == 0);
+    org_free_result(&result);
+
+    assert(org_set_option(ORG_OPTION_RESULT_TEXT, 1) == 0);
+    assert(org_process_document(input, strlen(input), &result) == 0);
+    assert(org_extract_text(input, strlen(input), 0, &text) == 0);
+    assert(result.text.len == text.len && strcmp(result.text.text, text.text) == 0);
+    assert(result.text.heading_count == 2);
+    org_free_text(&text);
+    org_free_result(&result);
+    assert(result.text.text == NULL);
+    assert(org_set_option(ORG_OPTION_RESULT_TEXT, 0) == 0);
+
+    assert(org_extract_text(NULL, 0, 0, &text) != 0);
+    assert(text.text == NULL && text.headings == NULL);
+
+    printf("  OK\n");
+}
+
+void test_cjk_spacing(void) {
+    printf("  test_cjk_spacing...");
+
+    char *input = "#+title: 使用Rust编写\n\n"
+        "* 中文English标题\n"
+        "在Linux上运行3个*测试*用例，见https://example.com/路径 说明。\n"
+        "代码=a中b=和~x2~不变，*粗体*English也加空格。";
+
+    assert(org_set_option(ORG_OPTION_CJK_SPACING, 1) == 0);
+    char *html = parse_html(input);
+    assert_contains(html, ">中文 English 标题</h2>");
+    assert_contains(html, "在 Linux 上运行 3 个<b>测试</b>用例");
+    assert_contains(html, "见 <a href=\"https://example.com/路径\">");
+    assert_contains(html, "<code>a中b</code>");
+    assert_contains(html, "<code>x2</code>");
+    assert_contains(html, "<b>粗体</b> English 也加空格");
+    org_free_string(html);
+
+    char *toc = extract_toc(input);
+    assert_contains(toc, ">中文 English 标题</a>");
+    org_free_string(toc);
+
+    OrgMetadata *meta = org_extract_metadata(input, strlen(input));
+    assert(strcmp(org_meta_get_title(meta), "使用 Rust 编写") == 0);
+    org_free_metadata(meta);
+
+    /* Unhighlighted source blocks reach the prose path but stay as written */
+    char *code = "#+begin_src python\nprint('中文abc')  # 见https://example.com/路径\n#+end_src\n\n"
+        "#+begin_src\n运行3个test\n#+end_src\n";
+    assert(org_set_option(ORG_OPTION_HIGHLIGHT, 0) == 0);
+    html = parse_html(code);
+    assert_contains(html, "print(&#39;中文abc&#39;)  # 见");
+    assert_contains(html, "运行3个test");
+    assert(strstr(html, "中文 abc") == NULL);
+    assert(strstr(html, "见 ") == NULL);
+    org_free_string(html);
+
+    assert(org_set_option(ORG_OPTION_CJK_SPACING, 0) == 0);
+    html = parse_html(input);
+    assert_contains(html, "在Linux上运行3个");
+    org_free_string(html);
+
+    printf("  OK\n");
+}
+
+void test_heading_anchors(void) {
+    printf("  test_heading_anchors...");
+
+    char *input = "* Intro *bold* & more\n** Details\n*** Deep\n**** Deeper\n";
+
+    assert(org_set_option(ORG_OPTION_HEADING_ANCHORS, 1) == 0);
+    char *html = parse_html(input);
+    assert_contains(html, "<div class=\"heading-wrapper\"><h2 id=\"intro-bold-more\">Intro <b>bold</b> &amp; more</h2>"
+        "<a class=\"heading-anchor\" href=\"#intro-bold-more\" aria-label=\"Link to Intro bold &amp; more\">#</a></div>");
+    assert_contains(html, "<div class=\"heading-wrapper\"><h3 id=\"details\">Details</h3>"
+        "<a class=\"heading-anchor\" href=\"#details\" aria-label=\"Link to Details\">#</a></div>");
+    assert_contains(html, "<div class=\"heading-wrapper\"><h4 id=\"deep\">");
+    assert_contains(html, "<h5 id=\"deeper\">Deeper</h5>");
+    assert(strstr(html, "<div class=\"heading-wrapper\"><h5") == NULL);
+    org_free_string(html);
+
+    assert(org_set_option(ORG_OPTION_HEADING_ANCHORS, 0) == 0);
+    html = parse_html(input);
+    assert(strstr(html, "heading-wrapper") == NULL);
+    org_free_string(html);
+
+    printf("  OK\n");
+}
+
+void test_code_decorations(void) {
+    printf("  test_code_decorations...");
+
+    char input[4096] = "#+begin_src python\nprint('中文abc')\n#+end_src\n\n"
+        "#+begin_src\nplain\n#+end_src\n\n#+begin_src nil\nx\n#+end_src\n\n#+begin_src c\n";
+    for (int i = 0; i < 60; i++) {
+        strcat(input, "line();\n");
+    }
+    strcat(input, "#+end_src\n");
+
+    assert(org_set_option(ORG_OPTION_CODE_DECORATIONS, 1) == 0);
+    char *html = parse_html(input);
+    assert_contains(html, "<div class=\"org-src-container\"><pre class=\"src src-python\" data-lang=\"python\">");
+    assert_contains(html, "中文abc");
+    assert_contains(html, "</pre><button type=\"button\" class=\"copy-button\">Copy</button></div>");
+    assert_contains(html, "<pre class=\"src\" data-lang=\"code\">plain");
+    assert_contains(html, "<pre class=\"src src-nil\" data-lang=\"code\">");
+    assert_contains(html, "</pre><div class=\"expand-wrapper\"><span class=\"code-ellipsis\">...</span>"
+        "<button type=\"button\" class=\"toggle-button\">Expand</button></div>"
+        "<button type=\"button\" class=\"copy-button\">Copy</button></div>");
+    /* Only the 60-line block is long enough to collapse */
+    const char *first = strstr(html, "toggle-button");
+    assert(first != NULL && strstr(first + 1, "toggle-button") == NULL);
+    org_free_string(html);
+
+    assert(org_set_option(ORG_OPTION_CODE_DECORATIONS, 0) == 0);
+    html = parse_html(input);
+    assert_contains(html, "<pre class=\"src src-python\">");
+    assert(strstr(html, "data-lang") == NULL);
+    assert(strstr(html, "<button") == NULL);
+    org_free_string(html);
+
+    printf("  OK\n");
+}
+
+static void write_gif(const char *path, unsigned char width, unsigned char height) {
+    /* Only the header is ever read */
+    unsigned char gif[] = {'G', 'I', 'F', '8', '9', 'a', width, 0, height, 0, 0x80, 0, 0};
+    FILE *f = fopen(path, "wb");
+    assert(f != NULL);
+    fwrite(gif, 1, sizeof(gif), f);
+    fclose(f);
+}
+
+void test_image_hints(void) {
+    printf("  test_image_hints...");
+
+    /* Same file name at the top level and in a subdirectory, as with a
+       post in posts/sub/ whose page and images go to output/sub/ */
+    mkdir("build/test-images", 0755);
+    write_gif("build/test-image.gif", 12, 34);
+    write_gif("build/test-images/test-image.gif", 56, 78);
+
+    const char *input = "[[file:test-image.gif]]\n\n"
+        "#+ATTR_HTML: :width 100 :loading eager\n[[file:test-image.gif]]\n\n"
+        "[[file:missing.png]]\n";
+    OrgInput inputs[4] = {
+        { input, strlen(input), "build" },
+        { input, strlen(input), "build/test-images" },
+        { input, strlen(input), NULL },
+        { input, strlen(input), "build/no-such-dir:build/test-images" },
+    };
+    OrgResult results[4];
+
+    assert(org_set_option(ORG_OPTION_IMAGE_HINTS, 1) == 0);
+    assert(org_process_batch(inputs, 4, results, 0) == 0);
+    const char *html = results[0].html;
+    assert_contains(html, "<img src=\"test-image.gif\" width=\"12\" height=\"34\" loading=\"lazy\" decoding=\"async\">");
+    /* #+ATTR_HTML wins over probed and default values */
+    const char *sized = strstr(html, "width=\"100\"");
+    assert(sized != NULL && strstr(sized, "loading=\"eager\"") != NULL);
+    assert(strstr(strstr(html, "height=\"34\"") + 1, "height=\"34\"") == NULL);
+    assert_contains(html, "<img src=\"missing.png\" loading=\"lazy\" decoding=\"async\">");
+    /* Each page's images are sized from its own directory */
+    assert_contains(results[1].html, "<img src=\"test-image.gif\" width=\"56\" height=\"78\"");
+    assert(strstr(results[1].html, "height=\"34\"") == NULL);
+    /* No directory: lazy loading only */
+    assert_contains(results[2].html, "<img src=\"test-image.gif\" loading=\"lazy\" decoding=\"async\">");
+    /* A list of directories is searched in order */
+    assert_contains(results[3].html, "<img src=\"test-image.gif\" width=\"56\" height=\"78\"");
+    for (int i = 0; i < 4; i++) {
+        org_free_result(&results[i]);
+    }
+
+    /* Handles take the directories from a setter; one-shot calls never size */
+    OrgDocument *doc = org_document_parse(input, strlen(input));
+    assert(doc != NULL);
+    char *unsized = org_document_html(doc);
+    assert_contains(unsized, "<img src=\"test-image.gif\" loading=\"lazy\"");
+    org_free_string(unsized);
+    assert(org_document_set_image_dir(doc, "build") == 0);
+    assert(org_document_set_image_dir(NULL, "build") != 0);
+    assert(org_document_set_image_dir(doc, "") != 0);
+    char *handle_html = org_document_html(doc);
+    assert_contains(handle_html, "<img src=\"test-image.gif\" width=\"12\" height=\"34\"");
+    org_free_string(handle_html);
+    OrgResult handle_result;
+    assert(org_document_process(doc, &handle_result) == 0);
+    assert_contains(handle_result.html, "<img src=\"test-image.gif\" width=\"12\" height=\"34\"");
+    org_free_result(&handle_result);
+    org_document_free(doc);
+
+    assert(org_set_option(ORG_OPTION_IMAGE_HINTS, 0) == 0);
+    char *plain = parse_html(input);
+    assert_contains(plain, "<img src=\"test-image.gif\">");
+    assert(strstr(plain, "loading=\"lazy\"") == NULL);
+    org_free_string(plain);
+
+    remove("build/test-images/test-image.gif");
+    remove("build/test-images");
+    remove("build/test-image.gif");
+    printf("  OK\n");
+}
+
+void test_stats(void) {
+    printf("  test_stats...");
+
+    char *input = "#+TITLE: Stats\n\n* One\nBody text.\n** Two\nMore.";
+    OrgStats stats;
+
+    org_reset_stats();
+    org_get_stats(&stats);
+    assert(stats.documents == 0 && stats.bytes_in == 0 && stats.bytes_out == 0);
+
+    assert(org_set_option(ORG_OPTION_STAGE_TIMING, 1) == 0);
+    OrgResult result;
+    assert(org_process_document(input, strlen(input), &result) == 0);
+    assert(org_set_option(ORG_OPTION_STAGE_TIMING, 0) == 0);
+
+    org_get_stats(&stats);
+    assert(stats.documents == 1);
+    assert(stats.bytes_in == strlen(input));
+    assert(stats.bytes_out >= strlen(result.html) + strlen(result.toc));
+    assert(stats.output_allocations >= 3);
+    assert(stats.parse_ns > 0);
+    assert(stats.traverse_ns > 0);
+    assert(stats.html_ns > 0 && stats.toc_ns > 0);
+    assert(stats.html_ns + stats.toc_ns + stats.meta_ns <= stats.traverse_ns);
+    org_free_result(&result);
+
+    org_reset_stats();
+    org_get_stats(&stats);
+    assert(stats.documents == 0 && stats.parse_ns == 0 && stats.traverse_ns == 0);
+    assert(stats.html_ns == 0 && stats.output_allocations == 0);
+    org_get_stats(NULL);
+
+    printf("  OK\n");
+}
+
 int main(void) {
     printf("Running Rust FFI Tests\n");
     printf("======================\n\n");
@@ -460,12 +1455,34 @@ int main(void) {
     test_body_extraction();
     test_url_punctuation();
     test_url_balanced_parentheses();
+    test_url_in_cjk_text();
     test_verbatim_url_no_link();
+    test_internal_links();
     test_extract_toc_basic();
     test_extract_toc_nested();
     test_extract_toc_empty();
     test_html_with_ids();
     test_toc_and_html_consistency();
+    test_duplicate_heading_ids();
+    test_process_document();
+    test_parallel_large_document();
+    test_section_memo();
+    test_process_batch();
+    test_batch_thread_budget();
+    test_document_handle();
+    test_length_bounded_input();
+    test_streaming_export();
+    test_scan_header();
+    test_escape_html();
+    test_source_highlighting();
+    test_latex_mathml();
+    test_cjk_spacing();
+    test_heading_anchors();
+    test_code_decorations();
+    test_image_hints();
+    test_stats();
+    test_ast_flat();
+    test_extract_text();
 
     printf("\nAll tests passed!\n");
     return 0;
@@ -75,7 +75,7 @@ void test_generated_page_structure(void) {
     assert(strstr(content, "shiba.js") != NULL);
     assert(strstr(content, "copyCode.js") != NULL);
     assert(strstr(content, "search.js") != NULL);
-    assert(strstr(content, "pangu") != NULL);
+    assert(strstr(content, "pangu") == NULL); /* CJK spacing is done at build time */
     printf(" OK\n");
 
     printf("  Checking top link button...");
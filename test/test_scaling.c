@@ -0,0 +1,169 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include "../include/org-ffi.h"
+#include "template.h"
+#include "org-string.h"
+
+/* Each case runs at a small and a large size. Runtime may grow by at most
+ * SLOWDOWN times the growth in size, plus SLACK_SECONDS for timer noise on
+ * the small run, before the case counts as super-linear. */
+#define SLOWDOWN 3.0
+#define SLACK_SECONDS 0.05
+#define RUNS 3
+
+#define SMALL_DOC (1024 * 1024)
+#define LARGE_DOC (10 * 1024 * 1024)
+#define SMALL_VARS 10000
+#define LARGE_VARS 100000
+
+typedef void (*ScalingCase)(size_t size);
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Best of RUNS, so one descheduled run does not fail the test. */
+static double best_time(ScalingCase run, size_t size) {
+    double best = -1;
+    for (int i = 0; i < RUNS; i++) {
+        double start = now();
+        run(size);
+        double elapsed = now() - start;
+        if (best < 0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+static void assert_linear(const char *name, ScalingCase run, size_t small, size_t large) {
+    double small_time = best_time(run, small);
+    double large_time = best_time(run, large);
+    double limit = small_time * ((double)large / small) * SLOWDOWN + SLACK_SECONDS;
+
+    printf("  %-28s %9zu: %8.3fs  %9zu: %8.3fs  (limit %.3fs)\n",
+           name, small, small_time, large, large_time, limit);
+    if (large_time > limit) {
+        printf("FAIL: %s grows faster than linearly\n", name);
+        exit(1);
+    }
+}
+
+/* `size` bytes of `unit` repeated, cut at a unit boundary. */
+static char *repeat(const char *unit, size_t size) {
+    size_t unit_len = strlen(unit);
+    size_t count = size / unit_len;
+    char *out = malloc(count * unit_len + 1);
+    assert(out != NULL);
+    for (size_t i = 0; i < count; i++) {
+        memcpy(out + i * unit_len, unit, unit_len);
+    }
+    out[count * unit_len] = '\0';
+    return out;
+}
+
+static void parse_repeated(const char *unit, size_t size) {
+    char *input = repeat(unit, size);
+    char *html = org_parse_to_html(input, strlen(input));
+    assert(html != NULL);
+    org_free_string(html);
+    free(input);
+}
+
+static void dense_urls(size_t size) {
+    parse_repeated("see http://example.com/a(b)c, https://x.org/p?q=1. and http://n \n", size);
+}
+
+/* Candidates whose bodies are all trailing punctuation or unbalanced
+ * parentheses, which the URL scan must not revisit. */
+static void url_punctuation(size_t size) {
+    parse_repeated("http://.,;:!?.,;:!? https://((((((((x http:// http:/ httphttp\n", size);
+}
+
+static void attr_html_lines(size_t size) {
+    parse_repeated("#+attr_html: :class \"a b\" :width 10 :alt \"x \"\"y\"\" z\" :data-x :style \"c: d\"\n"
+                   "[[file:a.png]]\n\n", size);
+}
+
+static Template *template_from(const char *content) {
+    FILE *f = fopen("/tmp/test_scaling.html", "w");
+    assert(f != NULL);
+    fputs(content, f);
+    fclose(f);
+
+    Template *t = template_create("/tmp/test_scaling.html", "/tmp");
+    assert(t != NULL);
+    return t;
+}
+
+static void render_and_free(Template *t) {
+    String *output = string_create(t->content->len + 1);
+    template_render(t, output);
+    string_free(output);
+    template_free(t);
+}
+
+/* Sets `count` distinct variables and renders a reference to each. */
+static void many_vars(size_t count) {
+    String *content = string_create(count * 16);
+    char key[32];
+    for (size_t i = 0; i < count; i++) {
+        snprintf(key, sizeof(key), "{{var%zu}}", i);
+        string_append_cstr(content, key);
+    }
+    Template *t = template_from(content->data);
+    string_free(content);
+
+    for (size_t i = 0; i < count; i++) {
+        snprintf(key, sizeof(key), "var%zu", i);
+        template_set_var(t, key, "v");
+    }
+    render_and_free(t);
+}
+
+static void unclosed_vars(size_t size) {
+    char *content = repeat("{{a ", size);
+    Template *t = template_from(content);
+    free(content);
+    render_and_free(t);
+}
+
+static void unclosed_includes(size_t size) {
+    char *content = repeat("{{include x ", size);
+    Template *t = template_from(content);
+    free(content);
+    render_and_free(t);
+}
+
+static void many_includes(size_t size) {
+    FILE *f = fopen("/tmp/test_scaling_part.html", "w");
+    assert(f != NULL);
+    fputs("<p>part</p>", f);
+    fclose(f);
+
+    char *content = repeat("text {{include test_scaling_part.html}} ", size);
+    Template *t = template_from(content);
+    free(content);
+    render_and_free(t);
+}
+
+int main(void) {
+    printf("Running scaling tests...\n");
+
+    assert_linear("dense URLs", dense_urls, SMALL_DOC, LARGE_DOC);
+    assert_linear("URL punctuation", url_punctuation, SMALL_DOC, LARGE_DOC);
+    assert_linear("attr_html lines", attr_html_lines, SMALL_DOC, LARGE_DOC);
+    assert_linear("template variables", many_vars, SMALL_VARS, LARGE_VARS);
+    assert_linear("unclosed variables", unclosed_vars, SMALL_DOC, LARGE_DOC);
+    assert_linear("unclosed includes", unclosed_includes, SMALL_DOC, LARGE_DOC);
+    assert_linear("includes", many_includes, SMALL_DOC, LARGE_DOC);
+
+    remove("/tmp/test_scaling.html");
+    remove("/tmp/test_scaling_part.html");
+    printf("All scaling tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,287 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "site-builder/site-builder.h"
+#include "site-builder/post-management.h"
+#include "site-builder/search-index.h"
+#include "site-builder/link-check.h"
+
+static void assert_contains(const char *haystack, const char *needle) {
+    if (!haystack || !strstr(haystack, needle)) {
+        fprintf(stderr, "\n    expected to find: %s\n    in: %s\n", needle, haystack ? haystack : "(null)");
+        assert(0);
+    }
+}
+
+static char *read_file(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *content = malloc(size + 1);
+    assert(content != NULL);
+    size_t read_size = fread(content, 1, size, f);
+    content[read_size] = '\0';
+    fclose(f);
+    return content;
+}
+
+static void write_file(const char *dir, const char *name, const char *content) {
+    char *path = join_path(dir, name);
+    FILE *f = fopen(path, "wb");
+    assert(f != NULL);
+    fputs(content, f);
+    fclose(f);
+    free(path);
+}
+
+/* A site built from scratch: its posts live in a fresh temporary directory
+ * and its output directory does not exist before the build. The
+ * repository's own templates are used. */
+typedef struct {
+    char root[32];
+    char *posts;
+    SiteBuilder builder;
+} TestSite;
+
+static void site_init(TestSite *site) {
+    strcpy(site->root, "/tmp/test_site_XXXXXX");
+    assert(mkdtemp(site->root) != NULL);
+    site->posts = join_path(site->root, "posts");
+    mkdir_p(site->posts);
+
+    SiteBuilder builder = {
+        .input_dir = site->posts,
+        .output_dir = join_path(site->root, "blog"),
+        .template_dir = "templates",
+        .site_title = "Test Site",
+        .blog_base_url = "https://example.com/blog/",
+        .max_rss_items = 30
+    };
+    site->builder = builder;
+}
+
+static void site_build(TestSite *site) {
+    SiteBuilder *builder = &site->builder;
+    mkdir_p(builder->output_dir);
+    assert(open_search_index(builder) == 0);
+    assert(process_directory(builder, builder->input_dir, builder->output_dir) == 0);
+    assert(close_search_index(builder) == 0);
+    assert(generate_index_page(builder, true) == 0);
+    assert(generate_archive_page(builder) == 0);
+    assert(generate_rss_feed(builder) == 0);
+}
+
+static char *site_read(TestSite *site, const char *name) {
+    char *path = join_path(site->builder.output_dir, name);
+    char *content = read_file(path);
+    free(path);
+    return content;
+}
+
+static void site_free(TestSite *site) {
+    free_posts(&site->builder);
+    char command[64];
+    snprintf(command, sizeof(command), "rm -rf '%s'", site->root);
+    assert(system(command) == 0);
+    free(site->posts);
+    free(site->builder.output_dir);
+}
+
+static void test_rss_bodies(void) {
+    printf("  test_rss_bodies...");
+
+    TestSite site;
+    site_init(&site);
+    write_file(site.posts, "old.org", "#+TITLE: Old\n#+DATE: <2023-01-02 Mon 10:00>\n\nOld *body*.\n");
+    write_file(site.posts, "new.org", "#+TITLE: New\n#+DATE: <2024-03-04 Mon 10:00>\n#+FILETAGS: news\n\nNew *body*.\n");
+    site_build(&site);
+
+    /* Bodies are parsed again from the sources, newest first */
+    char *rss = site_read(&site, "rss.xml");
+    assert_contains(rss, "<title><![CDATA[New]]></title>");
+    assert_contains(rss, "New <b>body</b>.");
+    assert_contains(rss, "Old <b>body</b>.");
+    assert(strstr(rss, "New <b>body</b>.") < strstr(rss, "Old <b>body</b>."));
+    assert_contains(rss, "<category><![CDATA[news]]></category>");
+    free(rss);
+
+    char *page = site_read(&site, "new.html");
+    assert_contains(page, "New <b>body</b>.");
+    free(page);
+
+    site_free(&site);
+    printf("  OK\n");
+}
+
+static void test_single_post(void) {
+    printf("  test_single_post...");
+
+    /* The path posts too large for a batch take: a handle whose body is
+     * streamed into one buffer, then written between the page halves */
+    TestSite site;
+    site_init(&site);
+    write_file(site.posts, "one.org", "#+TITLE: One\n#+DATE: <2024-05-06 Mon 10:00>\n\n* Heading\nStreamed *body*.\n");
+    mkdir_p(site.builder.output_dir);
+    char *input = join_path(site.posts, "one.org");
+    char *output = join_path(site.builder.output_dir, "one.html");
+    assert(process_org_file(&site.builder, input, output) == 0);
+
+    char *page = site_read(&site, "one.html");
+    assert_contains(page, "<title>One");
+    assert_contains(page, "Streamed <b>body</b>.");
+    assert(strstr(page, "Streamed <b>body</b>.") < strstr(page, "</html>"));
+    free(page);
+    assert(site.builder.post_count == 1);
+    assert(strcmp(site.builder.posts[0].path, "one.html") == 0);
+
+    free(input);
+    free(output);
+    site_free(&site);
+    printf("  OK\n");
+}
+
+static void test_listing_only(void) {
+    printf("  test_listing_only...");
+
+    TestSite site;
+    site_init(&site);
+    write_file(site.posts, "described.org", "#+TITLE: Described\n#+DATE: <2024-01-01 Mon 10:00>\n"
+        "#+DESCRIPTION: From the header\n#+FILETAGS: c\n\n* Body\nText.\n");
+    write_file(site.posts, "plain.org", "#+TITLE: Plain\n#+DATE: <2024-02-01 Thu 10:00>\n\nOpening words of the body.\n");
+
+    SiteBuilder *builder = &site.builder;
+    mkdir_p(builder->output_dir);
+    assert(scan_directory(builder, builder->input_dir, builder->output_dir) == 0);
+    assert(builder->post_count == 2);
+    assert(generate_index_page(builder, true) == 0);
+    assert(generate_rss_feed(builder) == 0);
+
+    char *index = site_read(&site, "index.html");
+    assert_contains(index, "From the header");
+    /* Posts without a description get the same excerpt as in a full build */
+    assert_contains(index, "Opening words of the body.");
+    free(index);
+
+    char *rss = site_read(&site, "rss.xml");
+    assert_contains(rss, "<category><![CDATA[c]]></category>");
+    free(rss);
+
+    /* No pages and no link data */
+    char *page = site_read(&site, "plain.html");
+    assert(page == NULL);
+    for (int i = 0; i < builder->post_count; i++) {
+        assert(builder->posts[i].links.href_count == 0);
+    }
+
+    site_free(&site);
+    printf("  OK\n");
+}
+
+static void test_search_and_links(void) {
+    printf("  test_search_and_links...");
+
+    TestSite site;
+    site_init(&site);
+    write_file(site.posts, "a.org", "#+TITLE: A\n#+DATE: <2024-01-01 Mon 10:00>\n\n"
+        "See [[./b.html#details][details]], [[./b.html#nowhere][nowhere]] and [[./missing.html][gone]].\n");
+    write_file(site.posts, "b.org", "#+TITLE: B\n#+DATE: <2024-02-01 Thu 10:00>\n\n* Details\nSearchable words.\n");
+    site_build(&site);
+
+    /* Written post by post during the build, not from the post list */
+    char *index = site_read(&site, "search.json");
+    assert_contains(index, "{\"url\":\"b.html\",\"title\":\"B\",\"date\":\"\\u003c2024-02-01 Thu 10:00>\"");
+    assert_contains(index, "{\"id\":\"details\",\"text\":\"Details\\nSearchable words.\"}");
+    assert_contains(index, "\"url\":\"a.html\"");
+    free(index);
+
+    /* The bodies are gone by now; only their links and ids are kept */
+    assert(site.builder.post_count == 2);
+    assert(report_broken_links(&site.builder) == 2);
+
+    site_free(&site);
+    printf("  OK\n");
+}
+
+static void test_links_between_directories(void) {
+    printf("  test_links_between_directories...");
+
+    /* Two posts with the same name; each link is resolved from the page
+     * it is on. */
+    TestSite site;
+    site_init(&site);
+    char *a = join_path(site.posts, "a");
+    char *b = join_path(site.posts, "b");
+    mkdir_p(a);
+    mkdir_p(b);
+    write_file(a, "same.org", "#+TITLE: A\n#+DATE: <2024-01-01 Mon 10:00>\n\n* Only A\n"
+        "[[../b/same.html#only-b][b]], [[./same.html#only-a][self]], [[../index.html][home]],\n"
+        "[[../b/same.html#only-a][wrong page]] and [[index.html][wrong directory]].\n");
+    write_file(b, "same.org", "#+TITLE: B\n#+DATE: <2024-02-01 Thu 10:00>\n\n* Only B\n"
+        "[[../a/./same.html#only-a][a]].\n");
+    site_build(&site);
+
+    assert(site.builder.post_count == 2);
+    assert(report_broken_links(&site.builder) == 2);
+
+    free(a);
+    free(b);
+    site_free(&site);
+    printf("  OK\n");
+}
+
+static void test_image_sizes(void) {
+    printf("  test_image_sizes...");
+
+    /* One image next to the post, one from the custom templates that are
+     * copied over the output; the output directory is empty when the post
+     * is built. */
+    TestSite site;
+    site_init(&site);
+    char *sub = join_path(site.posts, "sub");
+    mkdir_p(sub);
+    unsigned char gif[] = {'G', 'I', 'F', '8', '9', 'a', 12, 0, 34, 0, 0x80, 0, 0};
+    char *gif_path = join_path(sub, "pic.gif");
+    FILE *f = fopen(gif_path, "wb");
+    assert(f != NULL);
+    fwrite(gif, 1, sizeof(gif), f);
+    fclose(f);
+    write_file(sub, "post.org", "#+TITLE: Pictures\n#+DATE: <2024-01-01 Mon 10:00>\n\n"
+        "[[file:pic.gif]]\n\n[[file:../assets/shiba_gif/shiba_idle_8fps.gif]]\n");
+
+    assert(org_set_option(ORG_OPTION_IMAGE_HINTS, 1) == 0);
+    site_build(&site);
+    assert(org_set_option(ORG_OPTION_IMAGE_HINTS, 0) == 0);
+
+    char *page = site_read(&site, "sub/post.html");
+    assert_contains(page, "<img src=\"pic.gif\" width=\"12\" height=\"34\"");
+    assert_contains(page, "<img src=\"../assets/shiba_gif/shiba_idle_8fps.gif\" width=\"174\" height=\"115\"");
+    free(page);
+
+    /* The feed parses the post again and sizes its images the same way */
+    char *rss = site_read(&site, "rss.xml");
+    assert_contains(rss, "<img src=\"pic.gif\" width=\"12\" height=\"34\"");
+    free(rss);
+
+    free(gif_path);
+    free(sub);
+    site_free(&site);
+    printf("  OK\n");
+}
+
+int main(void) {
+    printf("Running site builder tests...\n");
+
+    test_rss_bodies();
+    test_single_post();
+    test_search_and_links();
+    test_listing_only();
+    test_links_between_directories();
+    test_image_sizes();
+
+    printf("All site builder tests passed!\n");
+    return 0;
+}
@@ -114,6 +114,22 @@ void test_string_large_append() {
     printf("  ✓ large string append passed\n");
 }
 
+void test_string_release() {
+    printf("Testing string release...\n");
+
+    String *s = string_create(16);
+    assert(s != NULL);
+    string_append_cstr(s, "Owned");
+
+    char *data = string_release(s);
+    assert(data != NULL);
+    assert(strcmp(data, "Owned") == 0);
+    free(data);
+
+    assert(string_release(NULL) == NULL);
+    printf("  ✓ string release passed\n");
+}
+
 int main() {
     printf("=== String Utility Tests ===\n\n");
 
@@ -122,6 +138,7 @@ int main() {
     test_string_append();
     test_string_edge_cases();
     test_string_large_append();
+    test_string_release();
 
     printf("\n✓ All string tests passed!\n");
     return 0;
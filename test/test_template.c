@@ -160,6 +160,107 @@ static void test_template_missing_var() {
     printf("Template with missing variable: PASS\n");
 }
 
+static void test_template_set_var_owned() {
+    printf("\nTesting template owned variable...\n");
+
+    create_test_template("/tmp/test_template6.html");
+
+    Template *t = template_create("/tmp/test_template6.html", "/tmp");
+    if (!t) {
+        printf("ERROR: Failed to create template\n");
+        return;
+    }
+
+    char *value = strdup("Owned Content");
+    template_set_var_owned(t, "content", value);
+    assert(t->var_count == 1);
+    assert(t->vars[0].value == value);
+
+    template_set_var_owned(t, "content", strdup("Replaced"));
+    assert(t->var_count == 1);
+    assert(strcmp(t->vars[0].value, "Replaced") == 0);
+
+    String *output = string_create(1024);
+    template_render(t, output);
+    assert(strstr(output->data, "<p>Replaced</p>") != NULL);
+
+    string_free(output);
+    template_free(t);
+    printf("Template owned variable: PASS\n");
+}
+
+static void test_template_set_var_borrowed() {
+    printf("\nTesting template borrowed variable...\n");
+
+    create_test_template("/tmp/test_template7.html");
+
+    Template *t = template_create("/tmp/test_template7.html", "/tmp");
+    if (!t) {
+        printf("ERROR: Failed to create template\n");
+        return;
+    }
+
+    /* Neither replacing nor freeing the template may free() these */
+    char first[] = "Borrowed Content";
+    char second[] = "Borrowed Again";
+    template_set_var_borrowed(t, "content", first);
+    assert(t->vars[0].value == first);
+    String *output = string_create(1024);
+    template_render(t, output);
+    assert(strstr(output->data, "<p>Borrowed Content</p>") != NULL);
+
+    template_set_var_borrowed(t, "content", second);
+    assert(t->var_count == 1);
+    output->len = 0;
+    template_render(t, output);
+    assert(strstr(output->data, "<p>Borrowed Again</p>") != NULL);
+
+    /* An owned value replacing a borrowed one is freed as usual */
+    template_set_var_owned(t, "content", strdup("Owned"));
+    template_set_var_borrowed(t, "title", first);
+    output->len = 0;
+    template_render(t, output);
+    assert(strstr(output->data, "<p>Owned</p>") != NULL);
+    assert(strstr(output->data, "<title>Borrowed Content</title>") != NULL);
+
+    string_free(output);
+    template_free(t);
+    assert(strcmp(first, "Borrowed Content") == 0);
+    printf("Template borrowed variable: PASS\n");
+}
+
+static void test_template_render_split() {
+    printf("\nTesting template split rendering...\n");
+
+    create_test_template("/tmp/test_template8.html");
+
+    Template *t = template_create("/tmp/test_template8.html", "/tmp");
+    if (!t) {
+        printf("ERROR: Failed to create template\n");
+        return;
+    }
+
+    template_set_var(t, "title", "Split");
+    template_set_var(t, "content", "never copied");
+    template_set_var(t, "footer", "Footer");
+
+    String *before = string_create(64);
+    String *after = string_create(64);
+    template_render_split(t, "content", before, after);
+
+    /* The two halves are the page without the split variable */
+    assert(strstr(before->data, "<title>Split</title>") != NULL);
+    assert(strcmp(before->data + before->len - 5, "  <p>") == 0);
+    assert(strncmp(after->data, "</p>\n  <footer>Footer</footer>", 30) == 0);
+    assert(strstr(before->data, "never copied") == NULL);
+    assert(strstr(after->data, "never copied") == NULL);
+
+    string_free(before);
+    string_free(after);
+    template_free(t);
+    printf("Template split rendering: PASS\n");
+}
+
 int main() {
     printf("=== Template System Tests ===\n\n");
 
@@ -168,6 +269,9 @@ int main() {
     test_template_render();
     test_template_var_update();
     test_template_missing_var();
+    test_template_set_var_owned();
+    test_template_set_var_borrowed();
+    test_template_render_split();
 
     printf("\n=== All template tests passed! ===\n");
     return 0;